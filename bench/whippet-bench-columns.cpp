@@ -0,0 +1,85 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+/// integrates position by velocity; one-at-a-time through visit vs the batch kernels over columns
+
+#include <whippet.hpp>
+#include <whippet.kernels.hpp>
+
+#include <benchmark/benchmark.h>
+
+namespace
+{
+	typedef whippet::kernels::motion motion;
+
+	/// a universe full of motion, packed by sort()
+	struct world
+	{
+		whippet::universe _universe;
+
+		world(const size_t count)
+		{
+			_universe.install<motion>();
+
+			for (size_t i = 0; i < count; ++i)
+				_universe.create().attach<motion>(float(i), 0.f, 0.f, 1.f, 2.f, 3.f);
+
+			_universe.sort<motion>();
+		}
+	};
+
+	void columns_visit(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+
+		float dt = 1.f / 60.f;
+
+		for (auto _ : state)
+			world._universe.visit<float, motion>(dt, [](float& dt, motion& next)
+			{
+				for (int i = 0; i < 3; ++i)
+					next._position[i] += next._velocity[i] * dt;
+				return true;
+			});
+
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+	}
+
+	template<void(*KERNEL)(const whippet::column<motion>&, float)>
+	void columns_kernel(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+
+		float dt = 1.f / 60.f;
+
+		for (auto _ : state)
+			world._universe.columns<float, motion>(dt, [](float& dt, whippet::column<motion>& column)
+			{
+				KERNEL(column, dt);
+				return true;
+			});
+
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+	}
+}
+
+BENCHMARK(columns_visit)->Range(1000, 1000000);
+BENCHMARK_TEMPLATE(columns_kernel, whippet::kernels::integrate_scalar)->Range(1000, 1000000);
+#ifdef whippet__kernels_sse
+BENCHMARK_TEMPLATE(columns_kernel, whippet::kernels::integrate_sse)->Range(1000, 1000000);
+#endif
+#ifdef whippet__kernels_avx2
+BENCHMARK_TEMPLATE(columns_kernel, whippet::kernels::integrate_avx2)->Range(1000, 1000000);
+#endif
+#ifdef whippet__kernels_simd
+BENCHMARK_TEMPLATE(columns_kernel, whippet::kernels::integrate_simd)->Range(1000, 1000000);
+#endif
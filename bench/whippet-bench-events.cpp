@@ -0,0 +1,446 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+
+/// events per second through pal::event_manager; producers broadcasting from their own threads into handlers that count
+/// ... the counts are of whole runs, so thread start-up is amortised over EVENTS
+
+#include <pal.hpp>
+
+#include <stdint.h>
+
+namespace
+{
+	/// a 256 byte message
+	struct payload
+	{
+		uint64_t _words[32];
+
+		payload(void) {}
+
+		payload(const uint64_t word)
+		{
+			for (auto& each : _words)
+				each = word;
+		}
+	};
+
+	/// a message for one of the lanes
+	struct prioritised
+	{
+		uint64_t _lane;
+		uint64_t _value;
+	};
+
+	/// a message for one subscriber
+	struct targeted
+	{
+		uint32_t _topic;
+		uint64_t _value;
+	};
+}
+
+namespace pal
+{
+	template<>
+	struct event_key<targeted>
+	{
+		static const bool enabled = true;
+
+		static uint32_t key(const targeted& message) { return message._topic; }
+	};
+
+	template<>
+	struct event_lane<prioritised>
+	{
+		static size_t lane(const prioritised& message) { return static_cast<size_t>(message._lane); }
+	};
+}
+
+#define pal_event_manager_E uint64_t
+#define pal_event_manager_cpp
+#include <pal.inc.event_manager.hpp>
+
+// payload, targeted and prioritised are local to this file; so, the parts of their event_managers that aren't used here would be warned about
+#define pal_event_manager_E payload
+#undef pal_event_manager_cpp
+#define pal_event_manager_cpp [[maybe_unused]]
+#include <pal.inc.event_manager.hpp>
+
+#define pal_event_manager_E targeted
+#define pal_event_manager_cpp [[maybe_unused]]
+#include <pal.inc.event_manager.hpp>
+
+#define pal_event_manager_E prioritised
+#define pal_event_manager_cpp [[maybe_unused]]
+#include <pal.inc.event_manager.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	/// events per iteration, split between the producers
+	const uint64_t EVENTS = 1 << 16;
+
+	struct counter
+	{
+		std::atomic<uint64_t> _count;
+
+		counter(void) : _count(0) {}
+
+		static void count(counter* self, const uint64_t&)
+		{
+			// only the event thread writes this
+			self->_count.store(self->_count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+	};
+
+	/// range(0) producers broadcast into range(1) handlers
+	void events_broadcast(benchmark::State& state)
+	{
+		const auto producers = static_cast<size_t>(state.range(0));
+		const auto handlers = static_cast<size_t>(state.range(1));
+
+		pal::event_manager<uint64_t> events;
+		std::unique_ptr<counter[]> counters(new counter[handlers]);
+		for (size_t i = 0; i < handlers; ++i)
+			events.attach(&counters[i], counter::count);
+
+		uint64_t expected = 0;
+		for (auto _ : state)
+		{
+			std::vector<std::thread> threads;
+			for (size_t p = 0; p < producers; ++p)
+				threads.emplace_back([&events, producers]
+				{
+					for (uint64_t i = 0; i < EVENTS / producers; ++i)
+						events.broadcast(i);
+				});
+
+			for (auto& thread : threads)
+				thread.join();
+
+			expected += (EVENTS / producers) * producers;
+			for (size_t i = 0; i < handlers; ++i)
+				while (counters[i]._count.load(std::memory_order_acquire) < expected)
+					std::this_thread::yield();
+		}
+
+		state.SetItemsProcessed(state.iterations() * (EVENTS / producers) * producers);
+	}
+
+	/// takes about a microsecond per message
+	void dawdle(void*, const uint64_t&)
+	{
+		const auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(1);
+		while (std::chrono::steady_clock::now() < until)
+			;
+	}
+
+	/// how long a quick handler takes to see SLOW messages while a slow one is attached
+	/// ... range(0) is the slow one's pal::dispatch::affinity (event_thread or dedicated, dropping the oldest when it falls behind)
+	void events_slow_handler(benchmark::State& state)
+	{
+		const uint64_t SLOW = EVENTS / 16;
+		const auto affinity = static_cast<pal::dispatch::affinity>(state.range(0));
+
+		pal::event_manager<uint64_t> events;
+		counter quick;
+		events.attach(&quick, counter::count);
+		events.attach<void>(nullptr, dawdle, pal::dispatch(affinity, pal::dispatch::backpressure::drop_oldest, 64));
+
+		uint64_t expected = 0;
+		for (auto _ : state)
+		{
+			for (uint64_t i = 0; i < SLOW; ++i)
+				events.broadcast(i);
+
+			expected += SLOW;
+			while (quick._count.load(std::memory_order_acquire) < expected)
+				std::this_thread::yield();
+		}
+
+		state.SetItemsProcessed(state.iterations() * SLOW);
+	}
+
+	struct reader
+	{
+		std::atomic<uint64_t> _count;
+		uint64_t _sum;
+
+		reader(void) : _count(0), _sum(0) {}
+
+		static void read(reader* self, const payload& message)
+		{
+			self->_sum += message._words[31];
+			self->_count.store(self->_count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+	};
+
+	/// 256 byte messages from one producer, sent by copy (0), move (1), emplace (2) or in batches of 64 (3)
+	void events_payload(benchmark::State& state)
+	{
+		const uint64_t COUNT = EVENTS / 4;
+		const uint64_t BATCH = 64;
+
+		pal::event_manager<payload> events;
+		reader handler;
+		events.attach(&handler, reader::read);
+
+		std::vector<payload> batch(BATCH);
+
+		uint64_t expected = 0;
+		for (auto _ : state)
+		{
+			switch (state.range(0))
+			{
+				case 0:
+					for (uint64_t i = 0; i < COUNT; ++i)
+					{
+						const payload message(i);
+						events.broadcast(message);
+					}
+					break;
+
+				case 1:
+					for (uint64_t i = 0; i < COUNT; ++i)
+						events.broadcast(payload(i));
+					break;
+
+				case 2:
+					for (uint64_t i = 0; i < COUNT; ++i)
+						events.emplace_broadcast(i);
+					break;
+
+				case 3:
+					for (uint64_t i = 0; i < COUNT; i += BATCH)
+					{
+						for (uint64_t j = 0; j < BATCH; ++j)
+							batch[j] = payload(i + j);
+						events.broadcast_batch(batch.data(), BATCH);
+					}
+					break;
+			}
+
+			expected += COUNT;
+			while (handler._count.load(std::memory_order_acquire) < expected)
+				std::this_thread::yield();
+		}
+
+		state.SetItemsProcessed(state.iterations() * COUNT);
+		state.SetBytesProcessed(state.iterations() * COUNT * sizeof(payload));
+	}
+
+	/// one of many subscribers, each listening for its own topic
+	struct subscriber
+	{
+		uint32_t _topic;
+		std::atomic<uint64_t>* _heard;
+
+		static void hear(subscriber* self, const targeted& message)
+		{
+			if (message._topic != self->_topic)
+				return;
+
+			// only the event thread writes this
+			self->_heard->store(self->_heard->load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+	};
+
+	/// messages to one of range(0) subscribers, found by topic (range(1) = 0) or by calling every one of them to check (1)
+	void events_topics(benchmark::State& state)
+	{
+		const auto subscribers = static_cast<uint32_t>(state.range(0));
+		const bool wildcard = 0 != state.range(1);
+
+		std::atomic<uint64_t> heard(0);
+		std::vector<subscriber> each(subscribers);
+
+		pal::event_manager<targeted> events;
+		for (uint32_t i = 0; i < subscribers; ++i)
+		{
+			each[i]._topic = i;
+			each[i]._heard = &heard;
+
+			if (wildcard)
+				events.attach(&each[i], subscriber::hear);
+			else
+				events.attach(&each[i], subscriber::hear, i);
+		}
+
+		uint64_t expected = 0;
+		for (auto _ : state)
+		{
+			for (uint64_t i = 0; i < EVENTS; ++i)
+				events.broadcast(targeted{ static_cast<uint32_t>(i % subscribers), i });
+
+			expected += EVENTS;
+			while (heard.load(std::memory_order_acquire) < expected)
+				std::this_thread::yield();
+		}
+
+		state.SetItemsProcessed(state.iterations() * EVENTS);
+	}
+
+	/// TIMERS timers armed (with due times spread over ten seconds) and then cancelled (range(0) = 0),
+	/// ... or armed to go off within 50ms, and waited for (1)
+	void events_timers(benchmark::State& state)
+	{
+		const uint64_t TIMERS = 100000;
+		const bool fire = 0 != state.range(0);
+
+		pal::event_manager<uint64_t> events;
+		counter handler;
+		events.attach(&handler, counter::count);
+
+		std::vector<pal::event_manager<uint64_t>::timer> timers(TIMERS);
+
+		uint64_t expected = 0;
+		for (auto _ : state)
+		{
+			const auto now = std::chrono::steady_clock::now();
+			const uint64_t spread = fire ? 50 : 10000;
+
+			for (uint64_t i = 0; i < TIMERS; ++i)
+				timers[i] = events.broadcast_at(now + std::chrono::milliseconds((i * 7919) % spread), i);
+
+			if (fire)
+			{
+				expected += TIMERS;
+				while (handler._count.load(std::memory_order_acquire) < expected)
+					std::this_thread::yield();
+			}
+			else
+				for (auto& timer : timers)
+					events.cancel(timer);
+		}
+
+		state.SetItemsProcessed(state.iterations() * TIMERS);
+	}
+
+	/// notes the urgent messages, and takes about a microsecond over the rest
+	struct urgent
+	{
+		std::atomic<uint64_t> _seen;
+
+		urgent(void) : _seen(0) {}
+
+		static void handle(urgent* self, const prioritised& message)
+		{
+			if (0 == message._lane)
+			{
+				self->_seen.store(message._value, std::memory_order_release);
+				return;
+			}
+
+			const auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(1);
+			while (std::chrono::steady_clock::now() < until)
+				;
+		}
+	};
+
+	/// how long an urgent message takes to be handled while another thread floods the event thread with slow ones
+	/// ... range(0) lanes; with one they all queue together, with two the urgent messages are (strictly) ahead of the flood
+	void events_urgent(benchmark::State& state)
+	{
+		pal::event_manager<prioritised> events(pal::event_manager<prioritised>::CAPACITY, 0, pal::lanes(static_cast<size_t>(state.range(0))));
+		urgent handler;
+		events.attach(&handler, urgent::handle);
+
+		std::atomic<bool> stop(false);
+		std::thread flood([&events, &stop]
+		{
+			while (!stop)
+				events.broadcast(prioritised{ 1, 0 });
+		});
+
+		uint64_t sent = 0;
+		for (auto _ : state)
+		{
+			events.broadcast(prioritised{ 0, ++sent });
+			while (handler._seen.load(std::memory_order_acquire) < sent)
+				std::this_thread::yield();
+		}
+
+		stop = true;
+		flood.join();
+	}
+
+	/// appends each message to a journal, and counts them
+	struct journaled
+	{
+		pal::journal _journal;
+		std::atomic<uint64_t> _count;
+
+		journaled(void) : _count(0) {}
+
+		static void append(journaled* self, const uint64_t& message)
+		{
+			self->_journal.append(&message);
+
+			// only the journal's thread writes this
+			self->_count.store(self->_count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+		}
+	};
+
+	/// one producer broadcasting into a counting handler, without (range(0) = 0) or with (1) a journal on a thread of its own
+	void events_journal(benchmark::State& state)
+	{
+		const auto path = (std::filesystem::temp_directory_path() / "whippet-bench-journal").string();
+		const bool journal = 0 != state.range(0);
+
+		journaled sink;
+		counter handler;
+		{
+			pal::event_manager<uint64_t> events;
+			events.attach(&handler, counter::count);
+
+			if (journal)
+			{
+				sink._journal.open(path.c_str(), sizeof(uint64_t), pal::journal::SEGMENT, 4);
+				events.attach(&sink, journaled::append, pal::dispatch(pal::dispatch::affinity::dedicated, pal::dispatch::backpressure::block, 1 << 14));
+			}
+
+			uint64_t expected = 0;
+			for (auto _ : state)
+			{
+				for (uint64_t i = 0; i < EVENTS; ++i)
+					events.broadcast(i);
+
+				expected += EVENTS;
+				while (handler._count.load(std::memory_order_acquire) < expected || (journal && sink._count.load(std::memory_order_acquire) < expected))
+					std::this_thread::yield();
+			}
+
+			state.SetItemsProcessed(state.iterations() * EVENTS);
+		}
+
+		sink._journal.close();
+		for (int i = 0; i < 64; ++i)
+			std::filesystem::remove(path + "." + std::to_string(i));
+	}
+}
+
+BENCHMARK(events_broadcast)->ArgsProduct({ { 1, 2, 4, 8 }, { 1, 8 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(events_payload)->DenseRange(0, 3)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(events_slow_handler)->Arg(int(pal::dispatch::affinity::event_thread))->Arg(int(pal::dispatch::affinity::dedicated))->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(events_topics)->ArgsProduct({ { 10, 50, 200, 1000 }, { 0, 1 } })->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(events_timers)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+BENCHMARK(events_urgent)->Arg(1)->Arg(2)->Unit(benchmark::kMicrosecond)->UseRealTime();
+BENCHMARK(events_journal)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
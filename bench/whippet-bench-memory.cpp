@@ -0,0 +1,184 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+/// measures how many bytes each (tiny) component costs
+/// ... the global allocator is replaced with one that keeps a tally
+
+#include <whippet.hpp>
+
+#include <benchmark/benchmark.h>
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <vector>
+
+namespace
+{
+	/// every byte handed out by new
+	std::atomic<size_t> g_bytes_total(0);
+
+	/// the bytes handed out for storage blocks (the aligned allocations)
+	std::atomic<size_t> g_bytes_block(0);
+
+	/// room in front of each allocation to remember its size
+	const size_t PREFIX = alignof(std::max_align_t);
+
+	void* tally_alloc(size_t size, size_t align, std::atomic<size_t>& bytes)
+	{
+		const auto prefix = align < PREFIX ? PREFIX : align;
+		auto base = reinterpret_cast<uint8_t*>(malloc(size + prefix + align));
+		if (nullptr == base)
+			throw std::bad_alloc();
+
+		auto data = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(base) + prefix + align - 1) & ~static_cast<uintptr_t>(align - 1));
+
+		reinterpret_cast<void**>(data)[-1] = base;
+		reinterpret_cast<size_t*>(data)[-2] = size;
+
+		bytes += size;
+		return data;
+	}
+
+	void tally_free(void* data, std::atomic<size_t>& bytes)
+	{
+		if (nullptr == data)
+			return;
+
+		bytes -= reinterpret_cast<size_t*>(data)[-2];
+		free(reinterpret_cast<void**>(data)[-1]);
+	}
+}
+
+void* operator new(size_t size) { return tally_alloc(size, PREFIX, g_bytes_total); }
+void* operator new[](size_t size) { return tally_alloc(size, PREFIX, g_bytes_total); }
+void operator delete(void* data) noexcept { tally_free(data, g_bytes_total); }
+void operator delete[](void* data) noexcept { tally_free(data, g_bytes_total); }
+void operator delete(void* data, size_t) noexcept { tally_free(data, g_bytes_total); }
+void operator delete[](void* data, size_t) noexcept { tally_free(data, g_bytes_total); }
+
+void* operator new(size_t size, std::align_val_t align)
+{
+	g_bytes_block += size;
+	return tally_alloc(size, static_cast<size_t>(align), g_bytes_total);
+}
+void operator delete(void* data, std::align_val_t) noexcept
+{
+	if (nullptr != data)
+		g_bytes_block -= reinterpret_cast<size_t*>(data)[-2];
+	tally_free(data, g_bytes_total);
+}
+void operator delete(void* data, size_t, std::align_val_t align) noexcept
+{
+	operator delete(data, align);
+}
+
+namespace
+{
+	/// the header and one small value
+	struct tiny : whippet::_component
+	{
+		uint32_t _value;
+		tiny(uint32_t value) : _value(value) {}
+	};
+
+	/// nothing but the header; stored as bits
+	struct marker : whippet::_component
+	{
+		marker(int) {}
+	};
+
+	void memory_tiny_components(benchmark::State& state)
+	{
+		const auto count = static_cast<size_t>(state.range(0));
+
+		size_t total = 0;
+		size_t block = 0;
+
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			{
+				const size_t before_total = g_bytes_total;
+				const size_t before_block = g_bytes_block;
+
+				whippet::universe universe;
+				universe.install<tiny>();
+
+				auto entity = universe.create();
+
+				state.ResumeTiming();
+				for (size_t i = 0; i < count; ++i)
+					entity.attach<tiny>(static_cast<uint32_t>(i));
+				state.PauseTiming();
+
+				total = g_bytes_total - before_total;
+				block = g_bytes_block - before_block;
+			}
+			state.ResumeTiming();
+		}
+
+		state.counters["sizeof"] = static_cast<double>(sizeof(tiny));
+		state.counters["per_cache_line"] = static_cast<double>(64 / sizeof(tiny));
+		state.counters["storage_bytes/component"] = static_cast<double>(block) / count;
+		state.counters["total_bytes/component"] = static_cast<double>(total) / count;
+		state.SetItemsProcessed(state.iterations() * count);
+	}
+
+	void memory_tag_components(benchmark::State& state)
+	{
+		const auto count = static_cast<size_t>(state.range(0));
+
+		size_t storage = 0;
+
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			{
+				whippet::universe universe;
+				universe.install<marker>();
+
+				std::vector<whippet::entity> entities;
+				entities.reserve(count);
+				for (size_t i = 0; i < count; ++i)
+					entities.push_back(universe.create());
+
+				const size_t before = g_bytes_total;
+
+				state.ResumeTiming();
+				for (auto& entity : entities)
+					entity.attach<marker>(0);
+				state.PauseTiming();
+
+				storage = g_bytes_total - before;
+			}
+			state.ResumeTiming();
+		}
+
+		state.counters["storage_bytes/component"] = static_cast<double>(storage) / count;
+		state.SetItemsProcessed(state.iterations() * count);
+	}
+}
+
+BENCHMARK(memory_tiny_components)
+	->Arg(100000)
+	->Arg(1000000)
+	->Arg(10000000)
+	->Iterations(1)
+	->Unit(benchmark::kMillisecond);
+
+BENCHMARK(memory_tag_components)
+	->Arg(100000)
+	->Arg(1000000)
+	->Arg(10000000)
+	->Iterations(1)
+	->Unit(benchmark::kMillisecond);
@@ -0,0 +1,762 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+/// the core operations, each swept over universes of 1e3 to 1e7 components
+/// ... use --benchmark_filter to pick; the bigger sizes take a while to set up
+
+#include <whippet.hpp>
+#include <whippet.hierarchy.hpp>
+#include <whippet.static.hpp>
+
+#ifdef __cpp_impl_coroutine
+#	include <whippet.tasks.hpp>
+#endif
+
+#include <benchmark/benchmark.h>
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+	struct value : whippet::_component
+	{
+		uint32_t _value;
+		value(uint32_t v) : _value(v) {}
+	};
+
+	struct other : whippet::_component
+	{
+		float _other;
+		other(float v) : _other(v) {}
+	};
+
+	/// a universe with `count` entities, each with a value (and every fourth with an other)
+	template<typename U>
+	struct basic_world
+	{
+		U _universe;
+		std::vector<decltype(std::declval<U&>().create())> _entities;
+
+		basic_world(const size_t count)
+		{
+			_universe.template install<value>();
+			_universe.template install<other>();
+
+			_entities.reserve(count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				auto entity = _universe.create();
+				entity.template attach<value>(static_cast<uint32_t>(i));
+				if (0 == (i % 4))
+					entity.template attach<other>(float(i));
+				_entities.push_back(entity);
+			}
+		}
+
+		size_t components(void) const
+		{
+			return _entities.size() + ((_entities.size() + 3) / 4);
+		}
+	};
+
+	typedef basic_world<whippet::universe> world;
+
+	/// the same, but, with the component types fixed up front
+	typedef basic_world<whippet::static_universe<value, other>> static_world;
+
+	void sweep(benchmark::internal::Benchmark* benchmark)
+	{
+		benchmark->RangeMultiplier(10)->Range(1000, 10000000)->Unit(benchmark::kMicrosecond);
+	}
+
+	/// an entity comes, gets a component, and goes
+	void churn_create_remove(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+
+		for (auto _ : state)
+		{
+			auto entity = world._universe.create();
+			entity.attach<value>(0);
+			entity.remove();
+		}
+
+		state.SetItemsProcessed(state.iterations());
+	}
+
+	void churn_attach_detach(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+
+		auto entity = world._entities[world._entities.size() / 2];
+
+		for (auto _ : state)
+			entity.attach<other>(1.f).detach();
+
+		state.SetItemsProcessed(state.iterations());
+	}
+
+	void visit_typed(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+
+		uint64_t sum = 0;
+		for (auto _ : state)
+			world._universe.visit<uint64_t, value>(sum, [](uint64_t& sum, value& next)
+			{
+				sum += next._value;
+				return true;
+			});
+
+		benchmark::DoNotOptimize(sum);
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+	}
+
+	void visit_untyped(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+
+		uint64_t count = 0;
+		for (auto _ : state)
+			world._universe.visit<uint64_t, whippet::_component>(count, [](uint64_t& count, whippet::_component&)
+			{
+				++count;
+				return true;
+			});
+
+		benchmark::DoNotOptimize(count);
+		state.SetItemsProcessed(state.iterations() * world.components());
+	}
+
+	/// everything on one entity; this has to look through every component to find them
+	void visit_entity(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+
+		auto entity = world._entities[world._entities.size() / 2];
+
+		uint64_t count = 0;
+		for (auto _ : state)
+			entity.visit<uint64_t>(count, [](uint64_t& count, whippet::_component&)
+			{
+				++count;
+				return true;
+			});
+
+		benchmark::DoNotOptimize(count);
+		state.SetItemsProcessed(state.iterations());
+	}
+
+	/// churn_create_remove, visit_typed and visit_untyped again; without the map and virtual calls between them and the storage
+	void static_churn_create_remove(benchmark::State& state)
+	{
+		static_world world(static_cast<size_t>(state.range(0)));
+
+		for (auto _ : state)
+		{
+			auto entity = world._universe.create();
+			entity.attach<value>(0);
+			entity.remove();
+		}
+
+		state.SetItemsProcessed(state.iterations());
+	}
+
+	void static_visit_typed(benchmark::State& state)
+	{
+		static_world world(static_cast<size_t>(state.range(0)));
+
+		uint64_t sum = 0;
+		for (auto _ : state)
+			world._universe.visit<uint64_t, value>(sum, [](uint64_t& sum, value& next)
+			{
+				sum += next._value;
+				return true;
+			});
+
+		benchmark::DoNotOptimize(sum);
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+	}
+
+	void static_visit_untyped(benchmark::State& state)
+	{
+		static_world world(static_cast<size_t>(state.range(0)));
+
+		uint64_t count = 0;
+		for (auto _ : state)
+			world._universe.visit<uint64_t, whippet::_component>(count, [](uint64_t& count, whippet::_component&)
+			{
+				++count;
+				return true;
+			});
+
+		benchmark::DoNotOptimize(count);
+		state.SetItemsProcessed(state.iterations() * world.components());
+	}
+
+#ifdef whippet__porcelain
+	void porcelain_component(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+
+		size_t index = 0;
+		uint64_t sum = 0;
+		for (auto _ : state)
+		{
+			sum += whippet::porcelain::component<value>(world._entities[index])._value;
+			index = (index + 7919) % world._entities.size();
+		}
+
+		benchmark::DoNotOptimize(sum);
+		state.SetItemsProcessed(state.iterations());
+	}
+#endif
+
+	/// detach everything, then, weed out the emptied layers
+	void weed(benchmark::State& state)
+	{
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			{
+				world world(static_cast<size_t>(state.range(0)));
+				for (auto& entity : world._entities)
+					entity.remove();
+
+				state.ResumeTiming();
+				world._universe.weed();
+				state.PauseTiming();
+			}
+			state.ResumeTiming();
+		}
+
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+	}
+
+	void teardown(benchmark::State& state)
+	{
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			auto world = new ::world(static_cast<size_t>(state.range(0)));
+			state.ResumeTiming();
+
+			delete world;
+		}
+
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+	}
+
+	/// visit after the storage has been sorted by owner
+	void visit_sorted(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+
+		world._universe.sort<value>();
+
+		uint64_t sum = 0;
+		for (auto _ : state)
+			world._universe.visit<uint64_t, value>(sum, [](uint64_t& sum, value& next)
+			{
+				sum += next._value;
+				return true;
+			});
+
+		benchmark::DoNotOptimize(sum);
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+	}
+
+	/// a world read back from a snapshot (in memory) a block at a time
+	void snapshot_restore(benchmark::State& state)
+	{
+		std::string bytes;
+		{
+			world world(static_cast<size_t>(state.range(0)));
+			std::stringstream out;
+			world._universe.snapshot(out);
+			bytes = out.str();
+		}
+
+		for (auto _ : state)
+		{
+			auto universe = std::make_unique<whippet::universe>();
+			universe->install<value>();
+			universe->install<other>();
+
+			std::stringstream in(bytes);
+			if (!universe->restore(in))
+				state.SkipWithError("couldn't restore");
+
+			state.PauseTiming();
+			universe.reset();
+			state.ResumeTiming();
+		}
+
+		state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(bytes.size()));
+	}
+
+	/// a world read back from a snapshot file with the blocks mapped in place
+	void snapshot_map(benchmark::State& state)
+	{
+		const char* path = "whippet-bench-snapshot.bin";
+		{
+			world world(static_cast<size_t>(state.range(0)));
+			std::ofstream out(path, std::ios_base::binary);
+			world._universe.snapshot(out);
+		}
+
+		for (auto _ : state)
+		{
+			auto universe = std::make_unique<whippet::universe>();
+			universe->install<value>();
+			universe->install<other>();
+
+			if (!universe->map(path))
+				state.SkipWithError("couldn't map");
+
+			state.PauseTiming();
+			universe.reset();
+			state.ResumeTiming();
+		}
+
+		remove(path);
+	}
+
+	/// what the rollback benchmarks do each tick; change every value and make a few things
+	void rollback_tick(world& world)
+	{
+		uint32_t step = 1;
+		world._universe.visit<uint32_t, value>(step, [](uint32_t& step, value& next)
+		{
+			next._value += step;
+			return true;
+		});
+
+		for (uint32_t i = 0; i < 16; ++i)
+			world._universe.create().attach<value>(i);
+	}
+
+	const int ROLLBACK_TICKS = 8;
+
+	/// mark, run some ticks, roll back, and run them again
+	void rollback_mark(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+
+		for (auto _ : state)
+		{
+			world._universe.mark();
+
+			for (int i = 0; i < ROLLBACK_TICKS; ++i)
+				rollback_tick(world);
+
+			world._universe.rollback();
+
+			for (int i = 0; i < ROLLBACK_TICKS; ++i)
+				rollback_tick(world);
+		}
+	}
+
+	/// the same as rollback_mark with a whole snapshot instead
+	void rollback_snapshot(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+
+		for (auto _ : state)
+		{
+			std::stringstream saved;
+			world._universe.snapshot(saved);
+
+			for (int i = 0; i < ROLLBACK_TICKS; ++i)
+				rollback_tick(world);
+
+			world._universe.restore(saved);
+
+			for (int i = 0; i < ROLLBACK_TICKS; ++i)
+				rollback_tick(world);
+		}
+	}
+
+	/// a tick's delta; written and applied to a copy
+	void rollback_delta(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+
+		std::stringstream saved;
+		world._universe.snapshot(saved);
+
+		whippet::universe copy;
+		copy.install<value>();
+		copy.install<other>();
+		copy.restore(saved);
+
+		world._universe.mark();
+
+		size_t bytes = 0;
+		for (auto _ : state)
+		{
+			rollback_tick(world);
+
+			std::stringstream delta;
+			world._universe.delta(delta);
+			world._universe.mark();
+
+			bytes += delta.str().size();
+			if (!copy.apply(delta))
+				state.SkipWithError("couldn't apply");
+		}
+
+		state.counters["delta_bytes"] = benchmark::Counter(static_cast<double>(bytes) / state.iterations());
+	}
+
+	/// fork a world that hasn't changed since it was last forked
+	void fork_idle(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+		world._universe.fork();
+
+		for (auto _ : state)
+		{
+			auto child = world._universe.fork();
+
+			state.PauseTiming();
+			child.reset();
+			state.ResumeTiming();
+		}
+	}
+
+	/// fork a world that's ticked since, then tick the fork
+	void fork_tick(benchmark::State& state)
+	{
+		world world(static_cast<size_t>(state.range(0)));
+
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			rollback_tick(world);
+			state.ResumeTiming();
+
+			auto child = world._universe.fork();
+
+			uint32_t step = 1;
+			child->visit<uint32_t, value>(step, [](uint32_t& step, value& next)
+			{
+				next._value += step;
+				return true;
+			});
+
+			state.PauseTiming();
+			child.reset();
+			state.ResumeTiming();
+		}
+	}
+
+	/// cost of one recorded span; the ring wraps so this never allocates
+	void trace_span(benchmark::State& state)
+	{
+		for (auto _ : state)
+			pal::trace::span span("bench", "span");
+	}
+
+	/// finding an entity by name; through the index (0) or by visiting every name and comparing (1)
+	void named(benchmark::State& state)
+	{
+		whippet::universe universe;
+		universe.install<whippet::name>();
+
+		const int count = static_cast<int>(state.range(0));
+		std::vector<std::string> names;
+		for (int i = 0; i < count; ++i)
+		{
+			names.push_back("entity-" + std::to_string(i));
+			universe.create().attach<whippet::name>(names.back().c_str());
+		}
+
+		const bool visit = 0 != state.range(1);
+		size_t next = 0;
+		for (auto _ : state)
+		{
+			const char* text = names[next].c_str();
+			next = (next + 7919) % names.size();
+
+			if (!visit)
+			{
+				benchmark::DoNotOptimize(universe.named(text));
+				continue;
+			}
+
+			std::pair<const pal::adler::sum, whippet::entity> found(text, whippet::entity());
+			universe.visit<std::pair<const pal::adler::sum, whippet::entity>, whippet::name>(found, [](std::pair<const pal::adler::sum, whippet::entity>& found, whippet::name& name)
+			{
+				if (found.first != name._key)
+					return true;
+
+				found.second = name.owner();
+				return false;
+			});
+			benchmark::DoNotOptimize(found.second);
+		}
+	}
+
+	/// the parts of something spawned over and over; with value and other that's six components
+	struct health : whippet::_component
+	{
+		int32_t _health;
+		health(int32_t v) : _health(v) {}
+	};
+
+	struct velocity : whippet::_component
+	{
+		float _velocity[3];
+		velocity(float x, float y, float z) : _velocity{ x, y, z } {}
+	};
+
+	struct team : whippet::_component
+	{
+		uint8_t _team;
+		team(uint8_t v) : _team(v) {}
+	};
+
+	struct cooldown : whippet::_component
+	{
+		double _cooldown;
+		cooldown(double v) : _cooldown(v) {}
+	};
+
+	void spawning(whippet::universe& universe)
+	{
+		universe.install<value>();
+		universe.install<other>();
+		universe.install<health>();
+		universe.install<velocity>();
+		universe.install<team>();
+		universe.install<cooldown>();
+	}
+
+	/// `count` entities made a component at a time; or (with 1) as copies of a prefab
+	void spawn(benchmark::State& state)
+	{
+		const size_t count = static_cast<size_t>(state.range(0));
+		const bool prefab = 0 != state.range(1);
+
+		for (auto _ : state)
+		{
+			state.PauseTiming();
+			auto universe = std::make_unique<whippet::universe>();
+			spawning(*universe);
+
+			auto source = universe->create();
+			source.attach<value>(1);
+			source.attach<other>(2.0f);
+			source.attach<health>(100);
+			source.attach<velocity>(0.0f, 1.0f, 0.0f);
+			source.attach<team>(3);
+			source.attach<cooldown>(0.5);
+			const whippet::prefab copied(source);
+			state.ResumeTiming();
+
+			if (prefab)
+				benchmark::DoNotOptimize(universe->instantiate(copied, count));
+			else
+				for (size_t i = 0; i < count; ++i)
+				{
+					auto next = universe->create();
+					next.attach<value>(1);
+					next.attach<other>(2.0f);
+					next.attach<health>(100);
+					next.attach<velocity>(0.0f, 1.0f, 0.0f);
+					next.attach<team>(3);
+					next.attach<cooldown>(0.5);
+				}
+
+			state.PauseTiming();
+			universe.reset();
+			state.ResumeTiming();
+		}
+
+		state.SetItemsProcessed(state.iterations() * count);
+	}
+
+	/// a 2d transform; what's propagated from the roots down
+	struct placement
+	{
+		float _local[2];
+		float _world[2];
+	};
+
+	/// `count` nodes; each under a (random) earlier one, or, one in twenty a root
+	struct forest
+	{
+		whippet::universe _universe;
+		whippet::hierarchy<placement>& _tree;
+		std::vector<whippet::entity> _nodes;
+		uint32_t _random;
+
+		uint32_t next(const uint32_t range)
+		{
+			_random = _random * 1664525u + 1013904223u;
+			return (_random >> 8) % range;
+		}
+
+		forest(const size_t count) :
+			_tree(_universe.system<whippet::hierarchy<placement>>()),
+			_random(1)
+		{
+			_nodes.reserve(count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				auto node = _universe.create();
+				auto parent = (_nodes.empty() || 0 == next(20)) ? whippet::entity() : _nodes[next(static_cast<uint32_t>(_nodes.size()))];
+				_tree.insert(node, parent, placement{ { 1.0f, float(i % 7) }, { 0, 0 } });
+				_nodes.push_back(node);
+			}
+		}
+	};
+
+	/// every world transform; one linear pass per level
+	void hierarchy_propagate(benchmark::State& state)
+	{
+		forest forest(static_cast<size_t>(state.range(0)));
+
+		int unused = 0;
+		for (auto _ : state)
+			forest._tree.propagate<int>(unused, [](int&, placement& node, const placement* parent)
+			{
+				node._world[0] = node._local[0] + (nullptr == parent ? 0 : parent->_world[0]);
+				node._world[1] = node._local[1] + (nullptr == parent ? 0 : parent->_world[1]);
+			});
+
+		benchmark::DoNotOptimize(unused);
+		state.SetItemsProcessed(state.iterations() * state.range(0));
+	}
+
+	/// a node (and whatever's under it) moved under another one; skipping moves that would put it under itself
+	void hierarchy_reparent(benchmark::State& state)
+	{
+		forest forest(static_cast<size_t>(state.range(0)));
+
+		for (auto _ : state)
+		{
+			const auto node = forest._nodes[forest.next(static_cast<uint32_t>(forest._nodes.size()))];
+			const auto parent = forest._nodes[forest.next(static_cast<uint32_t>(forest._nodes.size()))];
+
+			bool under = false;
+			for (auto up = parent; 0 != up.guid()._weak && !under; up = forest._tree.parent(up))
+				under = up.guid() == node.guid();
+
+			if (!under)
+				forest._tree.reparent(node, parent);
+		}
+
+		state.SetItemsProcessed(state.iterations());
+	}
+
+#ifdef __cpp_impl_coroutine
+	whippet::task sleeper(void)
+	{
+		for (;;)
+			co_await whippet::delay(1000000000);
+	}
+
+	whippet::task stepper(uint64_t& steps)
+	{
+		for (;;)
+		{
+			co_await whippet::next_tick();
+			++steps;
+		}
+	}
+
+	/// one tick with a task that wakes every tick, and `range(0)` more that are sleeping; the sleepers should not cost anything
+	void tasks_tick(benchmark::State& state)
+	{
+		whippet::universe universe;
+		auto& scheduler = universe.system<whippet::scheduler>();
+
+		for (int64_t i = 0; i < state.range(0); ++i)
+			scheduler.spawn(sleeper());
+
+		uint64_t steps = 0;
+		scheduler.spawn(stepper(steps));
+
+		for (auto _ : state)
+			scheduler.tick();
+
+		benchmark::DoNotOptimize(steps);
+		state.SetItemsProcessed(state.iterations());
+	}
+
+	/// a task that finishes straight away; its frame comes from (and goes back to) the pool
+	void tasks_spawn(benchmark::State& state)
+	{
+		whippet::universe universe;
+		auto& scheduler = universe.system<whippet::scheduler>();
+
+		for (auto _ : state)
+			scheduler.spawn([](void) -> whippet::task { co_return; }());
+
+		state.SetItemsProcessed(state.iterations());
+	}
+#endif
+
+	/// checksum throughput; the second argument picks the byte-at-a-time loop over the block kernels
+	void adler_bytes(benchmark::State& state)
+	{
+		std::vector<char> bytes(static_cast<size_t>(state.range(0)));
+		for (size_t i = 0; i < bytes.size(); ++i)
+			bytes[i] = static_cast<char>(i * 7 + i / 251);
+
+		const bool scalar = 0 != state.range(1);
+		for (auto _ : state)
+		{
+			const auto sum = scalar ? pal::adler().scalar(bytes.size(), bytes.data()) : pal::adler()(bytes.size(), bytes.data());
+			benchmark::DoNotOptimize(sum);
+		}
+
+		state.SetBytesProcessed(state.iterations() * state.range(0));
+	}
+}
+
+BENCHMARK(churn_create_remove)->Apply(sweep);
+BENCHMARK(churn_attach_detach)->Apply(sweep);
+BENCHMARK(visit_typed)->Apply(sweep);
+BENCHMARK(visit_untyped)->Apply(sweep);
+BENCHMARK(visit_entity)->Apply(sweep);
+BENCHMARK(static_churn_create_remove)->Apply(sweep);
+BENCHMARK(static_visit_typed)->Apply(sweep);
+BENCHMARK(static_visit_untyped)->Apply(sweep);
+#ifdef whippet__porcelain
+BENCHMARK(porcelain_component)->Apply(sweep);
+#endif
+BENCHMARK(visit_sorted)->Apply(sweep);
+BENCHMARK(weed)->Apply(sweep)->Iterations(3);
+BENCHMARK(teardown)->Apply(sweep)->Iterations(3);
+BENCHMARK(snapshot_restore)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(snapshot_map)->RangeMultiplier(10)->Range(1000, 1000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(rollback_mark)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(rollback_snapshot)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(rollback_delta)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(fork_idle)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(fork_tick)->RangeMultiplier(10)->Range(10000, 1000000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(trace_span);
+BENCHMARK(named)->ArgsProduct({ { 1000, 10000, 100000 }, { 0, 1 } });
+BENCHMARK(spawn)->ArgsProduct({ { 1000, 100000 }, { 0, 1 } })->Unit(benchmark::kMillisecond);
+BENCHMARK(hierarchy_propagate)->RangeMultiplier(10)->Range(2000, 200000)->Unit(benchmark::kMicrosecond);
+BENCHMARK(hierarchy_reparent)->RangeMultiplier(10)->Range(2000, 200000);
+#ifdef __cpp_impl_coroutine
+BENCHMARK(tasks_tick)->Arg(0)->Arg(1000)->Arg(100000);
+BENCHMARK(tasks_spawn);
+#endif
+BENCHMARK(adler_bytes)->ArgsProduct({ { 64, 4096, 1 << 20 }, { 0, 1 } });
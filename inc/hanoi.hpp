@@ -18,35 +18,111 @@
 // - includes iteration
 // - emplace to an unspecified location
 // - needs inuse() and clean() methods on data object
+// - every layer is a block aligned to its own size, so anything inside of a layer can find the layer's header (and the container's tag) from its address
+// - so, an element has to fit into a block (less the header); bigger things need to be kept behind a pointer
+// - a container with anything in it holds at least one whole block, however few elements there are
+// - #define hanoi__stats to count what emplace/weed are doing
+// - track() keeps a copy of each block the first time it's touched afterwards; so changes can be rolled back or written out as deltas
+// - copy() fills a container with copies of another's blocks (made however the caller likes; say, copy-on-write mappings)
 //
 #pragma once
 
 #include <assert.h>
 #include <stdint.h>
 
-#include <vector>
-#include <array>
+#include <string.h>
+
 #include <algorithm>
 #include <memory>
+#include <new>
+#include <utility>
+#include <vector>
 
-#include "generator.hpp"
+#ifdef hanoi__stats
+#	define hanoi__count(...) __VA_ARGS__
+#else
+#	define hanoi__count(...)
+#endif
 
-template <typename E>
-class hanoi final
+/// the non-template parts of the layers
+struct hanoi_block final
 {
-	static const uint8_t LAYER_SIZE_INITIAL = 14;
-	static const uint8_t LAYER_SIZE_EXPAND = 3;
-	static const uint8_t LAYER_SIZE_LIMIT = 143;
+	hanoi_block(void) = delete;
+
+	/// size (and alignment) of every layer's block
+	static const size_t SIZE = 64 * 1024;
+
+	/// sits at the front of every block
+	struct header
+	{
+		/// whatever the owning container was given to hand out
+		void* _tag;
+
+		/// the next (older) layer
+		header* _next;
 
-	static_assert(0 <= LAYER_SIZE_INITIAL, "the initial size of the layers must be > 0");
+		/// number of entries in this block
+		uint32_t _size;
 
-	friend struct iterator_forward;
+		/// number of entries which are in use
+		uint32_t _live;
 
-	// TODO; perform byte alignment
+		/// no entry before this one is free
+		uint32_t _free;
+
+		/// which block this is (in its container) for deltas; survives being written out and read back
+		uint32_t _id;
+
+		/// gives the block back if it didn't come from allocate() (say; it's part of a mapped file)
+		void(*_release)(void*);
+
+		/// the block as it was when tracking started (if it's been touched since)
+		uint8_t* _shadow;
+
+		/// where a frozen copy of the block can be found (for copy-on-write forks); zero if there isn't one
+		uint32_t _frozen;
+		uint32_t _slot;
+
+		/// the block has been touched since it was frozen
+		uint32_t _written;
+	};
+
+	/// finds the header of the block that contains the address
+	static header* of(const void* address)
+	{
+		return reinterpret_cast<header*>(reinterpret_cast<uintptr_t>(address) & ~static_cast<uintptr_t>(SIZE - 1));
+	}
 
+	/// finds the tag of the container that owns the address
+	static void* tag(const void* address)
+	{
+		return of(address)->_tag;
+	}
+
+	/// blocks are always aligned to SIZE but can be allocated smaller
+	static void* allocate(const size_t size = SIZE)
+	{
+		assert(size <= SIZE);
+		return ::operator new(size, std::align_val_t(SIZE));
+	}
+
+	static void release(void* block)
+	{
+		auto self = reinterpret_cast<header*>(block);
+
+		if (nullptr != self->_release)
+			self->_release(block);
+		else
+			::operator delete(block, std::align_val_t(SIZE));
+	}
+};
+
+template <typename E>
+class hanoi final
+{
 	class entry final
 	{
-		uint8_t _data[sizeof(E)];
+		alignas(E) uint8_t _data[sizeof(E)];
 	public:
 		E* get(void) { return reinterpret_cast<E*>(_data); }
 
@@ -74,66 +150,130 @@ class hanoi final
 		}
 	};
 
+	typedef hanoi_block::header header;
+
+	/// entries start on a cache-line (or stricter) boundary
+	static const size_t LAYER_ALIGN = alignof(entry) < 64 ? 64 : alignof(entry);
+
+	/// where the first entry sits after the header
+	static const size_t LAYER_OFFSET = ((sizeof(header) + LAYER_ALIGN - 1) / LAYER_ALIGN) * LAYER_ALIGN;
+
+	/// entries that fit into one block
+	static const uint32_t LAYER_SIZE = static_cast<uint32_t>((hanoi_block::SIZE - LAYER_OFFSET) / sizeof(entry));
+
+	static_assert(0 < LAYER_SIZE, "the element is too big to fit in a block (64KiB less the header); keep it behind a pointer");
+	static_assert(alignof(entry) <= hanoi_block::SIZE, "the element needs more alignment than a block has");
+
 	/// layers contain (some number of) entries
 	struct layer final
 	{
-		std::vector<entry> _data;
-		std::unique_ptr<layer> _next;
+		layer(void) = delete;
 
-		layer(const size_t size) :
-			_data(size),
-			_next(nullptr)
+		static entry* data(header* self)
 		{
+			return reinterpret_cast<entry*>(reinterpret_cast<uint8_t*>(self) + LAYER_OFFSET);
 		}
 
-		/// "weed" out empty layers
-		void weed(std::unique_ptr<layer>& self)
+		static header* create(void* tag, header* next, const uint32_t id)
 		{
-			// first; do the next one
-			if (_next)
-				_next->weed(_next);
+			auto self = new (hanoi_block::allocate()) header();
 
-			// scan for an in-use item and return IFF one exists
-			for (auto & e : _data)
-				if (entry::inuse(&e))
-					return;
+			self->_tag = tag;
+			self->_next = next;
+			self->_size = LAYER_SIZE;
+			self->_live = 0;
+			self->_free = 0;
+			self->_id = id;
 
-			// cool; nothing is being used in *this* layer - wipe it out
-			self = std::move(_next);
+			for (uint32_t i = 0; i < LAYER_SIZE; ++i)
+				new (data(self) + i) entry();
+
+			return self;
 		}
-	};
 
-	std::unique_ptr<layer> _data = nullptr;
+		static void destroy(header* self)
+		{
+			assert(0 == self->_live);
 
-	template<const bool LIVE>
-	$generator(layer_iterator)
-	{
-		uint32_t _entry;
-		typename layer* _layer;
+			for (uint32_t i = 0; i < self->_size; ++i)
+				data(self)[i].~entry();
 
-		layer_iterator(layer* _) :
-			_layer(_)
-		{
+			drop(self);
 		}
 
-		$emit(typename entry*)
+		/// gives the block back without touching what's in it (for elements that are just bytes)
+		static void drop(header* self)
 		{
-			for (; nullptr != _layer; _layer = _layer->_next.get())
-				for (_entry = 0; _entry < _layer->_data.size(); ++_entry)
-					if (LIVE == entry::inuse(_layer->_data.data() + _entry))
-						$yield(&(_layer->_data[_entry]));
+			delete[] self->_shadow;
+			hanoi_block::release(self);
 		}
-		$stop;
 	};
+
+	void* const _tag;
+	header* _data;
+
+	/// the id the next new block gets
+	uint32_t _ids;
+
+	/// changes are being tracked; blocks with an id below _tracked were there when it started
+	bool _tracking;
+	uint32_t _tracked;
+
+	/// the blocks (in order) when tracking started, and, the ones weeded since (which are kept to roll back to)
+	std::vector<header*> _baseline;
+	std::vector<header*> _weeded;
+
 public:
+	/// what the container has been up to
+	struct counters
+	{
+		/// elements emplaced
+		uint64_t _emplaced;
+
+		/// slots looked at while looking for a free one
+		uint64_t _scanned;
+
+		/// full layers stepped over while looking for a free slot
+		uint64_t _skipped;
+
+		uint64_t _allocated;
+		uint64_t _weeded;
+	};
+
+#ifdef hanoi__stats
+	const counters& stats(void) const { return _counters; }
+private:
+	counters _counters = {};
+public:
+#endif
 
 	/// allows "weeding" unused data
-	void weed(void) { if (_data) _data->weed(_data); }
+	/// ... blocks that are being tracked are set aside (rather than destroyed) until tracking restarts
+	void weed(void)
+	{
+		for (auto link = &_data; nullptr != *link;)
+		{
+			auto self = *link;
+
+			if (self->_live)
+			{
+				link = &(self->_next);
+				continue;
+			}
+
+			// cool; nothing is being used in *this* layer - wipe it out
+			*link = self->_next;
+			if (_tracking && self->_id < _tracked)
+				_weeded.push_back(self);
+			else
+				layer::destroy(self);
+			hanoi__count(++_counters._weeded);
+		}
+	}
 
 	struct iterator_forward final
 	{
 		iterator_forward(void) = delete;
-		~iterator_forward(void);
 
 		E& operator*(void);
 		E* operator->(void);
@@ -145,14 +285,27 @@ public:
 
 	private:
 		friend class hanoi<E>;
-		typename layer_iterator<true> _inner;
-		typename entry* _last;
+		header* _layer;
+		uint32_t _entry;
 
-		iterator_forward(typename layer*);
+		iterator_forward(header*);
+		iterator_forward(header*, const uint32_t);
+
+		/// moves forward until something live is found
+		void settle(void);
+
+		entry* last(void) const { return layer::data(_layer) + _entry; }
 	};
 
-	hanoi(void) : _data(nullptr) { }
-	~hanoi(void) { while (!empty()) { erase(begin()); } }
+	hanoi(void* tag = nullptr) : _tag(tag), _data(nullptr), _ids(0), _tracking(false), _tracked(0) { }
+	~hanoi(void)
+	{
+		for (auto it = begin(); it != end(); ++it)
+			erase(it);
+		track(false);
+		weed();
+		assert(nullptr == _data);
+	}
 
 	hanoi(const hanoi&) = delete;
 	hanoi& operator=(const hanoi&) = delete;
@@ -160,28 +313,370 @@ public:
 	template <typename ...ARGS>
 	E& emplace_unspecified(ARGS&& ...);
 
+	/// emplaces `count` elements with `make(E* place, size_t i)`; it's handed clean storage and needs to leave an element there
+	/// ... holes in the layers there are now are filled first, then new layers are made and filled front to back
+	template <typename F>
+	void emplace_many(const size_t count, F make);
+
 	void erase(const iterator_forward&);
 
-	iterator_forward begin(void) { return hanoi<E>::iterator_forward::iterator_forward(_data.get()); }
-	iterator_forward end(void) { return hanoi<E>::iterator_forward::iterator_forward(nullptr); }
+	iterator_forward begin(void) { return iterator_forward(_data); }
+	iterator_forward end(void) { return iterator_forward(nullptr); }
 
 	bool empty(void) { return begin() == end(); }
 
+	/// how many layers (blocks) are allocated right now
+	size_t layers(void) const
+	{
+		size_t count = 0;
+		for (auto next = _data; nullptr != next; next = next->_next)
+			++count;
+		return count;
+	}
+
+	/// calls back with each contiguous run of live elements, a block at a time, until told to stop
+	/// ... the elements in a run are a plain array of E
+	template <typename F>
+	bool runs(F callback);
+
+	/// (stably) reorders the live elements by a uint32_t key and packs them into the front layers
+	/// ... elements are moved with memcpy (so E needs to be fine with that) and references to them are invalidated
+	template <typename K>
+	void sort(K key);
+
+	/// calls back with each layer (block) that has something live in it, newest first
+	/// ... a block is SIZE bytes; header and all
+	template <typename F>
+	void blocks(F callback) const
+	{
+		for (auto next = _data; nullptr != next; next = next->_next)
+			if (next->_live)
+				callback(static_cast<const header*>(next));
+	}
+
+	/// takes over a block that was filled in elsewhere (say; read back from a file) and puts it behind the others
+	/// ... the block's bytes need to be the image of a layer from a hanoi<E>; _size, _live, _free, _id and _release are trusted, _tag, _next, _shadow and _frozen are fixed up
+	/// ... returns false (and leaves the block alone) if it's not a layer of this shape
+	bool adopt(header* block)
+	{
+		if (LAYER_SIZE != block->_size || block->_size < block->_live)
+			return false;
+
+		block->_tag = _tag;
+		block->_next = nullptr;
+		block->_shadow = nullptr;
+		block->_frozen = 0;
+		_ids = std::max(_ids, block->_id + 1);
+
+		auto link = &_data;
+		while (nullptr != *link)
+			link = &((*link)->_next);
+		*link = block;
+
+		hanoi__count(++_counters._allocated);
+		return true;
+	}
+
+	/// starts (or restarts) tracking changes from here, or, stops
+	/// ... while tracking; the first time a block is touched a copy is kept (in its _shadow) so that it can be rolled back or diffed
+	void track(const bool tracking)
+	{
+		for (auto next = _data; nullptr != next; next = next->_next)
+		{
+			delete[] next->_shadow;
+			next->_shadow = nullptr;
+		}
+
+		// these are bytes from before (and might not be empty if apply() put them here)
+		for (auto self : _weeded)
+			layer::drop(self);
+
+		_weeded.clear();
+		_baseline.clear();
+
+		_tracking = tracking;
+		_tracked = _ids;
+
+		if (tracking)
+			for (auto next = _data; nullptr != next; next = next->_next)
+				_baseline.push_back(next);
+	}
+
+	/// notes that the block is about to change; and keeps a copy of it (if it's being tracked and that hasn't happened yet)
+	void touch(header* block)
+	{
+		block->_written = 1;
+
+		if (_tracking && nullptr == block->_shadow && block->_id < _tracked)
+		{
+			block->_shadow = new uint8_t[hanoi_block::SIZE];
+			memcpy(block->_shadow, block, hanoi_block::SIZE);
+		}
+	}
+
+	/// touches every block
+	void touch(void)
+	{
+		for (auto next = _data; nullptr != next; next = next->_next)
+			touch(next);
+	}
+
+	/// fills this (empty) container with copies of another's blocks, in the same order
+	/// ... `copier(const std::vector<header*>&)` returns a (same sized) vector of copies; the headers are fixed up here
+	template <typename F>
+	void copy(const hanoi& from, F copier)
+	{
+		assert(nullptr == _data);
+
+		std::vector<header*> blocks;
+		for (auto next = from._data; nullptr != next; next = next->_next)
+			blocks.push_back(next);
+
+		auto copies = copier(blocks);
+		assert(copies.size() == blocks.size());
+
+		for (auto it = copies.rbegin(); it != copies.rend(); ++it)
+		{
+			(*it)->_tag = _tag;
+			(*it)->_next = _data;
+			(*it)->_shadow = nullptr;
+			_data = *it;
+		}
+
+		_ids = from._ids;
+	}
+
+	/// puts every block back the way it was when tracking (re)started
+	/// ... elements are treated as bytes; nothing is constructed or destroyed
+	void rollback(void)
+	{
+		assert(_tracking);
+
+		for (auto next = _data; nullptr != next;)
+		{
+			auto self = next;
+			next = next->_next;
+
+			if (_tracked <= self->_id)
+				layer::drop(self);
+		}
+
+		_data = nullptr;
+		for (auto it = _baseline.rbegin(); it != _baseline.rend(); ++it)
+		{
+			auto self = *it;
+
+			if (nullptr != self->_shadow)
+			{
+				// the bytes go back; how the block is held doesn't
+				const header now = *self;
+
+				memcpy(self, now._shadow, hanoi_block::SIZE);
+
+				self->_tag = _tag;
+				self->_release = now._release;
+				self->_shadow = nullptr;
+				self->_frozen = now._frozen;
+				self->_slot = now._slot;
+				self->_written = 1;
+				delete[] now._shadow;
+			}
+
+			self->_next = _data;
+			_data = self;
+		}
+
+		_weeded.clear();
+		_ids = _tracked;
+	}
+
+	/// writes out what's changed since tracking (re)started so that apply() can do the same to a copy of the blocks as they were
+	/// ... the ids of the blocks (in order) then each block's changes; all of it if it's new, the runs of changed bytes if it was touched
+	template <typename W>
+	void delta(W write) const
+	{
+		assert(_tracking);
+
+		uint32_t count = 0;
+		for (auto next = _data; nullptr != next; next = next->_next)
+			++count;
+
+		write(&count, sizeof(count));
+		for (auto next = _data; nullptr != next; next = next->_next)
+		{
+			const uint32_t kind = (_tracked <= next->_id) ? 2 : (nullptr != next->_shadow ? 1 : 0);
+
+			write(&(next->_id), sizeof(next->_id));
+			write(&kind, sizeof(kind));
+
+			if (2 == kind)
+				write(next, hanoi_block::SIZE);
+
+			if (1 != kind)
+				continue;
+
+			write(&(next->_live), sizeof(next->_live));
+			write(&(next->_free), sizeof(next->_free));
+
+			// compare a word at a time; changed words that are next to each other become one run
+			auto now = reinterpret_cast<const uint64_t*>(next);
+			auto was = reinterpret_cast<const uint64_t*>(next->_shadow);
+			const uint32_t words = static_cast<uint32_t>(hanoi_block::SIZE / sizeof(uint64_t));
+
+			for (uint32_t word = static_cast<uint32_t>(LAYER_OFFSET / sizeof(uint64_t)); word < words;)
+			{
+				if (now[word] == was[word])
+				{
+					++word;
+					continue;
+				}
+
+				uint32_t end = word + 1;
+				while (end < words && now[end] != was[end])
+					++end;
+
+				const uint32_t run[2] = { word, end - word };
+				write(run, sizeof(run));
+				write(now + word, sizeof(uint64_t) * (end - word));
+
+				word = end;
+			}
+
+			const uint32_t done[2] = { 0, 0 };
+			write(done, sizeof(done));
+		}
+	}
+
+	/// does what delta() wrote; the blocks need to be as they were when the delta's tracking (re)started
+	/// ... blocks that the delta doesn't mention were weeded, and go; elements are treated as bytes
+	/// ... false if the reader runs dry or a block can't be found (which leaves things half done; so, `check` it first)
+	/// ... with `check` it's only read through to see that it would work; nothing is changed
+	template <typename R>
+	bool apply(R read, const bool check = false)
+	{
+		uint32_t count;
+		if (!read(&count, sizeof(count)))
+			return false;
+
+		// what's read while checking goes here rather than into the blocks
+		std::unique_ptr<uint64_t[]> scratch(check ? new uint64_t[hanoi_block::SIZE / sizeof(uint64_t)] : nullptr);
+
+		std::vector<header*> order;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			uint32_t id, kind;
+			if (!read(&id, sizeof(id)) || !read(&kind, sizeof(kind)))
+				return false;
+
+			if (2 == kind)
+			{
+				auto self = check ? reinterpret_cast<header*>(scratch.get()) : reinterpret_cast<header*>(hanoi_block::allocate());
+				const bool good = read(self, hanoi_block::SIZE);
+
+				self->_tag = _tag;
+				self->_release = nullptr;
+				self->_shadow = nullptr;
+				self->_frozen = 0;
+
+				if (!good || LAYER_SIZE != self->_size || id != self->_id)
+				{
+					if (!check)
+						hanoi_block::release(self);
+					return false;
+				}
+
+				if (check)
+					continue;
+
+				_ids = std::max(_ids, id + 1);
+				order.push_back(self);
+				continue;
+			}
+
+			header* self = nullptr;
+			for (auto next = _data; nullptr != next && nullptr == self; next = next->_next)
+				if (id == next->_id)
+					self = next;
+
+			if (nullptr == self)
+				return false;
+
+			if (!check)
+				order.push_back(self);
+
+			if (0 == kind)
+				continue;
+
+			if (check)
+				self = reinterpret_cast<header*>(scratch.get());
+			else
+				touch(self);
+
+			if (!read(&(self->_live), sizeof(self->_live)) || !read(&(self->_free), sizeof(self->_free)))
+				return false;
+
+			auto words = reinterpret_cast<uint64_t*>(self);
+			for (;;)
+			{
+				uint32_t run[2];
+				if (!read(run, sizeof(run)))
+					return false;
+
+				if (0 == run[1])
+					break;
+
+				if (run[0] < (LAYER_OFFSET / sizeof(uint64_t)) || (hanoi_block::SIZE / sizeof(uint64_t)) < (static_cast<size_t>(run[0]) + run[1]))
+					return false;
+
+				if (!read(words + run[0], sizeof(uint64_t) * run[1]))
+					return false;
+			}
+		}
+
+		if (check)
+			return true;
+
+		// whatever wasn't mentioned was weeded
+		for (auto next = _data; nullptr != next;)
+		{
+			auto self = next;
+			next = next->_next;
+
+			if (order.end() != std::find(order.begin(), order.end(), self))
+				continue;
+
+			if (_tracking && self->_id < _tracked)
+				_weeded.push_back(self);
+			else
+				layer::drop(self);
+		}
+
+		_data = nullptr;
+		for (auto it = order.rbegin(); it != order.rend(); ++it)
+		{
+			(*it)->_next = _data;
+			_data = *it;
+		}
+
+		return true;
+	}
+
 	/// erase the referenced element
+	/// ... the element's block gives us its layer so there's no need to search
 	void erase(E& element)
 	{
 		assert(nullptr != _data);
 
-		for (auto it = begin(); it != end(); ++it)
-		{
-			if ((&element) != &(*it))
-				continue;
+		auto self = hanoi_block::of(&element);
+		auto place = reinterpret_cast<entry*>(&element);
 
-			erase(it);
+		if (_tag != self->_tag || place < layer::data(self) || (layer::data(self) + self->_size) <= place)
+		{
+			warn("tried to erase non-existant element");
 			return;
 		}
 
-		warn("tried to erase non-existant element");
+		erase(iterator_forward(self, static_cast<uint32_t>(place - layer::data(self))));
 	}
 };
 
@@ -195,110 +690,304 @@ template <typename ...ARGS>
 inline
 E& hanoi<E>::emplace_unspecified(ARGS&& ... args)
 {
-	hanoi<E>::entry* place;
-	hanoi<E>::layer_iterator<false> layers(_data.get());
-
 	// see if there's a place in an old layer
-	if (layers(place))
+	for (auto next = _data; nullptr != next; next = next->_next)
 	{
-		// this spot is free!
-		assert(!hanoi<E>::entry::inuse(place));
+		if (next->_live == next->_size)
+		{
+			hanoi__count(++_counters._skipped);
+			continue;
+		}
+
+		for (auto index = next->_free; index < next->_size; ++index)
+		{
+			auto place = layer::data(next) + index;
+			hanoi__count(++_counters._scanned);
+
+			if (hanoi<E>::entry::inuse(place))
+				continue;
+
+			touch(next);
+
+			// create a component (remeber that you should mark it as used ASAP)
+			auto emplaced = new (place->get()) E(args...);
 
-		// create a component (remeber that you should mark it as used ASAP)
-		auto emplaced = new (place->get()) E(args...);
+			// check to be sure that worked
+			assert(hanoi<E>::entry::inuse(place));
 
-		// check to be sure that worked
-		assert(hanoi<E>::entry::inuse(place));
+			++(next->_live);
+			next->_free = index + 1;
+			hanoi__count(++_counters._emplaced);
 
-		// return the result
-		return *emplaced;
+			// return the result
+			return *emplaced;
+		}
+
+		assert(false && "the layer's live-count is wrong");
 	}
 
 	// add a new layer
+	_data = layer::create(_tag, _data, _ids++);
+	hanoi__count(++_counters._allocated);
+
+	// recur
+	return emplace_unspecified(args...);
+}
+
+template <typename E>
+template <typename F>
+inline
+void hanoi<E>::emplace_many(const size_t count, F make)
+{
+	size_t done = 0;
+
+	// the holes in the old layers
+	for (auto next = _data; nullptr != next && done < count; next = next->_next)
 	{
-		// determine grown size
-		size_t size = nullptr != _data
-			? _data->_data.size() + hanoi::LAYER_SIZE_EXPAND
-			: hanoi::LAYER_SIZE_INITIAL;
+		if (next->_live == next->_size)
+		{
+			hanoi__count(++_counters._skipped);
+			continue;
+		}
 
-		// limit if applicable
-		if (hanoi::LAYER_SIZE_LIMIT)
-			size = std::min<size_t>(hanoi::LAYER_SIZE_LIMIT, size);
+		touch(next);
 
-		// create the layer
-		std::unique_ptr<layer> next = std::make_unique<layer>(size);
+		auto index = next->_free;
+		for (; index < next->_size && done < count; ++index)
+		{
+			auto place = layer::data(next) + index;
+			hanoi__count(++_counters._scanned);
 
-		// put the layer into place
-		next->_next = std::move(_data);
-		_data = std::move(next);
+			if (hanoi<E>::entry::inuse(place))
+				continue;
+
+			make(place->get(), done++);
+			assert(hanoi<E>::entry::inuse(place));
+
+			++(next->_live);
+			hanoi__count(++_counters._emplaced);
+		}
+
+		// everything before where we stopped is in use now
+		next->_free = index;
 	}
 
-	// recur
-	return emplace_unspecified(args...);
+	// whole new layers for the rest
+	while (done < count)
+	{
+		_data = layer::create(_tag, _data, _ids++);
+		hanoi__count(++_counters._allocated);
+		touch(_data);
+
+		const auto size = static_cast<uint32_t>(std::min<size_t>(_data->_size, count - done));
+		for (uint32_t index = 0; index < size; ++index)
+		{
+			make(layer::data(_data)[index].get(), done++);
+			assert(hanoi<E>::entry::inuse(layer::data(_data) + index));
+		}
+
+		_data->_live = size;
+		_data->_free = size;
+		hanoi__count(_counters._emplaced += size);
+	}
 }
 
 template <typename E>
+template <typename F>
 inline
-void hanoi<E>::erase(typename const hanoi<E>::iterator_forward& position)
+bool hanoi<E>::runs(F callback)
 {
-	assert(nullptr != position._last);
+	static_assert(sizeof(entry) == sizeof(E), "entries need to be a plain array of elements");
 
-	assume(hanoi<E>::entry::inuse(position._last));
-	if (hanoi<E>::entry::inuse(position._last))
+	for (auto next = _data; nullptr != next; next = next->_next)
 	{
-		position._last->get()->~E();
+		auto data = layer::data(next);
+
+		if (next->_live)
+			touch(next);
+
+		for (uint32_t index = 0, seen = 0; seen < next->_live && index < next->_size;)
+		{
+			// skip the holes
+			if (!entry::inuse(data + index))
+			{
+				++index;
+				continue;
+			}
+
+			// find the end of the run
+			uint32_t end = index + 1;
+			while (end < next->_size && entry::inuse(data + end))
+				++end;
+
+			if (!callback(data[index].get(), end - index))
+				return false;
+
+			seen += end - index;
+			index = end;
+		}
 	}
-	assume(!(hanoi<E>::entry::inuse(position._last)));
+
+	return true;
 }
 
 template <typename E>
+template <typename K>
 inline
-hanoi<E>::iterator_forward::iterator_forward(typename hanoi<E>::layer* layer) :
-	_inner(layer)
+void hanoi<E>::sort(K key)
 {
-	if (!(_inner(_last)))
-		_last = nullptr;
+	typedef std::pair<uint32_t, entry*> keyed;
+
+	// gather the keys along with where they came from
+	std::vector<keyed> order;
+	for (auto it = begin(); it != end(); ++it)
+		order.emplace_back(key(*it), it.last());
+
+	if (order.empty())
+		return;
+
+	touch();
+
+	// lsd radix sort; a byte at a time
+	{
+		std::vector<keyed> spare(order.size());
+
+		for (uint32_t shift = 0; shift < 32; shift += 8)
+		{
+			size_t offset[257] = { 0 };
+
+			for (auto& next : order)
+				++offset[1 + ((next.first >> shift) & 0xFF)];
+
+			// skip bytes that are the same everywhere
+			if (order.size() == offset[1 + ((order.front().first >> shift) & 0xFF)])
+				continue;
+
+			for (size_t i = 1; i < 257; ++i)
+				offset[i] += offset[i - 1];
+
+			for (auto& next : order)
+				spare[offset[(next.first >> shift) & 0xFF]++] = next;
+
+			order.swap(spare);
+		}
+	}
+
+	// lift everything out of the layers ...
+	std::unique_ptr<uint8_t[]> moved(new uint8_t[order.size() * sizeof(entry)]);
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		memcpy(moved.get() + (i * sizeof(entry)), order[i].second, sizeof(entry));
+		entry::clean(order[i].second);
+	}
+
+	for (auto next = _data; nullptr != next; next = next->_next)
+	{
+		next->_live = 0;
+		next->_free = 0;
+	}
+
+	// ... and put it back, in order, from the front
+	auto into = _data;
+	for (size_t i = 0; i < order.size(); ++i)
+	{
+		if (into->_live == into->_size)
+			into = into->_next;
+
+		assert(nullptr != into);
+
+		memcpy(static_cast<void*>(layer::data(into) + into->_live), moved.get() + (i * sizeof(entry)), sizeof(entry));
+		assert(entry::inuse(layer::data(into) + into->_live));
+
+		into->_free = ++(into->_live);
+	}
+
+	// the trailing layers are now empty
+	weed();
 }
 
 template <typename E>
 inline
-E& hanoi<E>::iterator_forward::operator*(void)
+void hanoi<E>::erase(const typename hanoi<E>::iterator_forward& position)
 {
-	return *(_last->get());
+	assert(nullptr != position._layer);
+
+	auto place = position.last();
+
+	assume(hanoi<E>::entry::inuse(place));
+	if (hanoi<E>::entry::inuse(place))
+	{
+		touch(position._layer);
+		place->get()->~E();
+
+		--(position._layer->_live);
+		position._layer->_free = std::min(position._layer->_free, position._entry);
+	}
+	assume(!(hanoi<E>::entry::inuse(place)));
 }
 
 template <typename E>
 inline
-E* hanoi<E>::iterator_forward::operator->(void)
+hanoi<E>::iterator_forward::iterator_forward(header* layer) :
+	_layer(layer),
+	_entry(0)
 {
-	return _last->get();
+	settle();
 }
 
 template <typename E>
 inline
-typename hanoi<E>::iterator_forward& hanoi<E>::iterator_forward::operator++(void)
+hanoi<E>::iterator_forward::iterator_forward(header* layer, const uint32_t entry) :
+	_layer(layer),
+	_entry(entry)
 {
-	if (!(_inner(_last)))
-		_last = nullptr;
-	return *this;
 }
 
 template <typename E>
 inline
-bool hanoi<E>::iterator_forward::operator!=(typename const hanoi<E>::iterator_forward& other)const
+void hanoi<E>::iterator_forward::settle(void)
 {
-	return !((*this) == other);
+	for (; nullptr != _layer; _layer = _layer->_next, _entry = 0)
+		if (_layer->_live)
+			for (; _entry < _layer->_size; ++_entry)
+				if (hanoi<E>::entry::inuse(last()))
+					return;
+}
+
+template <typename E>
+inline
+E& hanoi<E>::iterator_forward::operator*(void)
+{
+	return *(last()->get());
 }
 
 template <typename E>
 inline
-bool hanoi<E>::iterator_forward::operator==(typename const hanoi<E>::iterator_forward& other)const
+E* hanoi<E>::iterator_forward::operator->(void)
 {
-	return _last == other._last;
+	return last()->get();
+}
+
+template <typename E>
+inline
+typename hanoi<E>::iterator_forward& hanoi<E>::iterator_forward::operator++(void)
+{
+	assert(nullptr != _layer);
+	++_entry;
+	settle();
+	return *this;
+}
+
+template <typename E>
+inline
+bool hanoi<E>::iterator_forward::operator!=(const typename hanoi<E>::iterator_forward& other)const
+{
+	return !((*this) == other);
 }
 
 template <typename E>
 inline
-hanoi<E>::iterator_forward::~iterator_forward(void)
+bool hanoi<E>::iterator_forward::operator==(const typename hanoi<E>::iterator_forward& other)const
 {
+	return _layer == other._layer && (nullptr == _layer || _entry == other._entry);
 }
@@ -22,11 +22,30 @@
 #include <assert.h>
 #include <stdint.h>
 
+#ifdef _MSC_VER
+#	include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#	include <x86intrin.h>
+#endif
+
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <new>
 #include <queue>
 #include <set>
+#include <string>
 #include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
 
 // #define real16_t ???
 #define real32_t float
@@ -75,6 +94,15 @@
 
 #define WARN(MESSAGE) warn(MESSAGE _fail_line_)
 
+// spans for the tracer; these vanish unless pal__trace is defined
+#ifdef pal__trace
+#	define pal__trace_span(CATEGORY, NAME) pal::trace::span pal__trace_line(__LINE__)(CATEGORY, NAME)
+#	define pal__trace_line(LINE) pal__trace_line_(LINE)
+#	define pal__trace_line_(LINE) pal__trace_span_ ## LINE
+#else
+#	define pal__trace_span(CATEGORY, NAME) do { } while (false)
+#endif
+
 
 #ifdef _MSC_VER
 #	define NOINLINE __declspec(noinline)
@@ -116,7 +144,7 @@ namespace pal
 	template<typename K, typename V>
 	struct map : std::map<K, V>
 	{
-		bool contains(const K& value) const { return end() != find(value); }
+		bool contains(const K& value) const { return this->end() != this->find(value); }
 	};
 
 	template<typename K, typename V>
@@ -183,8 +211,8 @@ namespace pal
 	{
 		E pull(void)
 		{
-			auto data = front();
-			pop();
+			auto data = this->front();
+			this->pop();
 			return data;
 		}
 	};
@@ -192,16 +220,29 @@ namespace pal
 	template<typename T>
 	struct set : std::set<T>
 	{
-		bool contains(const T& value) const { return end() != find(value); }
+		bool contains(const T& value) const { return this->end() != this->find(value); }
 	};
 
+	/// index of the lowest set bit (which had better be there)
+	inline uint32_t lowest_bit(const uint64_t bits)
+	{
+		assert(0 != bits);
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, bits);
+		return static_cast<uint32_t>(index);
+#else
+		return static_cast<uint32_t>(__builtin_ctzll(bits));
+#endif
+	}
+
 	/// twitchy semblance of strong(er) types
 	template<typename T>
 	struct strong
 	{
 		T _weak;
 
-		strong(const T& weak) : _weak(weak) {}
+		constexpr strong(const T& weak) : _weak(weak) {}
 		strong<T>& operator=(const T& weak) { _weak = weak; return *this; }
 
 		T& operator*(void) { return _weak; }
@@ -214,70 +255,555 @@ namespace pal
 	// Phase 2
 	//
 
+	/// Adler-32, as zlib has it (bytes are unsigned)
+	/// ... constexpr for text, so that a sum of a literal name folds away at compile time
 	struct adler final
 	{
-		const static uint32_t MOD_ADLER = 65521;
+		static constexpr uint32_t MOD_ADLER = 65521;
+
+		/// the most bytes that can be summed (from below MOD_ADLER) before _b could overflow; the modulo waits that long
+		static constexpr size_t NMAX = 5552;
 
 		const uint32_t _a;
 		const uint32_t _b;
 
-		adler(void);
+		constexpr adler(void) : _a(1), _b(0) {}
+
+		constexpr adler(const uint32_t a, const uint32_t b) : _a(a), _b(b) {}
 
-		adler(const adler&, const char);
+		constexpr adler(const adler& last, const char next) :
+			_a((last._a + static_cast<uint8_t>(next)) % MOD_ADLER),
+			_b((last._b + ((last._a + static_cast<uint8_t>(next)) % MOD_ADLER)) % MOD_ADLER)
+		{
+		}
 
-		adler operator << (const char) const;
+		constexpr adler operator << (const char next) const
+		{
+			return adler(*this, next);
+		}
 
-		adler operator << (const char*) const;
+		/// up to the nul; a loop (not recursion) so long text is fine too, but operator() is quicker for that
+		constexpr adler operator << (const char* text) const
+		{
+			uint32_t a = _a;
+			uint32_t b = _b;
+
+			for (size_t run = 0; text && *text; ++text)
+			{
+				a += static_cast<uint8_t>(*text);
+				b += a;
+
+				if (NMAX == ++run)
+				{
+					a %= MOD_ADLER;
+					b %= MOD_ADLER;
+					run = 0;
+				}
+			}
+
+			return adler(a % MOD_ADLER, b % MOD_ADLER);
+		}
 
+		/// a run of bytes, NMAX at a time; with SSE2 or AVX2 if the build is for them
 		adler operator()(const size_t, const char*) const;
 
-		uint32_t operator()(void) const;
+		/// the same without the vector kernels; what they're checked against
+		adler scalar(const size_t, const char*) const;
+
+		constexpr uint32_t operator()(void) const
+		{
+			return (_b << 16) | _a;
+		}
 
-		operator uint32_t(void) const;
+		constexpr operator uint32_t(void) const
+		{
+			return (_b << 16) | _a;
+		}
 
 		struct sum : strong<uint32_t>
 		{
 			// TODO; save std::string here durring debug?
 
-			sum(const char*);
-			sum(const adler&);
+			constexpr sum(const char* text) : strong<uint32_t>(adler() << text) {}
+			constexpr sum(const adler& adler) : strong<uint32_t>(adler) {}
 
 			pal__operator_prototypes(const char*);
 			pal__operator_prototypes(const sum);
 		};
 	};
 
+	/// a per-thread ring buffer of timed spans which can be dumped as Chrome trace (or Perfetto) JSON
+	/// ... #define pal__trace for the pal__trace_span() macros to record; otherwise they compile away
+	/// ... names and categories aren't copied; they need to be string literals (or live as long)
+	struct trace final
+	{
+		trace(void) = delete;
+
+		/// spans kept per thread; older ones are overwritten
+		static const size_t CAPACITY = 1 << 16;
+
+		/// one finished span
+		struct record
+		{
+			const char* _category;
+			const char* _name;
+			uint64_t _start;
+			uint64_t _end;
+		};
+
+		/// times the scope that it's in
+		struct span final
+		{
+			span(const char* category, const char* name) :
+				_category(category),
+				_name(name),
+				_start(now())
+			{
+			}
+
+			~span(void)
+			{
+				push(_category, _name, _start, now());
+			}
+
+			span(const span&) = delete;
+			span& operator=(const span&) = delete;
+		private:
+			const char* const _category;
+			const char* const _name;
+			const uint64_t _start;
+		};
+
+		/// ticks for timing spans; the time-stamp counter where there is one (it reads in half the time of steady_clock) otherwise nanoseconds
+		/// ... dump() converts these to microseconds
+		static uint64_t now(void)
+		{
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+			return __rdtsc();
+#else
+			return nanoseconds();
+#endif
+		}
+
+		/// nanoseconds on the steady clock
+		static uint64_t nanoseconds(void)
+		{
+			return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+		}
+
+		/// records a finished span in this thread's ring
+		static void push(const char* category, const char* name, const uint64_t start, const uint64_t end);
+
+		/// writes every thread's spans to a file as Chrome trace JSON
+		/// ... threads should be quiet while this happens; returns false if the file couldn't be written
+		static bool dump(const char* path);
+
+		/// forgets everything recorded so far
+		static void clear(void);
+	};
+
+	/// how an event_manager finds a message's topic, for handlers attached to one (see event_manager::attach())
+	/// ... specialise with enabled = true and a key(); pal::adler::sum suits named topics
+	template<typename E>
+	struct event_key
+	{
+		static const bool enabled = false;
+
+		static uint32_t key(const E&) { return 0; }
+	};
+
+	/// which of an event_manager's lanes a message goes in (see pal::lanes); anything past the last lane goes in the last
+	template<typename E>
+	struct event_lane
+	{
+		static size_t lane(const E&) { return 0; }
+	};
+
+	/// an event_manager's priority lanes, each with its own queue; lane 0 is the most urgent
+	struct lanes final
+	{
+		/// how the event thread picks the next message
+		enum class order : uint8_t
+		{
+			/// nothing is taken from a lane while a more urgent one has anything waiting
+			strict,
+
+			/// up to a lane's weight of messages is taken from each in turn, so none of them starves
+			weighted,
+		};
+
+		order _order;
+
+		/// for each lane, how many messages it gets in its turn (when weighted)
+		std::vector<uint32_t> _weights;
+
+		/// for each lane, whether a message replaces any still waiting there with the same event_key
+		/// ... the replacement keeps the older message's place; handlers with affinity::caller still see both
+		std::vector<bool> _coalesce;
+
+		lanes(const size_t count = 1, const order take = order::strict) :
+			_order(take),
+			_weights(count, 1),
+			_coalesce(count, false)
+		{
+		}
+	};
+
+	/// where (and how) an event_manager calls a handler; see event_manager::attach()
+	struct dispatch final
+	{
+		/// which thread calls the handler
+		enum class affinity : uint8_t
+		{
+			/// the event_manager's own thread, in turn with the other handlers there
+			event_thread,
+
+			/// a thread of its own, fed through its own queue
+			dedicated,
+
+			/// whichever of the event_manager's pool threads is free, fed through its own queue (and never two at once)
+			pool,
+
+			/// the thread calling broadcast(), before it returns
+			caller,
+		};
+
+		/// what a dedicated or pool handler's queue does when the handler has fallen _capacity messages behind
+		enum class backpressure : uint8_t
+		{
+			/// the event thread waits for room, and so does everything behind it
+			/// ... a handler using this shouldn't broadcast; it could end up waiting on itself
+			block,
+
+			/// the oldest waiting message is dropped
+			drop_oldest,
+
+			/// the newest waiting message with the same event_key is replaced (keeping its place) so a slow handler catches up with the latest
+			/// ... if none of them has the same key, the newest of them all is replaced; that's always the case for messages without event_key
+			coalesce,
+		};
+
+		affinity _affinity;
+		backpressure _backpressure;
+
+		/// at least 1; a queue with no room is taken to have room for 1
+		uint32_t _capacity;
+
+		dispatch(const affinity where = affinity::event_thread, const backpressure full = backpressure::block, const uint32_t capacity = 1024) :
+			_affinity(where),
+			_backpressure(full),
+			_capacity(capacity)
+		{
+		}
+	};
+
+	/// a thread which hands each broadcast message to every attached handler
+	/// ... producers (any number of threads) claim slots in a fixed ring without locking; the event thread drains everything that's ready each time it wakes
+	/// ... handlers are called from a set which attach() and detach() replace (read-copy-update) so dispatch never waits on them
+	/// ... handlers can be moved off the event thread (see pal::dispatch) so that a slow one doesn't hold up the rest
+	/// ... a full ring makes broadcast() wait, except from a handler (on the event thread itself) where the message is set aside and sent after the ring catches up
 	template<typename E>
 	class event_manager final
 	{
-		void attach_(void*, void(*)(void*, const E&));
-		void detach_(void*, void(*)(void*, const E&));
+		void attach_(void*, void(*)(void*, const E&), const bool keyed, const uint32_t topic, const dispatch&);
+		void detach_(void*, void(*)(void*, const E&), const bool keyed, const uint32_t topic);
 
 		std::thread _thread;
-		bool _terminate;
+		std::atomic<bool> _terminate;
 
+		struct sink_s;
+
+		/// an attached handler; detach() retires it and it's freed after a grace period (see synchronize_())
 		struct handler_s
 		{
 			void* _data;
 			void(*_code)(void*, const E&);
 
-			handler_s(void*, void(*)(void*, const E&));
+			dispatch::affinity _affinity;
+
+			/// only called for messages with this event_key (otherwise it's a wildcard, called for all of them)
+			bool _keyed;
+			uint32_t _topic;
+
+			/// cleared by detach(); everything that calls handlers checks it first
+			std::atomic<bool> _live;
+
+			/// the queue for dedicated and pool handlers (owned)
+			sink_s* _sink;
+
+			handler_s(void*, void(*)(void*, const E&), const bool keyed, const uint32_t topic);
 
 			bool operator <(const handler_s&) const;
 		};
 
+		/// replaced (never changed) by attach() and detach()
+		struct handlers_s
+		{
+			/// everything, sorted
+			std::vector<handler_s*> _all;
+
+			std::vector<handler_s*> _wildcard;
+
+			/// keyed handlers grouped by topic, and an open-addressed table (never more than half full) of where each topic's run is
+			std::vector<handler_s*> _keyed;
+			struct bucket_s
+			{
+				uint32_t _topic;
+				uint32_t _begin;
+				uint32_t _count;
+			};
+			std::vector<bucket_s> _buckets;
+
+			handlers_s(std::vector<handler_s*>&& all);
+
+			/// the run of handlers keyed to the message's topic (or an empty one)
+			std::pair<handler_s* const*, handler_s* const*> keyed(const E&) const;
+		};
+
+		/// a dedicated or pool handler's queue; the event thread pushes and the handler's thread takes everything waiting at once
+		struct sink_s
+		{
+			handler_s* _handler;
+			dispatch _dispatch;
+
+			std::mutex _lock;
+			std::condition_variable _ready;
+			std::condition_variable _room;
+
+			/// messages before _first have been dropped
+			std::vector<E> _pending;
+			size_t _first;
+
+			/// (pool) queued to run, or running on _runner
+			bool _scheduled;
+			std::thread::id _runner;
+
+			/// (dedicated)
+			std::thread _thread;
+			bool _terminate;
+
+			sink_s(handler_s*, const dispatch&);
+		};
+
+		struct {
+			std::mutex _lock;
+			std::deque<sink_s*> _runnable;
+			std::condition_variable _ready;
+			std::vector<std::thread> _threads;
+			size_t _size;
+			bool _terminate;
+		} _pool;
+
+		/// read-copy-update; the handler set is swapped out whole so nothing that dispatches ever takes _lock
+		/// ... the old sets (and detached handlers) are kept until everything that might be using them has moved on
 		struct {
+			/// held by attach() and detach() while they replace the set; never while they wait out a grace period
 			std::mutex _lock;
-			std::set<handler_s> _active;
+			std::atomic<const handlers_s*> _active;
+
+			/// handlers with affinity::caller (so broadcast() can skip looking)
+			std::atomic<size_t> _callers;
+
+			/// bumped by the event thread every so often between messages, and as it sleeps and wakes; odd while it's asleep
+			std::atomic<uint64_t> _passes;
+
+			/// callers part-way through calling handlers, counted against alternating phases so that detach() can wait them out
+			std::atomic<uint32_t> _phase;
+			std::atomic<uint64_t> _calling[2];
+
+			/// waiting on a grace period
+			std::vector<const handlers_s*> _retired_sets;
+			std::vector<handler_s*> _retired;
 		} _handler;
 
+		/// a message and the position it's good for; ready when _sequence is one past its position, free when _sequence equals it
+		/// ... the message is built in place by the producer and destroyed by the event thread once it's been routed
+		struct slot_s
+		{
+			std::atomic<uint64_t> _sequence;
+			alignas(E) unsigned char _storage[sizeof(E)];
+
+			E& message(void) { return *reinterpret_cast<E*>(_storage); }
+		};
+
+		/// a lane's ring; or if it coalesces, the latest message for each key in the order the keys came up
+		struct lane_s
+		{
+			std::unique_ptr<slot_s[]> _slots;
+			uint64_t _mask;
+
+			/// the next position a producer will claim
+			alignas(64) std::atomic<uint64_t> _tail;
+
+			/// the next position the event thread will read
+			alignas(64) uint64_t _head;
+
+			/// messages broadcast by handlers while the ring was full, and the position they go out after
+			std::atomic<bool> _spilled;
+			uint64_t _spill_after;
+			std::vector<E> _spill;
+
+			uint32_t _weight;
+			bool _coalesce;
+
+			std::mutex _lock;
+			std::atomic<bool> _waiting;
+			std::vector<E> _latest;
+			std::unordered_map<uint32_t, size_t> _index;
+
+			/// (for the event thread) the coalesced messages it's part way through
+			std::vector<E> _taking;
+			size_t _taken;
+		};
+
 		struct {
+			std::unique_ptr<lane_s[]> _lanes;
+			size_t _count;
+			size_t _capacity;
+			lanes::order _order;
+
+			/// whether messages have to be looked at (for their lane or key) before they can be queued
+			bool _sorted;
+
+			std::atomic<bool> _sleeping;
 			std::mutex _lock;
-			pal::queue<E> _messages;
 			std::condition_variable _condition;
 		} _queue;
 
+		/// a message waiting for its tick; linked (by index) into a slot of the wheel, or into the free list
+		struct timer_s
+		{
+			/// the tick it's due on, and the ticks between repeats (0 if it doesn't)
+			uint64_t _due;
+			uint64_t _period;
+
+			uint32_t _prev;
+			uint32_t _next;
+
+			/// bumped each time it's freed, so a stale handle can't cancel whatever it's reused for
+			uint32_t _generation;
+			uint8_t _level;
+			uint8_t _slot;
+			bool _armed;
+
+			alignas(E) unsigned char _storage[sizeof(E)];
+
+			E& message(void) { return *reinterpret_cast<E*>(_storage); }
+
+			/// the end of a list
+			static const uint32_t NONE = ~0u;
+		};
+
+		/// levels of 64 slots; the first level's slots are a tick (TICK) each, the next level's 64 ticks, and so on
+		static const size_t LEVELS = 6;
+
+		/// a hierarchical timing wheel, serviced by the event thread
+		/// ... timers come from a pool which only grows, so arming (and cancelling) one is a few index swaps under _lock
+		struct {
+			std::mutex _lock;
+			std::deque<timer_s> _pool;
+			uint32_t _free;
+
+			/// the first timer in each slot, and a bit for each slot with any
+			uint32_t _slots[LEVELS][64];
+			uint64_t _occupied[LEVELS];
+
+			/// ticks are counted from _epoch; _now is the last one serviced
+			std::chrono::steady_clock::time_point _epoch;
+			uint64_t _now;
+
+			std::atomic<size_t> _armed_count;
+
+			/// the tick the event thread will sleep until; a timer due sooner sets _rearm and wakes it
+			uint64_t _sleep;
+			std::atomic<bool> _rearm;
+
+			/// (for the event thread) messages of the timers that came due, sent once _lock is let go
+			std::vector<E> _fired;
+		} _timer;
+
+		bool pending_(void) const;
+		void wake_(void);
+
+		/// claims count positions (no more than half the ring) or returns false if the message(s) have to be set aside in _spill
+		bool claim_(lane_s&, const uint64_t count, uint64_t& position);
+
+		/// hands the message to the caller handlers, then to the event thread
+		void publish_(lane_s&, const uint64_t position);
+		void callers_(const E&);
+
+		/// builds the message in the lane's ring
+		template<typename... A>
+		void emplace_(lane_s& lane, A&&... args)
+		{
+			uint64_t position;
+			if (claim_(lane, 1, position))
+			{
+				new (lane._slots[position & lane._mask]._storage) E(std::forward<A>(args)...);
+				publish_(lane, position);
+				wake_();
+			}
+			else
+			{
+				lane._spill.emplace_back(std::forward<A>(args)...);
+				callers_(lane._spill.back());
+			}
+		}
+
+		/// puts a message in a coalescing lane, over any waiting with the same key
+		void coalesce_(lane_s&, E&&);
+
+		/// the lane a message goes in, and puts it there
+		lane_s& lane_(const E&);
+		void sort_(E&&);
+
+		/// the (manager, phase) of each caller dispatch this thread is part-way through
+		static std::vector<std::pair<const void*, uint32_t>>& calling_(void);
+
+		/// waits until nothing can still be calling a detached handler or reading a retired set
+		/// ... except this thread; returns false if it was part-way through dispatching (so nothing can be freed yet)
+		bool synchronize_(void);
+
+		/// waits until a detached handler's thread (or pool worker) is done with it; unless it's this thread
+		void quiet_(sink_s&);
+
+		/// frees retired sets and handlers; only after a whole synchronize_() begun after they were retired
+		/// ... handlers that can't be freed yet are left in the vector
+		void reclaim_(std::vector<const handlers_s*>&, std::vector<handler_s*>&);
+
+		/// reclaims what it can (if the grace period was whole) and hands the rest back to _handler, under its lock
+		void retire_(const bool whole, std::vector<const handlers_s*>&, std::vector<handler_s*>&);
+
+		/// the tick a time falls in (or the first tick not before it)
+		uint64_t floor_(const std::chrono::steady_clock::time_point) const;
+		uint64_t ceil_(const std::chrono::steady_clock::time_point) const;
+
+		/// puts a timer in the slot of the highest level where its _due differs from the next tick, or takes it out
+		void link_(const uint32_t);
+		void unlink_(const uint32_t);
+
+		/// arms a timer from the pool; returns its index (and generation)
+		uint32_t arm_(const uint64_t due, const uint64_t period, const E&, uint32_t& generation);
+
+		/// destroys a timer's message and puts it back in the pool
+		void free_(const uint32_t);
+
+		/// services the ticks up to now (jumping over those with nothing to do) and sends what came due
+		void expire_(void);
+
+		/// the tick by which the wheel next needs servicing (or ~0 if nothing's armed)
+		uint64_t next_(void) const;
+
+		/// routes up to most messages from the lane; since counts towards the next pass
+		size_t take_(lane_s&, const size_t most, size_t& since);
+
+		size_t drain_(void);
+		void push_(sink_s&, const E&);
+		void run_(sink_s&, std::vector<E>&);
+		void route_(const handlers_s&, const E&);
 		void thread_main(void);
+		void sink_main(sink_s&);
+		void pool_main(void);
 
 	public:
 
@@ -286,29 +812,243 @@ namespace pal
 			#define pal_event_manager_cpp ??? to set build symbol linkie thingie
 			#include <pal.event_manager.inc.hpp>
 		*/
+		/// attaching the same handler twice does nothing (the first dispatch stands)
+		template<typename H>
+		void attach(H* data, void(*code)(H*, const E&), const dispatch& how = dispatch())
+		{
+			attach_(
+				reinterpret_cast<void*>(data),
+				reinterpret_cast<void(*)(void*, const E&)>(code),
+				false, 0,
+				how
+			);
+		}
+
+		/// only calls the handler for messages whose event_key<E>::key() is topic
+		/// ... those are found through a hash of topics so that handlers for other topics cost nothing
 		template<typename H>
-		void attach(H* data, void(*code)(H*, const E&))
+		void attach(H* data, void(*code)(H*, const E&), const uint32_t topic, const dispatch& how = dispatch())
 		{
+			static_assert(event_key<E>::enabled, "specialise pal::event_key<E> to attach to topics");
+
 			attach_(
 				reinterpret_cast<void*>(data),
-				reinterpret_cast<void(*)(void*, const E&)>(code)
+				reinterpret_cast<void(*)(void*, const E&)>(code),
+				true, topic,
+				how
 			);
 		}
 
+		/// once this returns the handler won't be called again (unless this is the handler, which finishes its call)
+		/// ... it can be called from any handler; a handler with backpressure::block shouldn't detach (or attach) anything though
 		template<typename H>
 		void detach(H* data, void(*code)(H*, const E&))
 		{
 			detach_(
 				reinterpret_cast<void*>(data),
-				reinterpret_cast<void(*)(void*, const E&)>(code)
+				reinterpret_cast<void(*)(void*, const E&)>(code),
+				false, 0
+			);
+		}
+
+		template<typename H>
+		void detach(H* data, void(*code)(H*, const E&), const uint32_t topic)
+		{
+			detach_(
+				reinterpret_cast<void*>(data),
+				reinterpret_cast<void(*)(void*, const E&)>(code),
+				true, topic
 			);
 		}
 
 		void broadcast(const E&);
+		void broadcast(E&&);
+
+		/// builds the message in its slot in the ring
+		/// ... unless there are lanes (or coalescing) to choose between; then it's built first and moved in
+		template<typename... A>
+		void emplace_broadcast(A&&... args)
+		{
+			if (!_queue._sorted)
+				emplace_(_queue._lanes[0], std::forward<A>(args)...);
+			else
+				sort_(E(std::forward<A>(args)...));
+		}
+
+		/// copies the messages into the ring as a few big claims, and wakes the event thread once
+		void broadcast_batch(const E* messages, const size_t count);
+
+		/// names a timer, so that it can be cancelled
+		struct timer
+		{
+			uint32_t _index;
+			uint32_t _generation;
+		};
+
+		/// the timing wheel's resolution; messages go out on the first tick at (or after) the time they're due
+		static constexpr std::chrono::milliseconds TICK = std::chrono::milliseconds(1);
 
+		/// broadcasts the message (from the event thread) once the time comes
+		timer broadcast_at(const std::chrono::steady_clock::time_point, const E&);
+
+		/// broadcasts the message every period, starting a period from now, until it's cancelled
+		/// ... if the event thread falls behind, the repeats it missed are sent a tick apart
+		timer broadcast_every(const std::chrono::steady_clock::duration period, const E&);
+
+		/// returns false if the timer has already gone off (or been cancelled)
+		bool cancel(const timer&);
+
+		/// slots in the ring when no capacity is given
+		static const size_t CAPACITY = 1 << 12;
+
+		/// capacity (of each lane) is rounded up to a power of two
+		/// ... workers is the size of the pool (started with the first pool handler); 0 for one per core
+		event_manager(const size_t capacity, const size_t workers = 0, const lanes& = lanes());
 		event_manager(void);
 		~event_manager(void);
 	};
+
+	/// an append-only log of fixed size records in a ring of memory mapped segment files (path.0, path.1, ...)
+	/// ... appending copies into the mapping; a thread of its own syncs it to disk every so often (a group commit) rather than each time
+	/// ... each run carries on in a new segment; the oldest are deleted once there are more than they're allowed
+	/// ... the files are only good for the same build on the same sort of machine
+	class journal final
+	{
+		std::string _path;
+		size_t _record;
+		size_t _segment;
+		size_t _segments;
+		std::chrono::milliseconds _interval;
+
+		/// (for the appending thread) the segment being written, where the next record goes and the number it gets
+		int _file;
+		uint8_t* _mapping;
+		uint64_t _index;
+		size_t _offset;
+		uint64_t _sequence;
+
+		/// segments rolled away from but not yet synced (and closed)
+		struct retired_s
+		{
+			int _file;
+			uint8_t* _mapping;
+			size_t _end;
+		};
+
+		/// held to change segments, and by the syncing thread to see how far things have got
+		std::mutex _lock;
+		std::vector<retired_s> _retired;
+		std::atomic<size_t> _written;
+		std::atomic<uint64_t> _last;
+
+		/// one sync at a time; how far the current segment's been synced, and the last sequence number that's on disk
+		std::mutex _sync;
+		const uint8_t* _synced_mapping;
+		size_t _synced;
+		std::atomic<uint64_t> _committed;
+
+		/// errno from the last msync() that failed
+		std::atomic<int> _error;
+
+		std::thread _thread;
+		std::mutex _wake;
+		std::condition_variable _condition;
+		bool _terminate;
+
+		/// the bytes a record takes up (with its header, padded)
+		size_t stride_(void) const;
+
+		/// maps a new (empty) segment; closes the one before it later
+		bool roll_(void);
+		void sync_(void);
+
+	public:
+		/// bytes in a segment, and how many are kept
+		static const size_t SEGMENT = 1 << 26;
+		static const size_t SEGMENTS = 16;
+
+		/// where a segment's first record goes
+		static const size_t SEGMENT_HEADER = 32;
+
+		journal(void);
+
+		/// commits and closes
+		~journal(void);
+
+		/// starts a new segment after whatever is already there (numbering carries on) and the syncing thread
+		/// ... false if it can't (or there's no mmap)
+		bool open(const char* path, const size_t record, const size_t segment = SEGMENT, const size_t segments = SEGMENTS, const std::chrono::milliseconds interval = std::chrono::milliseconds(10));
+		void close(void);
+
+		/// copies a record in; from one thread at a time; returns its sequence number (from 1)
+		uint64_t append(const void*);
+
+		/// the same, but, 0 (and nothing's appended) unless size is the record size that it was opened with
+		uint64_t append(const void*, const size_t size);
+
+		/// syncs everything appended so far without waiting for the syncing thread; returns the last sequence number on disk
+		/// ... once a sync fails, that stops moving (until a later one works) and error() says why
+		uint64_t commit(void);
+		uint64_t committed(void) const;
+
+		/// errno from the last sync that failed; 0 if none has
+		int error(void) const;
+
+		/// an event_manager handler that appends each message
+		/// ... attach it with affinity::dedicated and backpressure::block so that the event thread doesn't do the copying (or the waiting)
+		template<typename E>
+		static void record(journal* self, const E& message)
+		{
+			static_assert(std::is_trivially_copyable<E>::value, "only trivially copyable messages can be journaled");
+
+			// a message of the wrong size isn't appended
+			const auto appended = self->append(&message, sizeof(E));
+			assume(0 != appended, "the journal wasn't opened with sizeof(E) records (or is closed)");
+			(void)appended;
+		}
+
+		/// calls code with each of the records, oldest segment first; returns how many
+		/// ... a segment's records stop at the first that isn't whole (or in sequence); the next segment carries on from its own start
+		static size_t replay(const char* path, const size_t record, void(*code)(void*, const void*), void* data);
+
+		/// broadcast_batch()es the records (as fast as the event_manager takes them)
+		template<typename E>
+		static size_t replay(const char* path, event_manager<E>& events)
+		{
+			static_assert(std::is_trivially_copyable<E>::value, "only trivially copyable messages can be journaled");
+
+			const size_t BATCH = 256;
+
+			struct batch_s
+			{
+				event_manager<E>& _events;
+				std::vector<E> _messages;
+
+				static void push(void* data, const void* record)
+				{
+					auto& self = *reinterpret_cast<batch_s*>(data);
+
+					alignas(E) unsigned char bytes[sizeof(E)];
+					memcpy(bytes, record, sizeof(E));
+					self._messages.push_back(*reinterpret_cast<const E*>(bytes));
+
+					if (BATCH == self._messages.size())
+						self.flush();
+				}
+
+				void flush(void)
+				{
+					_events.broadcast_batch(_messages.data(), _messages.size());
+					_messages.clear();
+				}
+			} batch = { events, {} };
+			batch._messages.reserve(BATCH);
+
+			const size_t count = replay(path, sizeof(E), batch_s::push, &batch);
+			batch.flush();
+			return count;
+		}
+	};
 }
 
 #ifdef pal_cpp
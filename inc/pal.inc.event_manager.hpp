@@ -31,9 +31,14 @@
 #ifdef pal_event_manager_cpp
 
 template<>
-pal_event_manager_cpp pal::event_manager<pal_event_manager_E>::handler_s::handler_s(void* data, void(*code)(void*, const pal_event_manager_E&)) :
+pal_event_manager_cpp pal::event_manager<pal_event_manager_E>::handler_s::handler_s(void* data, void(*code)(void*, const pal_event_manager_E&), const bool keyed, const uint32_t topic) :
 	_data(data),
-	_code(code)
+	_code(code),
+	_affinity(dispatch::affinity::event_thread),
+	_keyed(keyed),
+	_topic(topic),
+	_live(true),
+	_sink(nullptr)
 {
 }
 
@@ -47,79 +52,1309 @@ pal_event_manager_cpp bool pal::event_manager<pal_event_manager_E>::handler_s::o
 	auto td = reinterpret_cast<size_t>(_data);
 	auto od = reinterpret_cast<size_t>(other._data);
 
-	return tc == oc ? td < od : tc < oc;
+	if (tc != oc)
+		return tc < oc;
+	if (td != od)
+		return td < od;
+	if (_keyed != other._keyed)
+		return _keyed < other._keyed;
+	return _topic < other._topic;
 }
 
+template<>
+pal_event_manager_cpp pal::event_manager<pal_event_manager_E>::handlers_s::handlers_s(std::vector<handler_s*>&& all) :
+	_all(std::move(all))
+{
+	for (auto* handler : _all)
+		(handler->_keyed ? _keyed : _wildcard).push_back(handler);
+
+	if (_keyed.empty())
+		return;
+
+	std::stable_sort(_keyed.begin(), _keyed.end(), [](const handler_s* a, const handler_s* b)
+	{
+		return a->_topic < b->_topic;
+	});
+
+	size_t topics = 0;
+	for (size_t i = 0; i < _keyed.size(); ++i)
+		if (0 == i || _keyed[i - 1]->_topic != _keyed[i]->_topic)
+			++topics;
+
+	size_t size = 2;
+	while (size < topics * 2)
+		size <<= 1;
+	_buckets.resize(size, bucket_s{ 0, 0, 0 });
+
+	const size_t mask = size - 1;
+	for (size_t i = 0; i < _keyed.size(); )
+	{
+		const uint32_t topic = _keyed[i]->_topic;
+		size_t end = i;
+		while (end < _keyed.size() && topic == _keyed[end]->_topic)
+			++end;
+
+		size_t at = (topic * 0x9E3779B1u) & mask;
+		while (_buckets[at]._count)
+			at = (at + 1) & mask;
+
+		_buckets[at] = bucket_s{ topic, static_cast<uint32_t>(i), static_cast<uint32_t>(end - i) };
+		i = end;
+	}
+}
 
 template<>
-pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::broadcast(const pal_event_manager_E& message)
+pal_event_manager_cpp std::pair<pal::event_manager<pal_event_manager_E>::handler_s* const*, pal::event_manager<pal_event_manager_E>::handler_s* const*> pal::event_manager<pal_event_manager_E>::handlers_s::keyed(const pal_event_manager_E& message) const
+{
+	if (_buckets.empty())
+		return { nullptr, nullptr };
+
+	const uint32_t topic = event_key<pal_event_manager_E>::key(message);
+	const size_t mask = _buckets.size() - 1;
+
+	// the table is never full so there's always an empty bucket to stop at
+	for (size_t at = (topic * 0x9E3779B1u) & mask; _buckets[at]._count; at = (at + 1) & mask)
+		if (topic == _buckets[at]._topic)
+		{
+			auto* begin = _keyed.data() + _buckets[at]._begin;
+			return { begin, begin + _buckets[at]._count };
+		}
+
+	return { nullptr, nullptr };
+}
+
+
+template<>
+pal_event_manager_cpp pal::event_manager<pal_event_manager_E>::sink_s::sink_s(handler_s* handler, const dispatch& how) :
+	_handler(handler),
+	_dispatch(how),
+	_first(0),
+	_scheduled(false),
+	_terminate(false)
+{
+	assume(0 != _dispatch._capacity, "a handler's queue needs room for at least one message");
+	if (0 == _dispatch._capacity)
+		_dispatch._capacity = 1;
+}
+
+template<>
+pal_event_manager_cpp bool pal::event_manager<pal_event_manager_E>::pending_(void) const
+{
+	for (size_t i = 0; i < _queue._count; ++i)
+	{
+		const auto& lane = _queue._lanes[i];
+
+		// seq_cst pairs with the claim in broadcast(); either the event thread sees the claim or the producer sees it sleeping
+		if (lane._coalesce)
+		{
+			if (lane._taken < lane._taking.size() || lane._waiting.load(std::memory_order_seq_cst))
+				return true;
+		}
+		else if (lane._tail.load(std::memory_order_seq_cst) != lane._head
+			|| (lane._spilled.load(std::memory_order_relaxed) && lane._head == lane._spill_after))
+			return true;
+	}
+
+	return false;
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::wake_(void)
 {
+	if (!_queue._sleeping.load(std::memory_order_seq_cst))
+		return;
+
 	std::unique_lock<std::mutex> guard_queue(_queue._lock);
+	_queue._condition.notify_one();
+}
+
+template<>
+pal_event_manager_cpp bool pal::event_manager<pal_event_manager_E>::claim_(lane_s& lane, const uint64_t count, uint64_t& position)
+{
+	// a handler which has already set messages aside keeps doing so, to keep them in order
+	if (lane._spilled.load(std::memory_order_relaxed) && std::this_thread::get_id() == _thread.get_id())
+		return false;
+
+	uint64_t tail = lane._tail.load(std::memory_order_relaxed);
+	while (true)
+	{
+		// slots are freed in order, so if the last one is free they all are
+		const uint64_t last = tail + count - 1;
+		const auto sequence = lane._slots[last & lane._mask]._sequence.load(std::memory_order_acquire);
+
+		if (sequence == last)
+		{
+			if (!lane._tail.compare_exchange_weak(tail, tail + count, std::memory_order_seq_cst, std::memory_order_relaxed))
+				continue;
 
-	_queue._messages.emplace(message);
+			position = tail;
+			return true;
+		}
+
+		if (static_cast<int64_t>(sequence - last) < 0)
+		{
+			// full; the event thread can't wait on itself so it sets the message aside
+			if (std::this_thread::get_id() == _thread.get_id())
+			{
+				lane._spill_after = tail;
+				lane._spilled.store(true, std::memory_order_relaxed);
+				return false;
+			}
 
-	_queue._condition.notify_all();
+			std::this_thread::yield();
+		}
+
+		tail = lane._tail.load(std::memory_order_relaxed);
+	}
 }
 
 template<>
-pal_event_manager_cpp pal::event_manager<pal_event_manager_E>::event_manager(void)
+pal_event_manager_cpp std::vector<std::pair<const void*, uint32_t>>& pal::event_manager<pal_event_manager_E>::calling_(void)
 {
-	_terminate = false;
-	_thread = std::thread([this]
+	thread_local std::vector<std::pair<const void*, uint32_t>> calling;
+	return calling;
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::callers_(const pal_event_manager_E& message)
+{
+	if (0 == _handler._callers.load(std::memory_order_acquire))
+		return;
+
+	auto& calling = calling_();
+	const uint32_t phase = _handler._phase.load(std::memory_order_seq_cst) & 1;
+	_handler._calling[phase].fetch_add(1, std::memory_order_seq_cst);
+	calling.emplace_back(this, phase);
+
+	const auto& handlers = *_handler._active.load(std::memory_order_seq_cst);
+	for (auto* handler : handlers._wildcard)
+		if (dispatch::affinity::caller == handler->_affinity && handler->_live.load(std::memory_order_seq_cst))
+			handler->_code(handler->_data, message);
+
+	const auto keyed = handlers.keyed(message);
+	for (auto* handler = keyed.first; handler != keyed.second; ++handler)
+		if (dispatch::affinity::caller == (*handler)->_affinity && (*handler)->_live.load(std::memory_order_seq_cst))
+			(*handler)->_code((*handler)->_data, message);
+
+	calling.pop_back();
+	_handler._calling[phase].fetch_sub(1, std::memory_order_release);
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::publish_(lane_s& lane, const uint64_t position)
+{
+	auto& slot = lane._slots[position & lane._mask];
+
+	callers_(slot.message());
+
+	slot._sequence.store(position + 1, std::memory_order_release);
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::coalesce_(lane_s& lane, pal_event_manager_E&& message)
+{
+	callers_(message);
+
+	const uint32_t key = event_key<pal_event_manager_E>::key(message);
 	{
-		this->thread_main();
-	});
+		std::unique_lock<std::mutex> guard_lane(lane._lock);
+
+		auto found = lane._index.find(key);
+		if (lane._index.end() == found)
+		{
+			lane._index.emplace(key, lane._latest.size());
+			lane._latest.push_back(std::move(message));
+		}
+		else
+		{
+			auto& latest = lane._latest[found->second];
+			std::destroy_at(&latest);
+			new (&latest) pal_event_manager_E(std::move(message));
+		}
+
+		lane._waiting.store(true, std::memory_order_seq_cst);
+	}
+
+	wake_();
 }
 
 template<>
-pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::thread_main(void)
+pal_event_manager_cpp typename pal::event_manager<pal_event_manager_E>::lane_s& pal::event_manager<pal_event_manager_E>::lane_(const pal_event_manager_E& message)
+{
+	return _queue._lanes[std::min(_queue._count - 1, event_lane<pal_event_manager_E>::lane(message))];
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::sort_(pal_event_manager_E&& message)
+{
+	auto& lane = lane_(message);
+
+	if (lane._coalesce)
+		coalesce_(lane, std::move(message));
+	else
+		emplace_(lane, std::move(message));
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::broadcast(const pal_event_manager_E& message)
+{
+	emplace_broadcast(message);
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::broadcast(pal_event_manager_E&& message)
+{
+	emplace_broadcast(std::move(message));
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::broadcast_batch(const pal_event_manager_E* messages, const size_t count)
+{
+	if (_queue._sorted)
+	{
+		for (size_t i = 0; i < count; ++i)
+			sort_(pal_event_manager_E(messages[i]));
+		return;
+	}
+
+	auto& lane = _queue._lanes[0];
+	const uint64_t most = std::max<uint64_t>(1, (lane._mask + 1) / 2);
+
+	size_t done = 0;
+	while (done < count)
+	{
+		const uint64_t claim = std::min<uint64_t>(most, count - done);
+
+		uint64_t position;
+		if (!claim_(lane, claim, position))
+		{
+			for (; done < count; ++done)
+			{
+				lane._spill.emplace_back(messages[done]);
+				callers_(lane._spill.back());
+			}
+			break;
+		}
+
+		for (uint64_t i = 0; i < claim; ++i)
+			new (lane._slots[(position + i) & lane._mask]._storage) pal_event_manager_E(messages[done + i]);
+
+		for (uint64_t i = 0; i < claim; ++i)
+			publish_(lane, position + i);
+
+		done += claim;
+	}
+
+	wake_();
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::push_(sink_s& sink, const pal_event_manager_E& message)
+{
+	std::unique_lock<std::mutex> guard_sink(sink._lock);
+
+	if (sink._pending.size() - sink._first >= sink._dispatch._capacity)
+		switch (sink._dispatch._backpressure)
+		{
+			case dispatch::backpressure::block:
+				while (!sink._room.wait_for(guard_sink, std::chrono::milliseconds(100), [&](void)
+				{
+					return sink._pending.size() - sink._first < sink._dispatch._capacity;
+				}))
+					;
+				break;
+
+			case dispatch::backpressure::drop_oldest:
+				// dropped messages are skipped rather than erased, until there's a queue's worth of them
+				if (++sink._first >= sink._dispatch._capacity)
+				{
+					sink._pending.erase(sink._pending.begin(), sink._pending.begin() + sink._first);
+					sink._first = 0;
+				}
+				break;
+
+			case dispatch::backpressure::coalesce:
+			{
+				// the newest waiting message with the same key (which is the newest of them all, for messages without keys)
+				const uint32_t key = event_key<pal_event_manager_E>::key(message);
+
+				auto replaced = sink._pending.size() - 1;
+				for (auto next = sink._pending.size(); sink._first < next; --next)
+					if (key == event_key<pal_event_manager_E>::key(sink._pending[next - 1]))
+					{
+						replaced = next - 1;
+						break;
+					}
+
+				sink._pending[replaced] = message;
+				return;
+			}
+		}
+
+	sink._pending.push_back(message);
+
+	if (dispatch::affinity::dedicated == sink._dispatch._affinity)
+	{
+		sink._ready.notify_one();
+		return;
+	}
+
+	if (sink._scheduled)
+		return;
+
+	sink._scheduled = true;
+	guard_sink.unlock();
+
+	std::unique_lock<std::mutex> guard_pool(_pool._lock);
+	_pool._runnable.push_back(&sink);
+	_pool._ready.notify_one();
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::run_(sink_s& sink, std::vector<pal_event_manager_E>& batch)
+{
+	// the caller has checked that there's something waiting
+	size_t first;
+	{
+		std::unique_lock<std::mutex> guard_sink(sink._lock);
+
+		// the emptied batch goes back so that the queue keeps its capacity
+		batch.swap(sink._pending);
+		first = sink._first;
+		sink._first = 0;
+
+		sink._room.notify_one();
+	}
+
+	{
+		pal__trace_span("pal.event", "sink");
+
+		// a detached handler's queue is dropped
+		for (size_t i = first; i < batch.size() && sink._handler->_live.load(std::memory_order_seq_cst); ++i)
+			sink._handler->_code(sink._handler->_data, batch[i]);
+	}
+
+	batch.clear();
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::route_(const handlers_s& handlers, const pal_event_manager_E& message)
 {
-	auto predicate = [&](void)
+	const auto route = [this, &message](handler_s* handler)
 	{
-		return !_queue._messages.empty() || _terminate;
+		if (!handler->_live.load(std::memory_order_seq_cst))
+			return;
+		else if (handler->_sink)
+			push_(*handler->_sink, message);
+		else if (dispatch::affinity::event_thread == handler->_affinity)
+			handler->_code(handler->_data, message);
 	};
 
+	for (auto* handler : handlers._wildcard)
+		route(handler);
+
+	// only the handlers keyed to this message's topic
+	const auto keyed = handlers.keyed(message);
+	for (auto* handler = keyed.first; handler != keyed.second; ++handler)
+		route(*handler);
+}
+
+template<>
+pal_event_manager_cpp size_t pal::event_manager<pal_event_manager_E>::take_(lane_s& lane, const size_t most, size_t& since)
+{
+	// messages between passes; the set mustn't be held across one
+	const size_t PASS = 64;
+
+	const uint64_t capacity = lane._mask + 1;
+	size_t taken = 0;
+
+	while (taken < most)
+	{
+		if (PASS == since)
+		{
+			_handler._passes.fetch_add(2, std::memory_order_seq_cst);
+			since = 0;
+		}
+
+		const auto* handlers = _handler._active.load(std::memory_order_seq_cst);
+
+		if (lane._coalesce)
+		{
+			if (lane._taken == lane._taking.size())
+			{
+				lane._taking.clear();
+				lane._taken = 0;
+
+				if (!lane._waiting.load(std::memory_order_seq_cst))
+					break;
+
+				std::unique_lock<std::mutex> guard_lane(lane._lock);
+				lane._taking.swap(lane._latest);
+				lane._index.clear();
+				lane._waiting.store(false, std::memory_order_relaxed);
+			}
+
+			route_(*handlers, lane._taking[lane._taken++]);
+			++taken;
+			++since;
+			continue;
+		}
+
+		// messages set aside by handlers go once everything claimed before them has
+		if (lane._spilled.load(std::memory_order_relaxed) && lane._head == lane._spill_after)
+		{
+			std::vector<pal_event_manager_E> spill;
+			spill.swap(lane._spill);
+			lane._spilled.store(false, std::memory_order_relaxed);
+
+			for (auto& message : spill)
+				route_(*handlers, message);
+
+			taken += spill.size();
+			since += spill.size();
+			continue;
+		}
+
+		auto& slot = lane._slots[lane._head & lane._mask];
+		if (slot._sequence.load(std::memory_order_acquire) != lane._head + 1)
+			break;
+
+		route_(*handlers, slot.message());
+		std::destroy_at(&slot.message());
+
+		slot._sequence.store(lane._head + capacity, std::memory_order_release);
+		++lane._head;
+		++taken;
+		++since;
+	}
+
+	return taken;
+}
+
+template<>
+pal_event_manager_cpp size_t pal::event_manager<pal_event_manager_E>::drain_(void)
+{
+	pal__trace_span("pal.event", "dispatch");
+
+	// returns now and then under a flood, so that timers are still serviced
+	const size_t ENOUGH = _queue._capacity;
+
+	const bool strict = lanes::order::strict == _queue._order;
+	size_t drained = 0;
+	size_t since = 0;
+
+	while (drained < ENOUGH)
+	{
+		size_t taken = 0;
+		for (size_t i = 0; i < _queue._count; ++i)
+		{
+			auto& lane = _queue._lanes[i];
+
+			// strictly, only the most urgent lane goes on; the others give way after each message in case it's got more
+			taken += take_(lane, strict ? (0 == i ? ENOUGH : 1) : lane._weight, since);
+
+			if (strict && taken)
+				break;
+		}
+
+		if (!taken)
+			break;
+
+		drained += taken;
+	}
+
+	if (since)
+		_handler._passes.fetch_add(2, std::memory_order_seq_cst);
+
+	return drained;
+}
+
+template<>
+pal_event_manager_cpp uint64_t pal::event_manager<pal_event_manager_E>::floor_(const std::chrono::steady_clock::time_point when) const
+{
+	if (when <= _timer._epoch)
+		return 0;
+
+	return static_cast<uint64_t>((when - _timer._epoch) / TICK);
+}
+
+template<>
+pal_event_manager_cpp uint64_t pal::event_manager<pal_event_manager_E>::ceil_(const std::chrono::steady_clock::time_point when) const
+{
+	const uint64_t tick = floor_(when);
+
+	return (_timer._epoch + static_cast<int64_t>(tick) * TICK < when) ? tick + 1 : tick;
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::link_(const uint32_t index)
+{
+	auto& timer = _timer._pool[index];
+
+	const uint64_t first = _timer._now + 1;
+	if (timer._due < first)
+		timer._due = first;
+
+	// beyond the wheel's reach it waits for the last tick within it, and is put back from there
+	const uint64_t reach = ((first >> (6 * LEVELS)) + 1) << (6 * LEVELS);
+	const uint64_t at = std::min(timer._due, reach - 1);
+
+	size_t level = 0;
+	while (level + 1 < LEVELS && ((at ^ first) >> (6 * (level + 1))))
+		++level;
+
+	const uint32_t slot = static_cast<uint32_t>((at >> (6 * level)) & 63);
+
+	timer._level = static_cast<uint8_t>(level);
+	timer._slot = static_cast<uint8_t>(slot);
+	timer._prev = timer_s::NONE;
+	timer._next = _timer._slots[level][slot];
+
+	if (timer_s::NONE != timer._next)
+		_timer._pool[timer._next]._prev = index;
+
+	_timer._slots[level][slot] = index;
+	_timer._occupied[level] |= 1ull << slot;
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::unlink_(const uint32_t index)
+{
+	auto& timer = _timer._pool[index];
+	auto& head = _timer._slots[timer._level][timer._slot];
+
+	if (timer_s::NONE != timer._prev)
+		_timer._pool[timer._prev]._next = timer._next;
+	else
+		head = timer._next;
+
+	if (timer_s::NONE != timer._next)
+		_timer._pool[timer._next]._prev = timer._prev;
+
+	if (timer_s::NONE == head)
+		_timer._occupied[timer._level] &= ~(1ull << timer._slot);
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::free_(const uint32_t index)
+{
+	auto& timer = _timer._pool[index];
+
+	std::destroy_at(&timer.message());
+	timer._armed = false;
+	++timer._generation;
+
+	timer._next = _timer._free;
+	_timer._free = index;
+
+	_timer._armed_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+template<>
+pal_event_manager_cpp uint32_t pal::event_manager<pal_event_manager_E>::arm_(const uint64_t due, const uint64_t period, const pal_event_manager_E& message, uint32_t& generation)
+{
+	std::unique_lock<std::mutex> guard_timer(_timer._lock);
+
+	// an empty wheel can skip straight to now
+	if (0 == _timer._armed_count.load(std::memory_order_relaxed))
+		_timer._now = std::max(_timer._now, floor_(std::chrono::steady_clock::now()));
+
+	uint32_t index = _timer._free;
+	if (timer_s::NONE == index)
+	{
+		index = static_cast<uint32_t>(_timer._pool.size());
+		_timer._pool.emplace_back();
+	}
+	else
+		_timer._free = _timer._pool[index]._next;
+
+	auto& timer = _timer._pool[index];
+	new (timer._storage) pal_event_manager_E(message);
+	timer._due = due;
+	timer._period = period;
+	timer._armed = true;
+
+	link_(index);
+	_timer._armed_count.fetch_add(1, std::memory_order_relaxed);
+
+	generation = timer._generation;
+
+	// the event thread is asleep until after this is due
+	const bool sooner = timer._due < _timer._sleep;
+	if (sooner)
+	{
+		_timer._sleep = timer._due;
+		_timer._rearm.store(true, std::memory_order_seq_cst);
+	}
+
+	guard_timer.unlock();
+
+	if (sooner)
+		wake_();
+
+	return index;
+}
+
+template<>
+pal_event_manager_cpp uint64_t pal::event_manager<pal_event_manager_E>::next_(void) const
+{
+	if (0 == _timer._armed_count.load(std::memory_order_relaxed))
+		return ~0ull;
+
+	const uint64_t first = _timer._now + 1;
+	uint64_t next = ~0ull;
+
+	// the first occupied slot of each level from the one the next tick is in; for the upper levels that's when it comes down
+	for (size_t level = 0; level < LEVELS; ++level)
+	{
+		const uint64_t occupied = _timer._occupied[level];
+		if (!occupied)
+			continue;
+
+		const size_t shift = 6 * level;
+		const uint64_t current = (first >> shift) & 63;
+		const uint64_t base = (first >> (shift + 6)) << (shift + 6);
+		const uint64_t ahead = occupied & (~0ull << current);
+
+		const uint64_t tick = ahead
+			? base + (static_cast<uint64_t>(pal::lowest_bit(ahead)) << shift)
+			: base + (64ull << shift) + (static_cast<uint64_t>(pal::lowest_bit(occupied)) << shift);
+
+		next = std::min(next, tick);
+	}
+
+	return next;
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::expire_(void)
+{
+	if (0 == _timer._armed_count.load(std::memory_order_relaxed))
+		return;
+
+	const uint64_t until = floor_(std::chrono::steady_clock::now());
+
+	{
+		std::unique_lock<std::mutex> guard_timer(_timer._lock);
+
+		while (_timer._now < until && _timer._armed_count.load(std::memory_order_relaxed))
+		{
+			// nothing happens on the ticks before the next occupied slot (or level coming down); so, they're skipped
+			const uint64_t due = next_();
+			if (until < due)
+			{
+				_timer._now = until;
+				break;
+			}
+
+			_timer._now = std::max(_timer._now, due - 1);
+			const uint64_t tick = _timer._now + 1;
+
+			// as each level wraps around, the next level's slot comes down
+			for (size_t level = 1; level < LEVELS && 0 == (tick & ((1ull << (6 * level)) - 1)); ++level)
+			{
+				const uint32_t slot = static_cast<uint32_t>((tick >> (6 * level)) & 63);
+
+				uint32_t index = _timer._slots[level][slot];
+				_timer._slots[level][slot] = timer_s::NONE;
+				_timer._occupied[level] &= ~(1ull << slot);
+
+				while (timer_s::NONE != index)
+				{
+					const uint32_t next = _timer._pool[index]._next;
+					link_(index);
+					index = next;
+				}
+			}
+
+			_timer._now = tick;
+
+			const uint32_t slot = static_cast<uint32_t>(tick & 63);
+
+			uint32_t index = _timer._slots[0][slot];
+			_timer._slots[0][slot] = timer_s::NONE;
+			_timer._occupied[0] &= ~(1ull << slot);
+
+			while (timer_s::NONE != index)
+			{
+				auto& timer = _timer._pool[index];
+				const uint32_t next = timer._next;
+
+				if (tick < timer._due)
+					link_(index);
+				else if (timer._period)
+				{
+					_timer._fired.push_back(timer.message());
+					timer._due = std::max(timer._due + timer._period, tick + 1);
+					link_(index);
+				}
+				else
+				{
+					_timer._fired.push_back(std::move(timer.message()));
+					free_(index);
+				}
+
+				index = next;
+			}
+		}
+
+		if (0 == _timer._armed_count.load(std::memory_order_relaxed))
+			_timer._now = std::max(_timer._now, until);
+	}
+
+	for (auto& message : _timer._fired)
+		emplace_broadcast(std::move(message));
+	_timer._fired.clear();
+}
+
+template<>
+pal_event_manager_cpp typename pal::event_manager<pal_event_manager_E>::timer pal::event_manager<pal_event_manager_E>::broadcast_at(const std::chrono::steady_clock::time_point when, const pal_event_manager_E& message)
+{
+	timer handle;
+	handle._index = arm_(ceil_(when), 0, message, handle._generation);
+	return handle;
+}
+
+template<>
+pal_event_manager_cpp typename pal::event_manager<pal_event_manager_E>::timer pal::event_manager<pal_event_manager_E>::broadcast_every(const std::chrono::steady_clock::duration period, const pal_event_manager_E& message)
+{
+	const uint64_t ticks = std::max<uint64_t>(1, static_cast<uint64_t>((period + TICK - std::chrono::steady_clock::duration(1)) / TICK));
+
+	timer handle;
+	handle._index = arm_(ceil_(std::chrono::steady_clock::now() + period), ticks, message, handle._generation);
+	return handle;
+}
+
+template<>
+pal_event_manager_cpp bool pal::event_manager<pal_event_manager_E>::cancel(const timer& handle)
+{
+	std::unique_lock<std::mutex> guard_timer(_timer._lock);
+
+	if (_timer._pool.size() <= handle._index)
+		return false;
+
+	auto& timer = _timer._pool[handle._index];
+	if (!timer._armed || timer._generation != handle._generation)
+		return false;
+
+	unlink_(handle._index);
+	free_(handle._index);
+	return true;
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::thread_main(void)
+{
+	// yields before sleeping; producers tend to come straight back
+	const int SPIN = 64;
+
 	while (true)
 	{
-		pal_event_manager_E message;
+		expire_();
+
+		if (drain_())
+			continue;
+
+		bool pending = false;
+		for (int spin = 0; spin < SPIN && !(pending = pending_()); ++spin)
+			std::this_thread::yield();
+
+		if (pending)
+			continue;
 
+		// sleep until the next timer (if any) is due
+		uint64_t due;
 		{
-			std::unique_lock<std::mutex> guard_queue(_queue._lock);
+			std::unique_lock<std::mutex> guard_timer(_timer._lock);
+			due = next_();
+			_timer._sleep = due;
+			_timer._rearm.store(false, std::memory_order_seq_cst);
+		}
+		const auto until = (~0ull == due) ? std::chrono::steady_clock::time_point::max() : _timer._epoch + static_cast<int64_t>(due) * TICK;
+
+		std::unique_lock<std::mutex> guard_queue(_queue._lock);
+
+		// the timeout is only a backstop; producers (the destructor, and timers due sooner) notify
+		_handler._passes.fetch_add(1, std::memory_order_seq_cst);
+		_queue._sleeping.store(true, std::memory_order_seq_cst);
+		while (!(pending_() || _terminate.load() || _timer._rearm.load(std::memory_order_seq_cst)))
+		{
+			const auto now = std::chrono::steady_clock::now();
+			if (until <= now)
+				break;
 
-			_queue._condition.wait(guard_queue, predicate);
+			_queue._condition.wait_for(guard_queue, std::min<std::chrono::steady_clock::duration>(std::chrono::milliseconds(100), until - now));
+		}
+		_queue._sleeping.store(false, std::memory_order_relaxed);
+		guard_queue.unlock();
+
+		{
+			std::unique_lock<std::mutex> guard_timer(_timer._lock);
+			_timer._sleep = 0;
+		}
+
+		// if there are no messages - we woke to finish (and stay "asleep")
+		if (_terminate.load() && !pending_())
+			break;
+
+		_handler._passes.fetch_add(1, std::memory_order_seq_cst);
+	}
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::sink_main(sink_s& sink)
+{
+	std::vector<pal_event_manager_E> batch;
+
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> guard_sink(sink._lock);
+
+			while (!sink._ready.wait_for(guard_sink, std::chrono::milliseconds(100), [&](void)
+			{
+				return sink._pending.size() > sink._first || sink._terminate;
+			}))
+				;
 
 			// if there are no messages - we woke to finish
-			if (_queue._messages.empty())
+			if (sink._pending.size() == sink._first)
 				break;
+		}
+
+		run_(sink, batch);
+	}
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::pool_main(void)
+{
+	std::vector<pal_event_manager_E> batch;
+
+	while (true)
+	{
+		sink_s* sink;
+		{
+			std::unique_lock<std::mutex> guard_pool(_pool._lock);
+
+			while (!_pool._ready.wait_for(guard_pool, std::chrono::milliseconds(100), [&](void)
+			{
+				return !_pool._runnable.empty() || _pool._terminate;
+			}))
+				;
+
+			if (_pool._runnable.empty())
+				break;
+
+			sink = _pool._runnable.front();
+			_pool._runnable.pop_front();
+		}
+
+		{
+			std::unique_lock<std::mutex> guard_sink(sink->_lock);
+			sink->_runner = std::this_thread::get_id();
+		}
+
+		run_(*sink, batch);
+
+		// anything which came in while it ran goes to the back of the line
+		{
+			std::unique_lock<std::mutex> guard_sink(sink->_lock);
+			sink->_runner = std::thread::id();
+
+			if (!sink->_handler->_live.load(std::memory_order_seq_cst))
+			{
+				sink->_pending.clear();
+				sink->_first = 0;
+			}
 
-			message = _queue._messages.pull();
+			if (sink->_pending.size() == sink->_first)
+			{
+				// the sink can be freed as soon as this is seen
+				sink->_scheduled = false;
+				continue;
+			}
 		}
 
-		// broadcast the message
+		std::unique_lock<std::mutex> guard_pool(_pool._lock);
+		_pool._runnable.push_back(sink);
+		_pool._ready.notify_one();
+	}
+}
+
+template<>
+pal_event_manager_cpp bool pal::event_manager<pal_event_manager_E>::synchronize_(void)
+{
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	bool whole = true;
+
+	// the event thread finishes the messages it's on (unless this is it, in which case it's checking _live as it goes)
+	if (std::this_thread::get_id() == _thread.get_id())
+		whole = false;
+	else
+	{
+		const auto passes = _handler._passes.load(std::memory_order_seq_cst);
+		if (0 == (passes & 1))
+			while (passes == _handler._passes.load(std::memory_order_seq_cst))
+				std::this_thread::yield();
+	}
+
+	// callers finish what they're calling, in both phases; each is flipped away from first so that new callers don't hold it up
+	// ... other threads can be synchronizing too and flip it back, which only makes this wait longer
+	const auto& calling = calling_();
+	for (uint32_t phase = 0; phase < 2; ++phase)
+	{
+		auto current = _handler._phase.load(std::memory_order_seq_cst);
+		if (phase == (current & 1))
+			_handler._phase.compare_exchange_strong(current, current + 1, std::memory_order_seq_cst);
+
+		uint64_t own = 0;
+		for (auto& call : calling)
+			if (call.first == this && call.second == phase)
+				++own;
+
+		if (own)
+			whole = false;
+
+		while (_handler._calling[phase].load(std::memory_order_seq_cst) > own)
+			std::this_thread::yield();
+	}
+
+	return whole;
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::quiet_(sink_s& sink)
+{
+	if (dispatch::affinity::dedicated == sink._dispatch._affinity)
+	{
+		{
+			std::unique_lock<std::mutex> guard_sink(sink._lock);
+			sink._terminate = true;
+			sink._ready.notify_one();
+		}
+
+		if (sink._thread.get_id() != std::this_thread::get_id())
+			sink._thread.join();
+
+		return;
+	}
+
+	// the event thread has stopped scheduling it, so it only has to come off the pool
+	std::unique_lock<std::mutex> guard_sink(sink._lock);
+	while (sink._scheduled && sink._runner != std::this_thread::get_id())
+	{
+		guard_sink.unlock();
+		std::this_thread::yield();
+		guard_sink.lock();
+	}
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::reclaim_(std::vector<const handlers_s*>& sets, std::vector<handler_s*>& handlers)
+{
+	for (auto* set : sets)
+		delete set;
+	sets.clear();
+
+	// handlers detached from their own threads are kept until those threads are done with them
+	std::vector<handler_s*> keep;
+	for (auto* handler : handlers)
+	{
+		if (auto* sink = handler->_sink)
 		{
-			std::unique_lock<std::mutex> guard_queue(_handler._lock);
+			if (dispatch::affinity::dedicated == sink->_dispatch._affinity)
+			{
+				if (sink->_thread.get_id() == std::this_thread::get_id())
+				{
+					keep.push_back(handler);
+					continue;
+				}
+
+				if (sink->_thread.joinable())
+					sink->_thread.join();
+			}
+			else
+			{
+				bool scheduled;
+				{
+					std::unique_lock<std::mutex> guard_sink(sink->_lock);
+					scheduled = sink->_scheduled;
+				}
 
-			for (auto& handler : _handler._active)
-				handler._code(handler._data, message);
+				if (scheduled)
+				{
+					keep.push_back(handler);
+					continue;
+				}
+			}
+
+			delete sink;
 		}
+
+		delete handler;
 	}
+	handlers.swap(keep);
 }
 
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::retire_(const bool whole, std::vector<const handlers_s*>& sets, std::vector<handler_s*>& handlers)
+{
+	if (whole)
+		reclaim_(sets, handlers);
+
+	// whatever couldn't be freed yet goes back for the next one
+	std::unique_lock<std::mutex> guard_handlers(_handler._lock);
+	_handler._retired_sets.insert(_handler._retired_sets.end(), sets.begin(), sets.end());
+	_handler._retired.insert(_handler._retired.end(), handlers.begin(), handlers.end());
+}
 
 template<>
 pal_event_manager_cpp pal::event_manager<pal_event_manager_E>::~event_manager(void)
 {
 	_terminate = true;
-	_queue._condition.notify_all();
+	{
+		std::unique_lock<std::mutex> guard_queue(_queue._lock);
+		_queue._condition.notify_all();
+	}
 	_thread.join();
+
+	// timers still waiting are dropped
+	for (auto& timer : _timer._pool)
+		if (timer._armed)
+			std::destroy_at(&timer.message());
+
+	// the event thread has routed everything by now; the handlers' own threads finish their queues
+	const auto* active = _handler._active.load(std::memory_order_seq_cst);
+	for (auto* handler : active->_all)
+		if (handler->_sink && handler->_sink->_thread.joinable())
+		{
+			auto& sink = *handler->_sink;
+			{
+				std::unique_lock<std::mutex> guard_sink(sink._lock);
+				sink._terminate = true;
+				sink._ready.notify_one();
+			}
+			sink._thread.join();
+		}
+
+	{
+		std::unique_lock<std::mutex> guard_pool(_pool._lock);
+		_pool._terminate = true;
+		_pool._ready.notify_all();
+	}
+	for (auto& thread : _pool._threads)
+		thread.join();
+
+	// handlers which detached themselves have been told to stop; reclaim_() joins their threads
+	for (auto* handler : active->_all)
+	{
+		delete handler->_sink;
+		delete handler;
+	}
+	delete active;
+
+	reclaim_(_handler._retired_sets, _handler._retired);
 }
 
 template<>
-pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::attach_(void* data, void(*code)(void*, const pal_event_manager_E&))
+pal_event_manager_cpp pal::event_manager<pal_event_manager_E>::event_manager(const size_t capacity, const size_t workers, const lanes& how)
 {
+	size_t size = 2;
+	while (size < capacity)
+		size <<= 1;
+
+	assume(!how._weights.empty() && how._weights.size() == how._coalesce.size());
+
+	_queue._capacity = size;
+	_queue._count = how._weights.size();
+	_queue._lanes.reset(new lane_s[_queue._count]);
+	_queue._order = how._order;
+	_queue._sorted = 1 < _queue._count;
+	_queue._sleeping = false;
+
+	for (size_t i = 0; i < _queue._count; ++i)
+	{
+		auto& lane = _queue._lanes[i];
+
+		lane._weight = std::max<uint32_t>(1, how._weights[i]);
+		lane._coalesce = how._coalesce[i];
+		lane._waiting = false;
+		lane._taken = 0;
+		_queue._sorted = _queue._sorted || lane._coalesce;
+
+		lane._tail = 0;
+		lane._head = 0;
+		lane._spilled = false;
+		lane._spill_after = 0;
+
+		// coalescing lanes don't have a ring
+		if (lane._coalesce)
+		{
+			lane._mask = 0;
+			continue;
+		}
+
+		lane._slots.reset(new slot_s[size]);
+		lane._mask = size - 1;
+		for (size_t j = 0; j < size; ++j)
+			lane._slots[j]._sequence.store(j, std::memory_order_relaxed);
+	}
+
+	_handler._active = new handlers_s(std::vector<handler_s*>());
+
+	_timer._free = timer_s::NONE;
+	for (auto& level : _timer._slots)
+		for (auto& slot : level)
+			slot = timer_s::NONE;
+	for (auto& occupied : _timer._occupied)
+		occupied = 0;
+	_timer._epoch = std::chrono::steady_clock::now();
+	_timer._now = 0;
+	_timer._armed_count = 0;
+	_timer._sleep = 0;
+	_timer._rearm = false;
+	_handler._callers = 0;
+	_handler._passes = 0;
+	_handler._phase = 0;
+	_handler._calling[0] = 0;
+	_handler._calling[1] = 0;
+
+	_pool._size = workers ? workers : std::max<size_t>(1, std::thread::hardware_concurrency());
+	_pool._terminate = false;
+
+	_terminate = false;
+	_thread = std::thread([this]
+	{
+		this->thread_main();
+	});
+}
+
+template<>
+pal_event_manager_cpp pal::event_manager<pal_event_manager_E>::event_manager(void) :
+	event_manager(CAPACITY)
+{
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::attach_(void* data, void(*code)(void*, const pal_event_manager_E&), const bool keyed, const uint32_t topic, const dispatch& how)
+{
+	// retired sets are left to pile up this far before attach() waits to free them
+	const size_t RETIRED = 16;
+
 	std::unique_lock<std::mutex> guard_handlers(_handler._lock);
 
-	_handler._active.emplace(data, code);
+	const auto* active = _handler._active.load(std::memory_order_relaxed);
+
+	const handler_s key(data, code, keyed, topic);
+	auto at = std::lower_bound(active->_all.begin(), active->_all.end(), &key, [](const handler_s* a, const handler_s* b)
+	{
+		return *a < *b;
+	});
+	if (active->_all.end() != at && !(key < **at))
+		return;
+
+	auto* handler = new handler_s(data, code, keyed, topic);
+	handler->_affinity = how._affinity;
+
+	switch (how._affinity)
+	{
+		case dispatch::affinity::event_thread:
+			break;
+
+		case dispatch::affinity::dedicated:
+		case dispatch::affinity::pool:
+		{
+			auto* sink = new sink_s(handler, how);
+			handler->_sink = sink;
+
+			if (dispatch::affinity::dedicated == how._affinity)
+				sink->_thread = std::thread([this, sink]
+				{
+					this->sink_main(*sink);
+				});
+			else if (_pool._threads.empty())
+				for (size_t i = 0; i < _pool._size; ++i)
+					_pool._threads.emplace_back([this]
+					{
+						this->pool_main();
+					});
+			break;
+		}
+
+		case dispatch::affinity::caller:
+			_handler._callers.fetch_add(1, std::memory_order_relaxed);
+			break;
+	}
+
+	std::vector<handler_s*> all(active->_all);
+	all.insert(all.begin() + (at - active->_all.begin()), handler);
+	auto* replacement = new handlers_s(std::move(all));
+
+	_handler._active.store(replacement, std::memory_order_seq_cst);
+	_handler._retired_sets.push_back(active);
+
+	// the event thread can't wait on itself, so it leaves them for someone else
+	if (_handler._retired_sets.size() < RETIRED || std::this_thread::get_id() == _thread.get_id())
+		return;
+
+	// the grace period is waited out unlocked, since a handler it's waiting on could be attaching or detaching
+	std::vector<const handlers_s*> sets;
+	std::vector<handler_s*> handlers;
+	sets.swap(_handler._retired_sets);
+	handlers.swap(_handler._retired);
+	guard_handlers.unlock();
+
+	const bool whole = synchronize_();
+	retire_(whole, sets, handlers);
+}
+
+template<>
+pal_event_manager_cpp void pal::event_manager<pal_event_manager_E>::detach_(void* data, void(*code)(void*, const pal_event_manager_E&), const bool keyed, const uint32_t topic)
+{
+	std::unique_lock<std::mutex> guard_handlers(_handler._lock);
+
+	const auto* active = _handler._active.load(std::memory_order_relaxed);
+
+	const handler_s key(data, code, keyed, topic);
+	auto at = std::lower_bound(active->_all.begin(), active->_all.end(), &key, [](const handler_s* a, const handler_s* b)
+	{
+		return *a < *b;
+	});
+	if (active->_all.end() == at || key < **at)
+		return;
+
+	auto* handler = *at;
+	handler->_live.store(false, std::memory_order_seq_cst);
+
+	if (dispatch::affinity::caller == handler->_affinity)
+		_handler._callers.fetch_sub(1, std::memory_order_relaxed);
+
+	std::vector<handler_s*> all(active->_all);
+	all.erase(all.begin() + (at - active->_all.begin()));
+	auto* replacement = new handlers_s(std::move(all));
+
+	_handler._active.store(replacement, std::memory_order_seq_cst);
+
+	// the grace period is waited out unlocked, since a handler it's waiting on could be attaching or detaching
+	// ... whatever was retired before now is covered by it too
+	std::vector<const handlers_s*> sets;
+	std::vector<handler_s*> handlers;
+	sets.swap(_handler._retired_sets);
+	handlers.swap(_handler._retired);
+	guard_handlers.unlock();
+	sets.push_back(active);
+
+	// after this the event thread won't route to it either
+	const bool whole = synchronize_();
+
+	if (handler->_sink)
+		quiet_(*handler->_sink);
+
+	// it's only up for reclaiming once it's quiet, so nobody else joins its thread meanwhile
+	handlers.push_back(handler);
+	retire_(whole, sets, handlers);
 }
 
 #endif // pal_event_manager_cpp
@@ -0,0 +1,299 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#pragma once
+
+#include "whippet.hpp"
+
+#include <utility>
+#include <vector>
+
+namespace whippet
+{
+	/// entities in a tree (or a forest) with a T for each; get one with universe::system<whippet::hierarchy<T>>()
+	/// ... the Ts are kept a level (depth) at a time, so, propagate() is a linear pass per level and parents are always done before their children
+	/// ... reparent() and erase() only move the nodes under the one that's changed; each by swapping the last of its level into its place
+	/// ... removing an entity doesn't take it out of here; erase() it first
+	/// ... inserting (or moving) nodes can move the Ts; references from get() are only good until then
+	template<typename T>
+	struct hierarchy : _system
+	{
+		/// not defaulted; universe::system() value-initialises, which would zero what it's already set up in _system
+		hierarchy(void) {}
+
+		/// adds `child` (which mustn't be here already) under `parent`; or as a root if `parent` is the null entity
+		template<typename ...ARGS>
+		T& insert(entity child, entity parent, ARGS&&... args)
+		{
+			const uint32_t guid = child.guid()._weak;
+			const uint32_t above = parent.guid()._weak;
+
+			assume(!contains(child), "the entity is already in the hierarchy");
+			assume(0 == above || contains(parent), "the parent isn't in the hierarchy");
+
+			if (_nodes.size() <= guid)
+				_nodes.resize(guid + 1);
+
+			link_(guid, above);
+			return place_(guid, 0 == above ? 0 : _nodes[above]._depth + 1, T(std::forward<ARGS>(args)...));
+		}
+
+		/// takes `node` out; along with everything under it
+		void erase(entity node)
+		{
+			assume(contains(node), "the entity isn't in the hierarchy");
+
+			const auto below = subtree_(node.guid()._weak);
+
+			// the deepest first; each is unlinked so that a node moved into a gap never looks for a child that's gone
+			for (auto it = below.rbegin(); it != below.rend(); ++it)
+			{
+				unlink_(*it);
+				take_(*it);
+				_nodes[*it] = node_t();
+			}
+
+			while (!_levels.empty() && _levels.back()._guid.empty())
+				_levels.pop_back();
+		}
+
+		/// moves `node` (and everything under it) to be under `parent`; or to be a root if `parent` is the null entity
+		/// ... if the depth doesn't change nothing moves; otherwise each node under it moves to its new level
+		void reparent(entity node, entity parent)
+		{
+			const uint32_t guid = node.guid()._weak;
+			const uint32_t above = parent.guid()._weak;
+
+			assume(contains(node), "the entity isn't in the hierarchy");
+			assume(0 == above || contains(parent), "the parent isn't in the hierarchy");
+
+			for (auto next = above; 0 != next; next = _nodes[next]._parent)
+				assume(guid != next, "a node can't be moved under itself");
+
+			unlink_(guid);
+			link_(guid, above);
+
+			const uint32_t depth = 0 == above ? 0 : _nodes[above]._depth + 1;
+			if (depth == _nodes[guid]._depth)
+			{
+				_levels[depth]._up[_nodes[guid]._at] = 0 == above ? 0 : _nodes[above]._at;
+				return;
+			}
+
+			// a level at a time; so, each node's parent is already where it's going when the node gets there
+			const int32_t shift = static_cast<int32_t>(depth) - static_cast<int32_t>(_nodes[guid]._depth);
+			for (const auto next : subtree_(guid))
+				place_(next, static_cast<uint32_t>(static_cast<int32_t>(_nodes[next]._depth) + shift), take_(next));
+
+			while (!_levels.empty() && _levels.back()._guid.empty())
+				_levels.pop_back();
+		}
+
+		bool contains(entity node) const
+		{
+			const uint32_t guid = node.guid()._weak;
+
+			return guid < _nodes.size() && node_t::NONE != _nodes[guid]._depth;
+		}
+
+		T& get(entity node)
+		{
+			assert(contains(node));
+
+			const auto& self = _nodes[node.guid()._weak];
+			return _levels[self._depth]._data[self._at];
+		}
+
+		/// the null entity for a root
+		entity parent(entity node)
+		{
+			assert(contains(node));
+			return entity(&world(), _nodes[node.guid()._weak]._parent);
+		}
+
+		/// 0 for a root
+		uint32_t depth(entity node) const
+		{
+			assert(contains(node));
+			return _nodes[node.guid()._weak]._depth;
+		}
+
+		size_t size(void) const
+		{
+			size_t count = 0;
+			for (const auto& level : _levels)
+				count += level._guid.size();
+			return count;
+		}
+
+		/// the nodes directly under `node` (in no particular order) until told to stop
+		template<typename U>
+		void children(entity node, U& userdata, bool(*callback)(U&, entity))
+		{
+			assert(contains(node));
+
+			for (auto next = _nodes[node.guid()._weak]._first; 0 != next; next = _nodes[next]._next)
+				if (!callback(userdata, entity(&world(), next)))
+					return;
+		}
+
+		/// every node; roots (with a null parent) first, then their children, then theirs ...
+		template<typename U>
+		void propagate(U& userdata, void(*callback)(U&, T& node, const T* parent))
+		{
+			pal__trace_span("whippet.propagate", typeid(T).name());
+
+			const T* above = nullptr;
+			for (auto& level : _levels)
+			{
+				T* data = level._data.data();
+				const uint32_t* up = level._up.data();
+				const size_t count = level._data.size();
+
+				for (size_t i = 0; i < count; ++i)
+					callback(userdata, data[i], nullptr == above ? nullptr : above + up[i]);
+
+				above = data;
+			}
+		}
+
+	private:
+		/// one depth's worth of nodes; the three are in step
+		struct level_t
+		{
+			std::vector<uint32_t> _guid;
+
+			/// where the parent is in the level above
+			std::vector<uint32_t> _up;
+
+			std::vector<T> _data;
+		};
+
+		/// where a guid is and who it's related to; guids are never 0, so, 0 is "nobody"
+		struct node_t
+		{
+			static const uint32_t NONE = ~0u;
+
+			uint32_t _depth = NONE;
+			uint32_t _at = 0;
+			uint32_t _parent = 0;
+
+			/// the children are a (doubly) linked list
+			uint32_t _first = 0;
+			uint32_t _next = 0;
+			uint32_t _prev = 0;
+		};
+
+		std::vector<level_t> _levels;
+
+		/// by guid
+		std::vector<node_t> _nodes;
+
+		void link_(const uint32_t guid, const uint32_t parent)
+		{
+			auto& self = _nodes[guid];
+
+			self._parent = parent;
+			self._prev = 0;
+			self._next = 0;
+
+			if (0 == parent)
+				return;
+
+			self._next = _nodes[parent]._first;
+			if (0 != self._next)
+				_nodes[self._next]._prev = guid;
+			_nodes[parent]._first = guid;
+		}
+
+		void unlink_(const uint32_t guid)
+		{
+			auto& self = _nodes[guid];
+
+			if (0 != self._prev)
+				_nodes[self._prev]._next = self._next;
+			else if (0 != self._parent)
+				_nodes[self._parent]._first = self._next;
+
+			if (0 != self._next)
+				_nodes[self._next]._prev = self._prev;
+
+			self._parent = 0;
+			self._prev = 0;
+			self._next = 0;
+		}
+
+		/// `guid` and everything under it; a level at a time
+		std::vector<uint32_t> subtree_(const uint32_t guid) const
+		{
+			std::vector<uint32_t> found(1, guid);
+
+			for (size_t i = 0; i < found.size(); ++i)
+				for (auto next = _nodes[found[i]]._first; 0 != next; next = _nodes[next]._next)
+					found.push_back(next);
+
+			return found;
+		}
+
+		/// appends to a level; the parent (if there is one) needs to be where it's staying
+		T& place_(const uint32_t guid, const uint32_t depth, T&& data)
+		{
+			if (_levels.size() <= depth)
+				_levels.resize(depth + 1);
+
+			auto& level = _levels[depth];
+			auto& self = _nodes[guid];
+
+			self._depth = depth;
+			self._at = static_cast<uint32_t>(level._guid.size());
+
+			level._guid.push_back(guid);
+			level._up.push_back(0 == self._parent ? 0 : _nodes[self._parent]._at);
+			level._data.push_back(std::move(data));
+
+			return level._data.back();
+		}
+
+		/// pulls a node out of its level and moves the last one of the level into its place
+		T take_(const uint32_t guid)
+		{
+			auto& level = _levels[_nodes[guid]._depth];
+			const uint32_t at = _nodes[guid]._at;
+			const uint32_t last = static_cast<uint32_t>(level._guid.size() - 1);
+
+			T data = std::move(level._data[at]);
+
+			if (at != last)
+			{
+				const uint32_t moved = level._guid[last];
+
+				level._guid[at] = moved;
+				level._up[at] = level._up[last];
+				level._data[at] = std::move(level._data[last]);
+				_nodes[moved]._at = at;
+
+				// the moved node's children need to know where it went
+				// ... the one being taken might be one of them (when a reparent moves a node down into its child's level) and it's already gone from here
+				for (auto next = _nodes[moved]._first; 0 != next; next = _nodes[next]._next)
+					if (guid != next)
+						_levels[_nodes[next]._depth]._up[_nodes[next]._at] = at;
+			}
+
+			level._guid.pop_back();
+			level._up.pop_back();
+			level._data.pop_back();
+
+			return data;
+		}
+	};
+}
@@ -22,6 +22,25 @@
 // ... the utility routines are done entirely in user-land so there's no reason that *you* couldn't do them by hand, but, they're used by the unit tests to achieve full coverage
 #define whippet__porcelain
 
+// ifdef; counters (and timers) on the hot paths are collected and can be read back with universe::stats()
+// ... off by default; when it's off the counters aren't even there
+// #define whippet__stats
+
+#ifdef whippet__stats
+#	define hanoi__stats
+#	define whippet__count(...) __VA_ARGS__
+#else
+#	define whippet__count(...)
+#endif
+
+// ifdef; whippet::name keeps its text so that lookups can tell apart two names with the same adler sum
+// ... always on in debug builds; otherwise the sum alone is taken as the name (and short names share sums more often than you'd think)
+// #define whippet__names_compare
+
+#if defined(_DEBUG) && !defined(whippet__names_compare)
+#	define whippet__names_compare
+#endif
+
 // this provides a pretty "assume()" macro that you may not care about
 #include <pal.hpp>
 
@@ -31,24 +50,96 @@
 #include <assert.h>
 #include <stdint.h>
 
+#include <chrono>
 #include <functional>
+#include <istream>
 #include <list>
 #include <map>
 #include <memory>
+#include <ostream>
 #include <set>
 #include <string>
 #include <typeindex>
+#include <type_traits>
+#include <vector>
 
 namespace whippet
 {
 	typedef pal::strong<uint32_t> guid_t;
 
+	/// the owning entity's guid and a component's own guid, packed together into 64 bits
+	/// ... the universe and provider aren't stored; they're found from the storage block that the component lives in
+	struct handle_t
+	{
+		guid_t _entity;
+		guid_t _self;
+	};
+	static_assert(sizeof(handle_t) == sizeof(uint64_t), "the handle should pack into 64 bits");
+
 	struct entity;
 	struct _component;
 	struct _provider;
 	struct universe;
 	struct _system;
 
+	template<typename ...Cs>
+	struct static_universe;
+
+	/// a snapshot of the hot-path counters
+	/// ... everything is zero (and _enabled is false) unless whippet__stats was defined
+	struct stats
+	{
+		bool _enabled;
+
+		/// guid_activate() / guid_release()
+		struct guids_t
+		{
+			uint64_t _activated;
+
+			/// candidates looked at before a free guid was found
+			uint64_t _probes;
+			uint64_t _released;
+			uint64_t _nanoseconds;
+		} _guids;
+
+		/// one per installed component type
+		struct provider_t
+		{
+			std::string _name;
+
+			uint64_t _emplaced;
+
+			/// free-slot scan lengths (and full layers skipped) when emplacing
+			uint64_t _scanned;
+			uint64_t _skipped;
+
+			/// layers allocated, weeded, and still around
+			uint64_t _allocated;
+			uint64_t _weeded;
+			uint64_t _layers;
+
+			uint64_t _visits;
+
+			/// records looked at during visits (entity visits look at everything to find their own)
+			uint64_t _visit_scanned;
+			uint64_t _visit_callbacks;
+			uint64_t _visit_nanoseconds;
+
+			/// components detached (entity::remove() included)
+			uint64_t _detached;
+
+			/// records looked at by per-entity visits (entity::remove() finds what to detach with those, but, so does anything else that visits an entity)
+			uint64_t _entity_scanned;
+		};
+		std::vector<provider_t> _providers;
+
+		/// prints a human readable table
+		void print(std::ostream&) const;
+
+		/// writes the snapshot out as a JSON object
+		void json(std::ostream&) const;
+	};
+
 	/// entities are really just a GUID which take a pointer along for the ride
 	struct entity
 	{
@@ -57,6 +148,7 @@ namespace whippet
 		entity(void);
 		entity(universe*, const guid_t);
 
+		entity(const entity&) = default;
 		entity& operator=(const entity&);
 
 		template<typename C, typename ...ARGS>
@@ -86,8 +178,6 @@ namespace whippet
 		_component(const _component&) = delete;
 		_component& operator=(const _component&) = delete;
 
-		~_component(void);
-
 		universe& world(void) const;
 		entity owner(void) const;
 		guid_t guid(void) const;
@@ -96,6 +186,10 @@ namespace whippet
 		/// this is (by necesity) sort of a front-end for the actual removal logic
 		void detach(void);
 
+		/// call before changing a component through a reference that was kept from before universe::mark() or universe::fork()
+		/// ... visits (and attaching) do this for you
+		void touch(void);
+
 		/// casts or nulls
 		template<typename C>
 		C* as(void);
@@ -109,17 +203,117 @@ namespace whippet
 		_component(void);
 	private:
 		friend struct universe;
-		entity _owner;
-		guid_t _guid;
-		_provider* _manager;
+		template<typename ...Cs>
+		friend struct static_universe;
+		handle_t _handle;
+		_provider& manager(void) const;
 		bool inuse(void) const;
 	};
 
 
+	/// components with nothing in them beyond the header (and nothing to do when they're destroyed) are tags
+	/// ... tags are stored as one bit per entity, and, an entity has a tag or doesn't (attaching it again is a no-op)
+	/// ... the reference handed out for a tag is a stand-in that's only good until the next attach/visit of that type
+	/// ... a tag has no guid of its own; its guid() is the owning entity's
+	template<typename C>
+	struct is_tag : std::integral_constant<bool, sizeof(C) == sizeof(_component) && std::is_trivially_destructible<C>::value>
+	{
+	};
+
+	/// components that can be moved around with memcpy
+	/// ... _component can't be copied so std::is_trivially_copyable doesn't work; a trivial destructor is the tell instead
+	/// ... specialise this if a component has a trivial destructor but still can't be moved (say; it points into itself)
+	template<typename C>
+	struct is_blittable : std::integral_constant<bool, std::is_trivially_destructible<C>::value>
+	{
+	};
+
+	/// how a non-blittable component is written into (and read back from) a snapshot
+	/// ... blittable components are copied a storage block at a time and never come through here
+	/// ... specialise this (with enabled = true) for components that should survive universe::snapshot() / universe::restore()
+	/// ... components without it are left out of snapshots (and are gone after a restore)
+	template<typename C>
+	struct serial
+	{
+		static const bool enabled = false;
+
+		/// writes whatever load() needs; the owner is taken care of
+		static void save(std::ostream&, const C&) { assume(false, "serial<C> wasn't specialised"); }
+
+		/// reads back what save() wrote and attaches a new component to the owner
+		static void load(std::istream&, entity) { assume(false, "serial<C> wasn't specialised"); }
+	};
+
+	/// a name (or a label) that universe::named() finds through an index instead of a visit
+	/// ... install it like any other component; attaching and detaching keep the index up to date
+	/// ... an entity can have more than one, and, more than one entity can have the same one
+	struct name : _component
+	{
+		name(const char* text);
+
+		/// a name from just its sum (say; one that's been read back from somewhere)
+		/// ... there's no text to compare, so, lookups with the same sum always find it
+		explicit name(const pal::adler::sum key);
+
+		/// the universe's index points at this one (and each name erases itself from there when it goes); so, there are no copies
+		name(const name&) = delete;
+		name(name&&) = delete;
+		name& operator=(const name&) = delete;
+		name& operator=(name&&) = delete;
+
+		~name(void);
+
+		const pal::adler::sum _key;
+
+#ifdef whippet__names_compare
+		const std::string _text;
+#endif
+	};
+
+	/// names are written as their sum (and text, if it's kept)
+	template<>
+	struct serial<name>
+	{
+		static const bool enabled = true;
+
+		static void save(std::ostream&, const name&);
+		static void load(std::istream&, entity);
+	};
+
+	/// a contiguous run of live components from one storage block
+	/// ... only the first run in a block is sure to start on a cache line; after sort<C>() each block is (at most) one run
+	template<typename C>
+	struct column
+	{
+		column(C* data, const uint32_t size) : _data(data), _size(size) {}
+
+		C* begin(void) const { return _data; }
+		C* end(void) const { return _data + _size; }
+		uint32_t size(void) const { return _size; }
+
+		/// the end of the whole groups of `lanes` components
+		C* aligned_end(const uint32_t lanes) const { return _data + (_size - (_size % lanes)); }
+
+		/// which lanes of the last (partial) group are in use
+		uint64_t tail_mask(const uint32_t lanes) const
+		{
+			assert(0 < lanes && lanes <= 64);
+			return (uint64_t(1) << (_size % lanes)) - 1u;
+		}
+	private:
+		C* _data;
+		uint32_t _size;
+	};
+
 	struct _provider
 	{
 		typedef std::unique_ptr<_provider> ptr;
 
+		/// components find their way back to the universe through here
+		universe& _world;
+
+		_provider(universe& world) : _world(world) {}
+
 		// TODO; use function pointers here instead
 
 		virtual void* alloc(const entity&) = 0;
@@ -134,11 +328,98 @@ namespace whippet
 
 		virtual void weed(void) = 0;
 
+		/// reorders storage by a key (or the owning entity if the key is null)
+		virtual void sort(uint32_t(*key)(const void*)) = 0;
 
-#if _DEBUG
-		// this is *just* used to do an assertion on the cleanup of derrived classes
-		virtual ~_provider(void) {}
+		/// hands out contiguous runs of live components
+		virtual bool runs(void* userdata, bool(*callback)(void*, void*, uint32_t)) = 0;
+
+		/// how the components are written into a snapshot
+		enum class layout : uint32_t
+		{
+			/// not at all
+			none,
+
+			/// one bit per entity (tags)
+			bits,
+
+			/// raw storage blocks (blittable components)
+			blocks,
+
+			/// one at a time through whippet::serial<C>
+			serial,
+		};
+
+		/// what a snapshot records so that restore() can check that it'll fit
+		struct schema
+		{
+			/// pal::adler::sum of the type's name
+			uint32_t _hash;
+			uint32_t _size;
+			uint32_t _align;
+			layout _layout;
+		};
+
+		virtual schema describe(void) const = 0;
+
+		/// writes the components out if they're bits or serial; the universe writes the blocks
+		virtual void save(std::ostream&) = 0;
+
+		/// reads back what save() wrote into (empty) storage; false if the stream ran dry or didn't fit
+		virtual bool load(std::istream&) = 0;
+
+		/// hands out the storage blocks that have something live in them
+		virtual void blocks(void* userdata, void(*callback)(void*, const hanoi_block::header*)) = 0;
+
+		/// takes over a storage block (see hanoi::adopt) or returns false
+		virtual bool adopt(hanoi_block::header*) = 0;
+
+		/// starts (or restarts) keeping track of changes, or, stops (see universe::mark())
+		virtual void mark(const bool tracking) = 0;
+
+		/// puts what's tracked back the way it was at mark()
+		/// ... serial components are read back from what mark() wrote; the universe purges them (and puts the guids back) first
+		virtual void rollback(void) = 0;
+
+		/// writes what's changed since mark(); all of them, for serial components
+		virtual void delta(std::ostream&) = 0;
+
+		/// does what delta() wrote; false if the stream ran dry or didn't fit
+		/// ... with `check` it's only read through to see that it would work; nothing is changed
+		virtual bool apply(std::istream&, const bool check) = 0;
+
+		/// the component is about to be changed
+		virtual void touch(_component*) = 0;
+
+		/// the same sort of provider, for another universe, with copies of the blocks or bits (see universe::fork())
+		virtual ptr fork(universe& into) = 0;
+
+		/// what a prefab keeps of a component; its bytes (blocks), what serial<C>::save() wrote (serial) or nothing (bits)
+		virtual std::string capture(_component*) = 0;
+
+		/// gives each of the handles' entities a copy of what capture() returned
+		/// ... blittable components are copied into storage (with the handles' guids) in one pass; others are attached (or their bit is set) one at a time
+		virtual void spawn(const std::string& image, const handle_t* handles, const size_t count) = 0;
+
+		/// copy-on-write copies of storage blocks (see universe::fork())
+		static std::vector<hanoi_block::header*> fork_blocks(const std::vector<hanoi_block::header*>&);
+
+		/// writes the words which differ (and the new length) so that apply_words() can turn `was` into `now`
+		static void delta_words(std::ostream&, const std::vector<uint64_t>& now, const std::vector<uint64_t>& was);
+
+		static bool apply_words(std::istream&, std::vector<uint64_t>&);
+
+#ifdef whippet__stats
+		/// counters that the universe (rather than the provider) keeps
+		whippet::stats::provider_t _counters = {};
+
+		/// fills in the counters that come from storage
+		virtual void report(whippet::stats::provider_t&) = 0;
 #endif
+
+
+		// the derrived classes own the storage blocks so they need to be cleaned up properly
+		virtual ~_provider(void) {}
 	};
 
 	struct _system
@@ -161,6 +442,31 @@ namespace whippet
 		std::type_index _name;
 	};
 
+	/// an entity's components, kept so that universe::instantiate() can stamp out copies of them
+	/// ... blittable components are kept as bytes, tags as a bit, and components with whippet::serial<C> as what save() wrote
+	/// ... anything else can't be copied; a prefab of an entity with any of those isn't whole, and won't instantiate
+	/// ... it's kept by type; it can be instantiated into any universe with the same types installed
+	struct prefab
+	{
+		explicit prefab(entity);
+
+		/// false if the entity had a component that can't be copied
+		bool whole(void) const { return _whole; }
+
+	private:
+		friend struct universe;
+
+		struct part_t
+		{
+			std::type_index _kind;
+			_provider::layout _layout;
+			std::string _image;
+		};
+
+		std::vector<part_t> _parts;
+		bool _whole = true;
+	};
+
 	/// a manager holds EVERYTHING
 	struct universe
 	{
@@ -172,6 +478,8 @@ namespace whippet
 
 		entity create(void);
 
+		/// components are stored a 64KiB block at a time
+		/// ... so each one has to fit into a block (less a 64 byte header) and each type that's in use (tags aside) costs at least a block
 		template<typename T>
 		void install(void);
 
@@ -184,24 +492,141 @@ namespace whippet
 		template<typename T, typename C>
 		void visit(T&, bool(*)(T&, C&));
 
+		/// the entities with a whippet::name of `text`; from the index, so, the cost doesn't grow with the number of names
+		/// ... in no particular order, and, an entity with the same name twice is handed over twice
+		/// ... names mustn't be attached or detached by the callback
+		template<typename T>
+		void named(const char* text, T&, bool(*)(T&, entity));
+
+		/// `count` new entities, each with copies of the prefab's components
+		/// ... the guids are all handed out at once, and, blittable components are copied into their storage a run at a time
+		/// ... none (an empty vector) if the prefab isn't whole, or has a type that isn't installed here (or is stored differently)
+		std::vector<entity> instantiate(const prefab&, const size_t count);
+
+		/// one of the entities with a whippet::name of `text`; or the null entity (with a guid of 0) if there aren't any
+		entity named(const char* text);
+
+		/// reorders the storage of C (with a radix sort) so that visits go through memory in order
+		/// ... with no key, components are ordered by their owner's guid; ties keep their order
+		/// ... components are moved, so, any references to them are invalidated
+		template<typename C>
+		void sort(uint32_t(*key)(const C&) = nullptr);
+
+		/// iterate through C a contiguous run at a time (for batch/SIMD kernels)
+		/// ... tags have no storage, so, they have no columns
+		template<typename T, typename C>
+		void columns(T&, bool(*)(T&, column<C>&));
+
 		void weed(void);
+
+		/// writes the entities and components out so that restore() can put them back
+		/// ... blittable components are written a storage block at a time, tags as bits, and anything else through whippet::serial<C>
+		/// ... the bytes are only good for the same build on the same sort of machine
+		void snapshot(std::ostream&);
+
+		/// replaces the entities and components (but not the systems) with what snapshot() wrote
+		/// ... the same component types need to be installed; false (with nothing changed) if they aren't
+		/// ... false (with the universe emptied) if the stream runs dry part way through
+		bool restore(std::istream&);
+
+		/// restore() from a file, but, the blittable components' blocks are mapped in place rather than read
+		/// ... the mapping is private; pages are shared with the file until a component on them is changed, then copied
+		/// ... the blocks are only mappable if the snapshot was written from the start of the file; otherwise (or without mmap) they're read
+		bool map(const char* path);
+
+		/// starts (or restarts) keeping track of what changes from here; for rollback() and delta()
+		/// ... entities, tags and blittable components (a storage block at a time; copied the first time each is touched) are tracked
+		/// ... components with whippet::serial<C> are written out whole, here, to be read back by rollback()
+		/// ... components that aren't written at all aren't tracked (see rollback() and apply())
+		void mark(void);
+
+		/// puts everything back the way it was at mark()
+		/// ... save for components that aren't written at all; those attached since are detached, but, those detached since are gone
+		void rollback(void);
+
+		/// writes out what's changed since mark(); entities, tag bits, whole new blocks, the runs of changed bytes in touched ones, and all of the serial components
+		void delta(std::ostream&);
+
+		/// does what delta() wrote to a universe that's the way the other one was at its mark() (say; restored from a snapshot taken then)
+		/// ... the whole delta is read (and checked) before anything's changed; false (with nothing changed) if it doesn't fit or the stream runs dry
+		/// ... components here that aren't written at all are kept if their entity is still around (and nothing's taken their guid) otherwise they're detached
+		bool apply(std::istream&);
+
+		/// a new universe with the same entities and components (but no systems) that shares storage with this one until either changes it
+		/// ... blittable components' blocks are frozen (copied to a file; only if they've been touched since they last were) and mapped copy-on-write into the fork
+		/// ... so, the first fork copies every block, and later ones copy just what's been touched since
+		/// ... a component changed through a reference kept from before a fork must be touch()ed first, or later forks won't see it (debug builds assert this)
+		/// ... tags are copied, components with whippet::serial<C> are written and read back, and anything else is left behind
+		/// ... without memfd/mmap the blocks are just copied
+		std::unique_ptr<universe> fork(void);
+
+		/// snapshot of the hot-path counters (if whippet__stats is defined)
+		whippet::stats stats(void);
 	private:
 		friend struct _component;
 		friend struct entity;
-
-		std::set<guid_t> _guid_active;
+		friend struct name;
+		friend struct prefab;
+
+		/// where the whippet::name components are, by sum
+		/// ... open addressing (with linear probing) in a power-of-two table that's never more than half full
+		struct names_t
+		{
+			struct slot_t
+			{
+				uint32_t _key;
+				uint32_t _entity;
+
+				/// null for an empty slot
+				const whippet::name* _name;
+			};
+
+			std::vector<slot_t> _slots;
+			uint32_t _count = 0;
+			uint32_t _shift = 32;
+
+			size_t home(const uint32_t key) const;
+			void place(const slot_t&);
+			void insert(const whippet::name*);
+			void erase(const whippet::name*);
+		} _names;
+
+		/// one bit per active guid
+		std::vector<uint64_t> _guid_active;
+
+		/// how many of those bits are set
+		uint32_t _guid_count;
+
+		/// the guids (and count) as they were at mark()
+		std::vector<uint64_t> _guid_marked;
+		uint32_t _guid_marked_count;
+		bool _marked;
+
+#ifdef whippet__stats
+		whippet::stats::guids_t _guid_stats = {};
+#endif
 		pal::map<std::type_index, _provider::ptr> _providers;
 		struct _system* _systems;
 
 		/// activate the next guid and return it
 		guid_t guid_activate(void);
 
+		/// activate `count` guids at once
+		void guid_activate(uint32_t*, const size_t count);
+
 		/// release a guid that's no longer in use
 		void guid_release(guid_t);
 
 		// privates
+		void purge_(void);
+		bool restore_(std::istream&, const int file);
+		bool guid_active_(const uint32_t) const;
+		void guid_take_(const uint32_t);
+		void guid_keep_(const bool applied);
+		bool apply_(std::istream&, const bool check);
 		void visit_(const guid_t, const std::type_index, void*, bool(*)(void*, void*));
 		bool installed_(const std::type_index)const;
+		bool named_(const pal::adler::sum, const char*, void*, bool(*)(void*, entity));
 	};
 
 #ifdef whippet__porcelain
@@ -15,13 +15,15 @@
 #include "whippet.hpp"
 
 #include <array>
+#include <cstring>
+#include <sstream>
 
 template<typename C>
 inline
 C* whippet::_component::as(void)
 {
 	return reinterpret_cast<C*>(
-		_manager->as(
+		manager().as(
 			std::type_index(typeid(C)),
 			this));
 }
@@ -44,7 +46,7 @@ void whippet::entity::visit(T& userdata, bool(*callback)(T&, C&))
 	_world->visit_(
 		_guid, std::type_index(typeid(C)),
 		reinterpret_cast<void*>(&userdata),
-		reinterpret_cast<bool(*)(void*, void*)>(callback)
+		reinterpret_cast<bool(*)(void*, void*)>(reinterpret_cast<void(*)(void)>(callback))
 	);
 }
 
@@ -54,7 +56,7 @@ void whippet::entity::visit(T& userdata, bool(*callback)(T&, whippet::_component
 	_world->visit_(
 		_guid, std::type_index(typeid(whippet::_component)),
 		reinterpret_cast<void*>(&userdata),
-		reinterpret_cast<bool(*)(void*, void*)>(callback)
+		reinterpret_cast<bool(*)(void*, void*)>(reinterpret_cast<void(*)(void)>(callback))
 	);
 }
 
@@ -68,8 +70,14 @@ void whippet::universe::install(void)
 	if (installed_(kind))
 		return;
 
-	struct provider : whippet::_provider
+	// the bits that either sort of provider needs
+	struct typed : whippet::_provider
 	{
+		typed(whippet::universe& world) :
+			whippet::_provider(world)
+		{
+		}
+
 		bool is(const std::type_index id) override
 		{
 			if (std::type_index(typeid(int)) != std::type_index(typeid(const int)))
@@ -89,6 +97,247 @@ void whippet::universe::install(void)
 			return reinterpret_cast<void*>(static_cast<C*>(me));
 		}
 
+		whippet::_provider::schema described(const whippet::_provider::layout layout) const
+		{
+			return whippet::_provider::schema{
+				pal::adler::sum(typeid(C).name())._weak,
+				static_cast<uint32_t>(sizeof(C)),
+				static_cast<uint32_t>(alignof(C)),
+				layout,
+			};
+		}
+	};
+
+	// tags are stored as one bit per entity guid
+	struct flags : typed
+	{
+		/// one bit for each entity guid
+		std::vector<uint64_t> _bits;
+
+		/// tags don't have storage of their own so this stand-in is handed out (and re-pointed) as needed
+		/// ... it sits in a block like any other component so that it can find its way back here
+		C* _proxy;
+
+		flags(whippet::universe& world) :
+			typed(world)
+		{
+			const size_t offset = ((sizeof(hanoi_block::header) + alignof(C) - 1) / alignof(C)) * alignof(C);
+
+			auto block = new (hanoi_block::allocate(offset + sizeof(C))) hanoi_block::header();
+
+			block->_tag = static_cast<whippet::_provider*>(this);
+			block->_next = nullptr;
+			block->_size = 1;
+			block->_live = 0;
+			block->_free = 0;
+
+			_proxy = reinterpret_cast<C*>(reinterpret_cast<uint8_t*>(block) + offset);
+			point(0);
+		}
+
+		~flags(void)
+		{
+			hanoi_block::release(hanoi_block::of(_proxy));
+		}
+
+		/// aims the stand-in at an entity
+		C* point(const uint32_t entity_guid)
+		{
+			auto comp = static_cast<whippet::_component*>(_proxy);
+
+			// there's no guid of our own - so the entity's is used
+			comp->_handle._entity = entity_guid;
+			comp->_handle._self = entity_guid;
+
+			return _proxy;
+		}
+
+		bool tagged(const uint32_t entity_guid) const
+		{
+			const uint32_t word = entity_guid >> 6;
+
+			return word < _bits.size() && (_bits[word] & (uint64_t(1) << (entity_guid & 63)));
+		}
+
+		/// sets the bit and hands out the stand-in
+		/// ... attaching a tag twice leaves the entity with one
+		void* alloc(const whippet::entity& owner) override
+		{
+			const uint32_t guid = owner._guid._weak;
+			const uint32_t word = guid >> 6;
+
+			if (_bits.size() <= word)
+				_bits.resize(word + 1, 0);
+
+			_bits[word] |= uint64_t(1) << (guid & 63);
+
+			return reinterpret_cast<void*>(point(guid));
+		}
+
+		void detach(whippet::_component* self) override
+		{
+			const uint32_t guid = self->_handle._entity._weak;
+
+			assert(tagged(guid) && "Coudn't find component - was it already detached?");
+
+			_bits[guid >> 6] &= ~(uint64_t(1) << (guid & 63));
+		}
+
+		void purge(void) override
+		{
+			_bits.clear();
+		}
+
+		bool visit(const whippet::guid_t entity_guid, const bool cast_to_kind, void* userdata, bool(*callback)(void*, void*)) override
+		{
+			if (entity_guid != 0)
+			{
+				whippet__count(++this->_counters._visit_scanned);
+				whippet__count(++this->_counters._entity_scanned);
+
+				if (!tagged(entity_guid._weak))
+					return true;
+
+				auto proxy = point(entity_guid._weak);
+				whippet__count(++this->_counters._visit_callbacks);
+				return callback(userdata, cast_to_kind ? proxy : static_cast<whippet::_component*>(proxy));
+			}
+
+			// scan the words; skip the empty ones
+			for (size_t word = 0; word < _bits.size(); ++word)
+				for (auto bits = _bits[word]; bits; bits &= bits - 1)
+				{
+					auto proxy = point(static_cast<uint32_t>((word << 6) | pal::lowest_bit(bits)));
+
+					whippet__count(++this->_counters._visit_scanned);
+					whippet__count(++this->_counters._visit_callbacks);
+					if (!callback(userdata, cast_to_kind ? proxy : static_cast<whippet::_component*>(proxy)))
+						return false;
+				}
+
+			return true;
+		}
+
+		void weed(void) override
+		{
+			while (!_bits.empty() && !_bits.back())
+				_bits.pop_back();
+		}
+
+		/// bits are always in entity order; there's nothing else to sort by
+		void sort(uint32_t(*key)(const void*)) override
+		{
+			(void)key;
+			assume(nullptr == key, "tags can't be sorted by a key");
+		}
+
+		bool runs(void*, bool(*)(void*, void*, uint32_t)) override
+		{
+			assume(false, "tags don't have columns");
+			return true;
+		}
+
+		whippet::_provider::schema describe(void) const override
+		{
+			return this->described(whippet::_provider::layout::bits);
+		}
+
+		void save(std::ostream& out) override
+		{
+			const uint64_t words = _bits.size();
+
+			out.write(reinterpret_cast<const char*>(&words), sizeof(words));
+			out.write(reinterpret_cast<const char*>(_bits.data()), sizeof(uint64_t) * words);
+		}
+
+		bool load(std::istream& in) override
+		{
+			uint64_t words;
+			if (!in.read(reinterpret_cast<char*>(&words), sizeof(words)))
+				return false;
+
+			_bits.resize(words);
+			return !!in.read(reinterpret_cast<char*>(_bits.data()), sizeof(uint64_t) * words);
+		}
+
+		void blocks(void*, void(*)(void*, const hanoi_block::header*)) override
+		{
+		}
+
+		bool adopt(hanoi_block::header*) override
+		{
+			return false;
+		}
+
+		/// the bits as they were at mark()
+		std::vector<uint64_t> _marked;
+
+		void mark(const bool tracking) override
+		{
+			if (tracking)
+				_marked = _bits;
+			else
+				_marked.clear();
+		}
+
+		void rollback(void) override
+		{
+			_bits = _marked;
+		}
+
+		void delta(std::ostream& out) override
+		{
+			this->delta_words(out, _bits, _marked);
+		}
+
+		bool apply(std::istream& in, const bool check) override
+		{
+			if (!check)
+				return this->apply_words(in, _bits);
+
+			auto bits = _bits;
+			return this->apply_words(in, bits);
+		}
+
+		void touch(whippet::_component*) override
+		{
+		}
+
+		whippet::_provider::ptr fork(whippet::universe& into) override
+		{
+			auto copy = std::make_unique<flags>(into);
+			copy->_bits = _bits;
+			return copy;
+		}
+
+		std::string capture(whippet::_component*) override
+		{
+			return std::string();
+		}
+
+		void spawn(const std::string&, const whippet::handle_t* handles, const size_t count) override
+		{
+			for (size_t i = 0; i < count; ++i)
+				alloc(whippet::entity(&(this->_world), handles[i]._entity));
+		}
+
+#ifdef whippet__stats
+		void report(whippet::stats::provider_t&) override
+		{
+			// no storage; nothing to report
+		}
+#endif
+	};
+
+	// everything else is stored in records
+	struct provider : typed
+	{
+		provider(whippet::universe& world) :
+			typed(world),
+			_storage(static_cast<whippet::_provider*>(this))
+		{
+		}
+
 		// need this to handler pre-init
 		struct record
 		{
@@ -97,7 +346,7 @@ void whippet::universe::install(void)
 
 			record& operator=(const record&) = delete;
 
-			uint8_t _data[sizeof(C)];
+			alignas(C) uint8_t _data[sizeof(C)];
 
 			C* get_T(void) { return reinterpret_cast<C*>(_data); }
 
@@ -117,20 +366,27 @@ void whippet::universe::install(void)
 
 				assert(0 != g._weak);
 
-				// pre-new the base component
-				comp->_owner = e;
-				comp->_guid = g;
-				comp->_manager = e.world()._providers[std::type_index(typeid(C))].get();
+				// pre-new the base component; the world and provider come from the block we're in
+				comp->_handle._entity = e._guid;
+				comp->_handle._self = g;
 
 				// hackery; please excuse
-				assert(e._guid == comp->_owner._guid);
-				assert(e._world == comp->_owner._world);
-				assert(g == comp->_guid);
+				assert(e._guid == comp->owner()._guid);
+				assert(e._world == comp->owner()._world);
+				assert(g == comp->guid());
 			}
 
 			~record(void)
 			{
+				auto& world = get_c()->world();
+				const auto guid = get_c()->guid();
+
 				get_T()->~C();
+
+				// the component's destructor is trivial so the guid is released here
+				world.guid_release(guid);
+				clean(this);
+
 				assert((!inuse()) && "Needs to be fresh before we can clean");
 			}
 
@@ -141,18 +397,21 @@ void whippet::universe::install(void)
 
 			static void clean(record* r)
 			{
-				r->get_c()->_guid = 0;
+				r->get_c()->_handle._self = 0;
 			}
 		};
 
 		hanoi<record> _storage;
 
-		provider(void) { }
+		/// the guid that load() is reading back a component with; the first one attached takes it
+		whippet::guid_t _loading = 0;
 
 		/// returns a pointer to a new instance of the derived-class for in-place allocation
 		void* alloc(const whippet::entity& owner) override
 		{
-			auto& emplaced = _storage.emplace_unspecified(owner, owner.world().guid_activate());
+			const auto guid = (0 != _loading._weak) ? std::exchange(_loading, 0) : owner.world().guid_activate();
+
+			auto& emplaced = _storage.emplace_unspecified(owner, guid);
 			auto pointer = emplaced.get_T();
 			return reinterpret_cast<void*>(pointer);
 		}
@@ -160,40 +419,299 @@ void whippet::universe::install(void)
 		/// destroys an instance
 		void detach(whippet::_component* self) override
 		{
-			for (auto it = _storage.begin(); it != _storage.end(); ++it)
-				if (it->get_c() == self)
-				{
-					_storage.erase(it);
-					return;
-				}
+			assert(self->inuse() && "Coudn't find component - was it already detached?");
 
-			assert(false && "Coudn't find component - was it already detached?");
+			// the record starts where the component's concrete type does
+			_storage.erase(*reinterpret_cast<record*>(static_cast<C*>(self)));
 		}
 
 		void purge(void) override
 		{
-			while (!_storage.empty())
+			// erasing doesn't move anything, so, one pass is enough
+			for (auto it = _storage.begin(); it != _storage.end(); ++it)
 			{
-				auto& head = *(_storage.begin());
-				auto comp = head.get_c();
+				auto comp = it->get_c();
 
-				assert(this == comp->_manager);
+				assert(this == &(comp->manager()));
 				comp->detach();
 			}
+
+			assert(_storage.empty());
 		}
 
 		bool visit(const whippet::guid_t entity_guid, const bool cast_to_kind, void* userdata, bool(*callback)(void*, void*)) override
 		{
+			// the callbacks can change anything that they're handed; so, each block is touched as the first thing in it is handed out
+			hanoi_block::header* touched = nullptr;
+
 			for (auto& storage : _storage)
-				if ((entity_guid == 0) || ((entity_guid != 0) && (storage.get_c()->_owner._guid == entity_guid)))
+			{
+				whippet__count(++this->_counters._visit_scanned);
+				whippet__count(if (entity_guid != 0) ++this->_counters._entity_scanned);
+
+				if ((entity_guid == 0) || ((entity_guid != 0) && (storage.get_c()->_handle._entity == entity_guid)))
+				{
+					if (hanoi_block::of(&storage) != touched)
+					{
+						touched = hanoi_block::of(&storage);
+						_storage.touch(touched);
+					}
+
+					whippet__count(++this->_counters._visit_callbacks);
 					if (!callback(userdata, cast_to_kind ? storage.get_T() : storage.get_c()))
 						return false;
+				}
+			}
 
 			return true;
 		}
 
 		void weed(void) override { _storage.weed(); }
 
+		void sort(uint32_t(*key)(const void*)) override
+		{
+			if (nullptr == key)
+				_storage.sort([](const record& r) { return r.see_c()->_handle._entity._weak; });
+			else
+				_storage.sort([key](const record& r) { return key(r.get_T()); });
+		}
+
+		bool runs(void* userdata, bool(*callback)(void*, void*, uint32_t)) override
+		{
+			static_assert(sizeof(record) == sizeof(C), "records need to line up with the components in them");
+
+			return _storage.runs([userdata, callback](record* data, const uint32_t size)
+			{
+				return callback(userdata, data->get_T(), size);
+			});
+		}
+
+		static whippet::_provider::layout stored(void)
+		{
+			if (whippet::is_blittable<C>::value)
+				return whippet::_provider::layout::blocks;
+
+			return whippet::serial<C>::enabled ? whippet::_provider::layout::serial : whippet::_provider::layout::none;
+		}
+
+		whippet::_provider::schema describe(void) const override
+		{
+			return this->described(stored());
+		}
+
+		void save(std::ostream& out) override
+		{
+			if (whippet::_provider::layout::serial != stored())
+				return;
+
+			uint64_t count = 0;
+			for (auto it = _storage.begin(); it != _storage.end(); ++it)
+				++count;
+
+			out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+			for (auto& next : _storage)
+			{
+				out.write(reinterpret_cast<const char*>(&(next.get_c()->_handle)), sizeof(whippet::handle_t));
+				whippet::serial<C>::save(out, *next.get_T());
+			}
+		}
+
+		bool load(std::istream& in) override
+		{
+			assert(_storage.empty());
+
+			if (whippet::_provider::layout::serial != stored())
+				return true;
+
+			uint64_t count;
+			if (!in.read(reinterpret_cast<char*>(&count), sizeof(count)))
+				return false;
+
+			for (uint64_t i = 0; i < count; ++i)
+			{
+				whippet::handle_t handle = { 0, 0 };
+				if (!in.read(reinterpret_cast<char*>(&handle), sizeof(handle)))
+					return false;
+
+				// the (first) component that's attached keeps the guid that it was saved with; if there isn't one, the guid is given back
+				_loading = handle._self;
+				whippet::serial<C>::load(in, whippet::entity(&(this->_world), handle._entity));
+
+				if (0 != _loading._weak)
+				{
+					this->_world.guid_release(_loading);
+					_loading = 0;
+				}
+
+				if (!in)
+					return false;
+			}
+
+			return true;
+		}
+
+		void blocks(void* userdata, void(*callback)(void*, const hanoi_block::header*)) override
+		{
+			_storage.blocks([userdata, callback](const hanoi_block::header* block)
+			{
+				callback(userdata, block);
+			});
+		}
+
+		bool adopt(hanoi_block::header* block) override
+		{
+			return whippet::_provider::layout::blocks == stored() && _storage.adopt(block);
+		}
+
+		/// serial components as they were at mark(); what save() wrote
+		std::string _marked;
+
+		void mark(const bool tracking) override
+		{
+			if (whippet::_provider::layout::blocks == stored())
+				_storage.track(tracking);
+
+			_marked.clear();
+			if (tracking && whippet::_provider::layout::serial == stored())
+			{
+				std::stringstream out;
+				save(out);
+				_marked = out.str();
+			}
+		}
+
+		void rollback(void) override
+		{
+			if (whippet::_provider::layout::blocks == stored())
+				_storage.rollback();
+
+			if (whippet::_provider::layout::serial == stored())
+			{
+				std::stringstream in(_marked);
+				require(load(in), "serial<C>::load() didn't read back what serial<C>::save() wrote at mark()");
+			}
+		}
+
+		/// serial components are written whole (with their length; so that apply() can check them without reading them back)
+		void delta(std::ostream& out) override
+		{
+			if (whippet::_provider::layout::blocks == stored())
+				_storage.delta([&out](const void* data, const size_t size)
+				{
+					out.write(reinterpret_cast<const char*>(data), size);
+				});
+
+			if (whippet::_provider::layout::serial == stored())
+			{
+				std::stringstream buffer;
+				save(buffer);
+
+				const auto text = buffer.str();
+				const uint64_t size = text.size();
+				out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+				out.write(text.data(), text.size());
+			}
+		}
+
+		bool apply(std::istream& in, const bool check) override
+		{
+			if (whippet::_provider::layout::blocks == stored())
+				return _storage.apply([&in](void* data, const size_t size)
+				{
+					return !!in.read(reinterpret_cast<char*>(data), size);
+				}, check);
+
+			if (whippet::_provider::layout::serial != stored())
+				return true;
+
+			uint64_t size;
+			if (!in.read(reinterpret_cast<char*>(&size), sizeof(size)))
+				return false;
+
+			std::string text(size, ' ');
+			if (!in.read(&text[0], size))
+				return false;
+
+			if (check)
+				return true;
+
+			std::stringstream buffer(text);
+			return load(buffer);
+		}
+
+		void touch(whippet::_component* self) override
+		{
+			_storage.touch(hanoi_block::of(static_cast<C*>(self)));
+		}
+
+		whippet::_provider::ptr fork(whippet::universe& into) override
+		{
+			auto copy = std::make_unique<provider>(into);
+
+			// serial components are attached (by the universe) once all of the providers are there
+			if (whippet::_provider::layout::blocks == stored())
+				copy->_storage.copy(_storage, whippet::_provider::fork_blocks);
+
+			return copy;
+		}
+
+		std::string capture(whippet::_component* self) override
+		{
+			switch (stored())
+			{
+			case whippet::_provider::layout::blocks:
+				return std::string(reinterpret_cast<const char*>(static_cast<C*>(self)), sizeof(C));
+
+			case whippet::_provider::layout::serial:
+			{
+				std::ostringstream out;
+				whippet::serial<C>::save(out, *static_cast<C*>(self));
+				return out.str();
+			}
+
+			default:
+				// the prefab doesn't ask; it isn't whole without these
+				assume(false, "only blittable components (or ones with whippet::serial<C>) can be put in a prefab");
+				return std::string();
+			}
+		}
+
+		void spawn(const std::string& image, const whippet::handle_t* handles, const size_t count) override
+		{
+			if (whippet::_provider::layout::blocks != stored())
+			{
+				for (size_t i = 0; i < count; ++i)
+				{
+					std::istringstream in(image);
+					whippet::serial<C>::load(in, whippet::entity(&(this->_world), handles[i]._entity));
+				}
+				return;
+			}
+
+			assert(sizeof(C) == image.size());
+
+			// the bytes (header and all) then the header that this copy should have
+			_storage.emplace_many(count, [&image, handles](record* place, const size_t i)
+			{
+				std::memcpy(static_cast<void*>(place), image.data(), sizeof(C));
+				static_cast<whippet::_component*>(place->get_T())->_handle = handles[i];
+			});
+		}
+
+#ifdef whippet__stats
+		void report(whippet::stats::provider_t& counters) override
+		{
+			auto& storage = _storage.stats();
+
+			counters._emplaced = storage._emplaced;
+			counters._scanned = storage._scanned;
+			counters._skipped = storage._skipped;
+			counters._allocated = storage._allocated;
+			counters._weeded = storage._weeded;
+			counters._layers = _storage.layers();
+		}
+#endif
+
 #if _DEBUG
 		virtual ~provider(void) override
 		{
@@ -203,7 +721,10 @@ void whippet::universe::install(void)
 #endif
 	};
 
-	_providers[kind] = std::make_unique<provider>();
+	if (whippet::is_tag<C>::value)
+		_providers[kind] = std::make_unique<flags>(*this);
+	else
+		_providers[kind] = std::make_unique<provider>(*this);
 }
 
 template<typename T>
@@ -254,10 +775,61 @@ void whippet::universe::visit(T& userdata, bool(*callback)(T&, C&))
 	visit_(
 		0, std::type_index(typeid(C)),
 		reinterpret_cast<void*>(&userdata),
-		reinterpret_cast<bool(*)(void*, void*)>(callback)
+		reinterpret_cast<bool(*)(void*, void*)>(reinterpret_cast<void(*)(void)>(callback))
+	);
+}
+
+template<typename T>
+void whippet::universe::named(const char* text, T& userdata, bool(*callback)(T&, whippet::entity))
+{
+	named_(
+		pal::adler::sum(text), text,
+		reinterpret_cast<void*>(&userdata),
+		reinterpret_cast<bool(*)(void*, whippet::entity)>(reinterpret_cast<void(*)(void)>(callback))
+	);
+}
+
+template<typename C>
+void whippet::universe::sort(uint32_t(*key)(const C&))
+{
+	static_assert(whippet::is_blittable<C>::value, "sorting moves components with memcpy");
+
+	assert(installed<C>());
+
+	pal__trace_span("whippet.sort", typeid(C).name());
+
+	_providers[std::type_index(typeid(C))]->sort(
+		reinterpret_cast<uint32_t(*)(const void*)>(reinterpret_cast<void(*)(void)>(key))
 	);
 }
 
+template<typename T, typename C>
+void whippet::universe::columns(T& userdata, bool(*callback)(T&, whippet::column<C>&))
+{
+	assert(installed<C>());
+
+	pal__trace_span("whippet.columns", typeid(C).name());
+
+	struct context
+	{
+		T& _userdata;
+		bool(*_callback)(T&, whippet::column<C>&);
+	};
+
+	context self = {
+		userdata,
+		callback,
+	};
+
+	_providers[std::type_index(typeid(C))]->runs(&self, [](void* self, void* data, uint32_t size)
+	{
+		auto& outer = *reinterpret_cast<context*>(self);
+
+		whippet::column<C> run(reinterpret_cast<C*>(data), size);
+		return outer._callback(outer._userdata, run);
+	});
+}
+
 #ifdef whippet__porcelain
 
 template<typename C>
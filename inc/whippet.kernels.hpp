@@ -0,0 +1,127 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+///
+/// sample batch kernels for universe::columns()
+/// ... each one integrates position by velocity over a column of `motion` components
+/// ... whichever instruction sets the compiler was told about are available
+///
+
+#pragma once
+
+#include "whippet.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64)
+#	define whippet__kernels_sse
+#	include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__) && defined(__FMA__)
+#	define whippet__kernels_avx2
+#	include <immintrin.h>
+#endif
+
+#if defined(__has_include)
+#	if __has_include(<experimental/simd>)
+#		define whippet__kernels_simd
+#		include <experimental/simd>
+#	endif
+#endif
+
+namespace whippet
+{
+	namespace kernels
+	{
+		/// a sample component laid out for SIMD
+		/// ... xyz and a spare (zero) lane each, 16-byte aligned
+		struct motion : whippet::_component
+		{
+			alignas(16) float _position[4];
+			alignas(16) float _velocity[4];
+
+			motion(float px, float py, float pz, float vx, float vy, float vz) :
+				_position{ px, py, pz, 0 },
+				_velocity{ vx, vy, vz, 0 }
+			{
+			}
+		};
+
+		/// one component at a time; the reference
+		inline void integrate_scalar(const whippet::column<motion>& column, const float dt)
+		{
+			for (auto& next : column)
+				for (int i = 0; i < 3; ++i)
+					next._position[i] += next._velocity[i] * dt;
+		}
+
+#ifdef whippet__kernels_sse
+		/// one component per instruction
+		inline void integrate_sse(const whippet::column<motion>& column, const float dt)
+		{
+			const auto step = _mm_set1_ps(dt);
+
+			for (auto& next : column)
+			{
+				const auto position = _mm_load_ps(next._position);
+				const auto velocity = _mm_load_ps(next._velocity);
+
+				_mm_store_ps(next._position, _mm_add_ps(position, _mm_mul_ps(velocity, step)));
+			}
+		}
+#endif
+
+#ifdef whippet__kernels_avx2
+		/// two components per instruction, then, the tail (if there is one) by itself
+		inline void integrate_avx2(const whippet::column<motion>& column, const float dt)
+		{
+			const auto step = _mm256_set1_ps(dt);
+
+			auto next = column.begin();
+			for (auto end = column.aligned_end(2); next != end; next += 2)
+			{
+				const auto position = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(next[0]._position)), _mm_load_ps(next[1]._position), 1);
+				const auto velocity = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_load_ps(next[0]._velocity)), _mm_load_ps(next[1]._velocity), 1);
+
+				const auto result = _mm256_fmadd_ps(velocity, step, position);
+
+				_mm_store_ps(next[0]._position, _mm256_castps256_ps128(result));
+				_mm_store_ps(next[1]._position, _mm256_extractf128_ps(result, 1));
+			}
+
+			if (column.tail_mask(2))
+			{
+				const auto position = _mm_load_ps(next->_position);
+				const auto velocity = _mm_load_ps(next->_velocity);
+
+				_mm_store_ps(next->_position, _mm_fmadd_ps(velocity, _mm256_castps256_ps128(step), position));
+			}
+		}
+#endif
+
+#ifdef whippet__kernels_simd
+		/// portable; whatever the compiler makes of std::experimental::simd
+		inline void integrate_simd(const whippet::column<motion>& column, const float dt)
+		{
+			typedef std::experimental::fixed_size_simd<float, 4> float4;
+
+			for (auto& next : column)
+			{
+				float4 position(next._position, std::experimental::vector_aligned);
+				const float4 velocity(next._velocity, std::experimental::vector_aligned);
+
+				position += velocity * dt;
+				position.copy_to(next._position, std::experimental::vector_aligned);
+			}
+		}
+#endif
+	}
+}
@@ -0,0 +1,236 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+
+#pragma once
+
+#include "whippet.hpp"
+
+#include <tuple>
+#include <utility>
+
+namespace whippet
+{
+	/// a universe with all of its component types listed up front
+	/// ... each type's storage is a member (of a tuple) so there's no map, no vtable and no std::type_index between a call and the components
+	/// ... entity::attach, entity::visit and visit look the same as they do on whippet::universe, so, code templated on the universe works with either
+	/// ... components don't get guids of their own (guid() is the owner's) and their world(), owner() and detach() only work in a whippet::universe; detach through here instead
+	/// ... tags and whippet::name need a whippet::universe
+	template<typename ...Cs>
+	struct static_universe
+	{
+		static_universe(const static_universe&) = delete;
+		static_universe& operator=(const static_universe&) = delete;
+
+		static_universe(void) : _guid_count(0) {}
+
+		struct entity
+		{
+			entity(void) : _world(nullptr), _guid(0) {}
+			entity(static_universe* world, const guid_t guid) : _world(world), _guid(guid) {}
+
+			guid_t guid(void) const { return _guid; }
+
+			static_universe& world(void) const
+			{
+				assert(nullptr != _world);
+				return *_world;
+			}
+
+			template<typename C, typename ...ARGS>
+			C& attach(ARGS&&... args)
+			{
+				auto& record = _world->template storage_<C>().emplace_unspecified(_guid);
+				return *new (record.get()) C(std::forward<ARGS>(args)...);
+			}
+
+			template<typename T, typename C>
+			void visit(T& userdata, bool(*callback)(T&, C&))
+			{
+				_world->scan_(_guid, userdata, callback);
+			}
+
+			/// detaches everything and releases the guid
+			void remove(void)
+			{
+				_world->remove_(_guid);
+			}
+
+		private:
+			static_universe* _world;
+			guid_t _guid;
+		};
+
+		entity create(void)
+		{
+			uint32_t next = 1 + _guid_count;
+			while (guid_active_(next))
+				--next;
+
+			assert(0 != next);
+
+			if (_guid_active.size() <= (next >> 6))
+				_guid_active.resize((next >> 6) + 1, 0);
+
+			_guid_active[next >> 6] |= uint64_t(1) << (next & 63);
+			++_guid_count;
+
+			return entity(this, next);
+		}
+
+		/// there's nothing to do; it's here so that code written for whippet::universe still compiles
+		template<typename C>
+		void install(void)
+		{
+			static_assert(installed<C>(), "C isn't one of this static_universe's components");
+		}
+
+		template<typename C>
+		static constexpr bool installed(void)
+		{
+			return (std::is_same<C, Cs>::value || ...);
+		}
+
+		template<typename T, typename C>
+		void visit(T& userdata, bool(*callback)(T&, C&))
+		{
+			scan_(0, userdata, callback);
+		}
+
+		/// iterate through C a contiguous run at a time (as whippet::universe::columns() does)
+		template<typename T, typename C>
+		void columns(T& userdata, bool(*callback)(T&, column<C>&))
+		{
+			storage_<C>().runs([&userdata, callback](record<C>* data, const uint32_t size)
+			{
+				column<C> run(data->get(), size);
+				return callback(userdata, run);
+			});
+		}
+
+		/// takes the component off of its owner (in place of _component::detach())
+		template<typename C>
+		void detach(C& component)
+		{
+			storage_<C>().erase(*reinterpret_cast<record<C>*>(&component));
+		}
+
+		/// releases the storage blocks that have nothing left in them
+		void weed(void)
+		{
+			(storage_<Cs>().weed(), ...);
+		}
+
+	private:
+		/// a component and the bits that hanoi needs to know if it's there
+		template<typename C>
+		struct record
+		{
+			static_assert(std::is_base_of<_component, C>::value, "components need to derive from whippet::_component");
+			static_assert(!is_tag<C>::value, "tags are stored as bits; they need a whippet::universe");
+			static_assert(!std::is_same<C, whippet::name>::value, "names are indexed by their world(); they need a whippet::universe");
+
+			record(void) = delete;
+			record(const record&) = delete;
+			record& operator=(const record&) = delete;
+
+			alignas(C) uint8_t _data[sizeof(C)];
+
+			/// pre-new the header; the owner's guid doubles as the component's (which just needs to be non-zero)
+			explicit record(const guid_t owner)
+			{
+				assert(0 != owner._weak);
+
+				header(this)._entity = owner;
+				header(this)._self = owner;
+			}
+
+			~record(void)
+			{
+				get()->~C();
+				clean(this);
+			}
+
+			C* get(void) { return reinterpret_cast<C*>(_data); }
+			const C* get(void) const { return reinterpret_cast<const C*>(_data); }
+
+			static handle_t& header(record* r) { return static_cast<_component*>(r->get())->_handle; }
+			static const handle_t& header(const record* r) { return static_cast<const _component*>(r->get())->_handle; }
+
+			static bool inuse(const record* r) { return 0 != header(r)._self._weak; }
+			static void clean(record* r) { header(r)._self = 0; }
+		};
+
+		std::tuple<hanoi<record<Cs>>...> _storage;
+
+		/// one bit per active (entity) guid
+		std::vector<uint64_t> _guid_active;
+		uint32_t _guid_count;
+
+		template<typename C>
+		hanoi<record<C>>& storage_(void)
+		{
+			static_assert(installed<C>(), "C isn't one of this static_universe's components");
+			return std::get<hanoi<record<C>>>(_storage);
+		}
+
+		bool guid_active_(const uint32_t guid) const
+		{
+			const uint32_t word = guid >> 6;
+
+			return word < _guid_active.size() && (_guid_active[word] & (uint64_t(1) << (guid & 63)));
+		}
+
+		/// the components of C (on `owner` or, with 0, on anyone) until told to stop
+		template<typename C, typename T, typename V>
+		bool each_(const guid_t owner, T& userdata, bool(*callback)(T&, V&))
+		{
+			for (auto& next : storage_<C>())
+				if (0 == owner._weak || owner == record<C>::header(&next)._entity)
+					if (!callback(userdata, *next.get()))
+						return false;
+
+			return true;
+		}
+
+		template<typename T, typename C>
+		void scan_(const guid_t owner, T& userdata, bool(*callback)(T&, C&))
+		{
+			// every storage in turn for the base type; stopping when told to
+			if constexpr (std::is_same<C, _component>::value)
+				(void)(each_<Cs>(owner, userdata, callback) && ...);
+			else
+				each_<C>(owner, userdata, callback);
+		}
+
+		template<typename C>
+		void drop_(const guid_t owner)
+		{
+			auto& storage = storage_<C>();
+
+			// erasing doesn't move anything, so, one pass is enough
+			for (auto it = storage.begin(); it != storage.end(); ++it)
+				if (owner == record<C>::header(&(*it))._entity)
+					storage.erase(it);
+		}
+
+		void remove_(const guid_t owner)
+		{
+			assert(guid_active_(owner._weak));
+
+			(drop_<Cs>(owner), ...);
+
+			_guid_active[owner._weak >> 6] &= ~(uint64_t(1) << (owner._weak & 63));
+			--_guid_count;
+		}
+	};
+}
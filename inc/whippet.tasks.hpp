@@ -0,0 +1,415 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+
+///
+/// coroutine systems; game logic that waits (for ticks, or for events) written as straight-line code
+/// ... needs C++20; the rest of whippet doesn't
+///
+
+#pragma once
+
+#include "whippet.hpp"
+
+#ifndef __cpp_impl_coroutine
+#	error "whippet.tasks.hpp needs C++20 coroutines"
+#endif
+
+#include <algorithm>
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace whippet
+{
+	struct scheduler;
+
+	template<typename E>
+	struct event;
+
+	/// where coroutine frames come from
+	/// ... a free list (per thread) for each multiple of GRAIN up to CLASSES of them; bigger frames go to the heap
+	/// ... once it's warmed up, starting (and finishing) a task doesn't allocate
+	struct frame_pool final
+	{
+		frame_pool(void) = delete;
+
+		static const size_t GRAIN = 64;
+		static const size_t CLASSES = 16;
+
+		static void* allocate(const size_t size)
+		{
+			const size_t grade = (size + GRAIN - 1) / GRAIN;
+			if (CLASSES < grade)
+				return ::operator new(size);
+
+			auto& head = lists()._heads[grade - 1];
+			if (nullptr == head)
+				return ::operator new(grade * GRAIN);
+
+			auto frame = head;
+			head = frame->_next;
+			return frame;
+		}
+
+		static void release(void* frame, const size_t size)
+		{
+			const size_t grade = (size + GRAIN - 1) / GRAIN;
+			if (CLASSES < grade)
+			{
+				::operator delete(frame);
+				return;
+			}
+
+			auto& head = lists()._heads[grade - 1];
+			head = new (frame) free_t{ head };
+		}
+
+	private:
+		struct free_t
+		{
+			free_t* _next;
+		};
+
+		struct lists_t
+		{
+			free_t* _heads[CLASSES] = {};
+
+			~lists_t(void)
+			{
+				for (auto head : _heads)
+					while (nullptr != head)
+					{
+						auto next = head->_next;
+						::operator delete(head);
+						head = next;
+					}
+			}
+		};
+
+		static lists_t& lists(void)
+		{
+			thread_local lists_t lists;
+			return lists;
+		}
+	};
+
+	/// what a coroutine system returns; hand it to scheduler::spawn() which runs it up to its first co_await (and owns it from then on)
+	struct task final
+	{
+		struct promise_type
+		{
+			/// set by spawn()
+			scheduler* _scheduler = nullptr;
+
+			/// the scheduler's live tasks are a (doubly) linked list
+			std::coroutine_handle<promise_type> _prev;
+			std::coroutine_handle<promise_type> _next;
+
+			task get_return_object(void) { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+			std::suspend_always initial_suspend(void) noexcept { return {}; }
+			std::suspend_always final_suspend(void) noexcept { return {}; }
+
+			void return_void(void) {}
+
+			/// there's no-one to hand it to; tasks are resumed from tick()
+			void unhandled_exception(void) { std::terminate(); }
+
+			static void* operator new(const size_t size) { return frame_pool::allocate(size); }
+			static void operator delete(void* frame, const size_t size) { frame_pool::release(frame, size); }
+		};
+
+		typedef std::coroutine_handle<promise_type> handle;
+
+		task(const task&) = delete;
+		task& operator=(const task&) = delete;
+
+		task(task&& other) noexcept : _handle(other._handle) { other._handle = nullptr; }
+
+		~task(void)
+		{
+			if (_handle)
+				_handle.destroy();
+		}
+
+	private:
+		friend struct scheduler;
+
+		explicit task(const handle frame) : _handle(frame) {}
+
+		handle _handle;
+	};
+
+	/// co_await whippet::delay(n); carries on n ticks from now (or straight away for 0)
+	struct delay final
+	{
+		explicit delay(const uint64_t ticks) : _ticks(ticks) {}
+
+		bool await_ready(void) const noexcept { return 0 == _ticks; }
+		inline void await_suspend(task::handle);
+		void await_resume(void) const noexcept {}
+
+		const uint64_t _ticks;
+	};
+
+	/// co_await whippet::next_tick()
+	inline delay next_tick(void)
+	{
+		return delay(1);
+	}
+
+	/// runs coroutine systems a tick at a time; get one with universe::system<whippet::scheduler>()
+	/// ... a task is only resumed once what it's waiting on is ready, so, waiting tasks cost nothing per tick
+	/// ... tasks are only ever resumed by tick() (and spawn()); messages from event_manager threads are handed over to it
+	struct scheduler : _system
+	{
+		/// not defaulted; universe::system() value-initialises, which would zero what it's already set up in _system
+		scheduler(void) {}
+
+		~scheduler(void)
+		{
+			// no more messages; then the tasks (and whatever they were waiting on) go
+			_listeners.clear();
+
+			while (_live)
+			{
+				auto frame = _live;
+				unlink_(frame);
+				frame.destroy();
+			}
+		}
+
+		/// takes the task and runs it up to its first co_await
+		void spawn(task&& started)
+		{
+			auto frame = started._handle;
+			started._handle = nullptr;
+
+			assert(frame && nullptr == frame.promise()._scheduler);
+
+			frame.promise()._scheduler = this;
+			frame.promise()._next = _live;
+			if (_live)
+				_live.promise()._prev = frame;
+			_live = frame;
+			++_count;
+
+			run_(frame);
+		}
+
+		/// moves time on by one and resumes what's due; delays that are up (in the order they were made) then messages that came in
+		/// ... tasks that wait again while they're being resumed are left for a later tick
+		void tick(void)
+		{
+			pal__trace_span("whippet", "tick");
+
+			++_now;
+
+			while (!_timed.empty() && _timed.front()._due <= _now)
+			{
+				std::pop_heap(_timed.begin(), _timed.end(), later_);
+				_running.push_back(_timed.back()._frame);
+				_timed.pop_back();
+			}
+
+			{
+				std::lock_guard<std::mutex> guard(_lock);
+				_running.insert(_running.end(), _mail.begin(), _mail.end());
+				_mail.clear();
+			}
+
+			for (size_t i = 0; i < _running.size(); ++i)
+				run_(_running[i]);
+
+			_running.clear();
+		}
+
+		/// ticks so far
+		uint64_t now(void) const { return _now; }
+
+		/// tasks that haven't finished
+		size_t size(void) const { return _count; }
+
+	private:
+		friend struct delay;
+
+		template<typename E>
+		friend struct event;
+
+		/// passes messages from one event_manager to the tasks waiting for them
+		struct listener_t
+		{
+			virtual ~listener_t(void) {}
+			const void* _source;
+		};
+
+		template<typename E>
+		struct listener final : listener_t
+		{
+			scheduler& _scheduler;
+			pal::event_manager<E>& _events;
+
+			std::mutex _lock;
+			std::vector<event<E>*> _waiting;
+
+			listener(scheduler& owner, pal::event_manager<E>& events) :
+				_scheduler(owner),
+				_events(events)
+			{
+				this->_source = &events;
+				_events.attach(this, &listener::heard);
+			}
+
+			~listener(void) override
+			{
+				_events.detach(this, &listener::heard);
+			}
+
+			/// on the event thread; everyone waiting gets a copy and is posted to the scheduler
+			static void heard(listener* self, const E& message)
+			{
+				std::vector<event<E>*> woken;
+				{
+					std::lock_guard<std::mutex> guard(self->_lock);
+					if (self->_waiting.empty())
+						return;
+
+					std::swap(woken, self->_waiting);
+				}
+
+				for (auto waiting : woken)
+					waiting->_message.emplace(message);
+
+				std::lock_guard<std::mutex> guard(self->_scheduler._lock);
+				for (auto waiting : woken)
+					self->_scheduler._mail.push_back(waiting->_frame);
+			}
+		};
+
+		struct timed_t
+		{
+			uint64_t _due;
+
+			/// ties go in the order they were made
+			uint64_t _order;
+
+			task::handle _frame;
+		};
+
+		uint64_t _now = 0;
+		uint64_t _order = 0;
+		size_t _count = 0;
+
+		/// a heap; soonest first
+		std::vector<timed_t> _timed;
+
+		/// what tick() is resuming
+		std::vector<task::handle> _running;
+
+		/// from the listeners; guarded by _lock
+		std::mutex _lock;
+		std::vector<task::handle> _mail;
+
+		std::vector<std::unique_ptr<listener_t>> _listeners;
+
+		/// the most recently spawned live task
+		task::handle _live;
+
+		static bool later_(const timed_t& left, const timed_t& right)
+		{
+			return left._due != right._due ? right._due < left._due : right._order < left._order;
+		}
+
+		void wait_(const task::handle frame, const uint64_t ticks)
+		{
+			_timed.push_back(timed_t{ _now + ticks, _order++, frame });
+			std::push_heap(_timed.begin(), _timed.end(), later_);
+		}
+
+		template<typename E>
+		listener<E>& listen_(pal::event_manager<E>& events)
+		{
+			for (auto& next : _listeners)
+				if (&events == next->_source)
+					return *static_cast<listener<E>*>(next.get());
+
+			_listeners.push_back(std::make_unique<listener<E>>(*this, events));
+			return *static_cast<listener<E>*>(_listeners.back().get());
+		}
+
+		void unlink_(const task::handle frame)
+		{
+			auto& self = frame.promise();
+
+			if (self._prev)
+				self._prev.promise()._next = self._next;
+			else
+				_live = self._next;
+
+			if (self._next)
+				self._next.promise()._prev = self._prev;
+
+			self._prev = nullptr;
+			self._next = nullptr;
+			--_count;
+		}
+
+		void run_(const task::handle frame)
+		{
+			frame.resume();
+
+			if (!frame.done())
+				return;
+
+			unlink_(frame);
+			frame.destroy();
+		}
+	};
+
+	inline void delay::await_suspend(task::handle waiting)
+	{
+		waiting.promise()._scheduler->wait_(waiting, _ticks);
+	}
+
+	/// co_await whippet::event<E>(events); carries on (at a tick) with the next message broadcast after it started waiting
+	/// ... the scheduler attaches one handler to each event_manager it's asked about; the event_manager needs to outlive the scheduler
+	template<typename E>
+	struct event final
+	{
+		explicit event(pal::event_manager<E>& events) : _events(events) {}
+
+		bool await_ready(void) const noexcept { return false; }
+
+		void await_suspend(task::handle waiting)
+		{
+			_frame = waiting;
+
+			auto& listener = waiting.promise()._scheduler->listen_(_events);
+
+			std::lock_guard<std::mutex> guard(listener._lock);
+			listener._waiting.push_back(this);
+		}
+
+		E await_resume(void) { return std::move(*_message); }
+
+	private:
+		friend struct scheduler;
+
+		pal::event_manager<E>& _events;
+		task::handle _frame;
+		std::optional<E> _message;
+	};
+}
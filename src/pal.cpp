@@ -16,54 +16,789 @@
 #	define pal_cpp
 #endif
 
-pal_cpp pal::adler::adler(void) :
-	_a(1),
-	_b(0)
+#include <errno.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#	include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#	include <immintrin.h>
+#endif
+
+#ifndef _WIN32
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+namespace
 {
+	/// adds n bytes (no more than NMAX) to a and b without taking the modulo
+	inline void adler_bytes(uint32_t& a, uint32_t& b, const uint8_t* bytes, size_t n)
+	{
+		for (; n >= 8; n -= 8, bytes += 8)
+		{
+			a += bytes[0]; b += a;
+			a += bytes[1]; b += a;
+			a += bytes[2]; b += a;
+			a += bytes[3]; b += a;
+			a += bytes[4]; b += a;
+			a += bytes[5]; b += a;
+			a += bytes[6]; b += a;
+			a += bytes[7]; b += a;
+		}
+
+		for (; n; --n, ++bytes)
+		{
+			a += *bytes;
+			b += a;
+		}
+	}
+
+#if defined(__SSE2__) || defined(_M_X64)
+	/// n (a multiple of 16, no more than NMAX) bytes sixteen at a time
+	/// ... over a block; a gains the sum of the bytes, b gains n * a and each byte times how many are left from it
+	inline void adler_sse2(uint32_t& a, uint32_t& b, const uint8_t* bytes, const size_t n)
+	{
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i high = _mm_setr_epi16(16, 15, 14, 13, 12, 11, 10, 9);
+		const __m128i low = _mm_setr_epi16(8, 7, 6, 5, 4, 3, 2, 1);
+
+		// the sums of bytes (so far), the running total of those at each step, and the weighted sums
+		__m128i sums = zero;
+		__m128i totals = zero;
+		__m128i weighted = zero;
+
+		for (size_t i = 0; i < n; i += 16)
+		{
+			const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + i));
+
+			totals = _mm_add_epi32(totals, sums);
+			sums = _mm_add_epi32(sums, _mm_sad_epu8(next, zero));
+
+			weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpacklo_epi8(next, zero), high));
+			weighted = _mm_add_epi32(weighted, _mm_madd_epi16(_mm_unpackhi_epi8(next, zero), low));
+		}
+
+		weighted = _mm_add_epi32(weighted, _mm_slli_epi32(totals, 4));
+
+		// horizontal sums; sad leaves its two totals in the low halves of each 64 bits
+		sums = _mm_add_epi32(sums, _mm_shuffle_epi32(sums, _MM_SHUFFLE(1, 0, 3, 2)));
+		weighted = _mm_add_epi32(weighted, _mm_shuffle_epi32(weighted, _MM_SHUFFLE(1, 0, 3, 2)));
+		weighted = _mm_add_epi32(weighted, _mm_shuffle_epi32(weighted, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		b += a * static_cast<uint32_t>(n) + static_cast<uint32_t>(_mm_cvtsi128_si32(weighted));
+		a += static_cast<uint32_t>(_mm_cvtsi128_si32(sums));
+	}
+#endif
+
+#if defined(__AVX2__)
+	/// the same, thirty two at a time
+	inline void adler_avx2(uint32_t& a, uint32_t& b, const uint8_t* bytes, const size_t n)
+	{
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i ones = _mm256_set1_epi16(1);
+		const __m256i taps = _mm256_setr_epi8(
+			32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17,
+			16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+
+		__m256i sums = zero;
+		__m256i totals = zero;
+		__m256i weighted = zero;
+
+		for (size_t i = 0; i < n; i += 32)
+		{
+			const __m256i next = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bytes + i));
+
+			totals = _mm256_add_epi32(totals, sums);
+			sums = _mm256_add_epi32(sums, _mm256_sad_epu8(next, zero));
+			weighted = _mm256_add_epi32(weighted, _mm256_madd_epi16(_mm256_maddubs_epi16(next, taps), ones));
+		}
+
+		weighted = _mm256_add_epi32(weighted, _mm256_slli_epi32(totals, 5));
+
+		const __m128i sums128 = _mm_add_epi32(_mm256_castsi256_si128(sums), _mm256_extracti128_si256(sums, 1));
+		__m128i weighted128 = _mm_add_epi32(_mm256_castsi256_si128(weighted), _mm256_extracti128_si256(weighted, 1));
+		weighted128 = _mm_add_epi32(weighted128, _mm_shuffle_epi32(weighted128, _MM_SHUFFLE(1, 0, 3, 2)));
+		weighted128 = _mm_add_epi32(weighted128, _mm_shuffle_epi32(weighted128, _MM_SHUFFLE(2, 3, 0, 1)));
+
+		b += a * static_cast<uint32_t>(n) + static_cast<uint32_t>(_mm_cvtsi128_si32(weighted128));
+		a += static_cast<uint32_t>(_mm_cvtsi128_si32(_mm_add_epi32(sums128, _mm_shuffle_epi32(sums128, _MM_SHUFFLE(1, 0, 3, 2)))));
+	}
+#endif
 }
 
-pal_cpp pal::adler::adler(const adler& last, const char next) :
-	_a((last._a + next) % MOD_ADLER),
-	_b((last._b + ((last._a + next) % MOD_ADLER)) % MOD_ADLER)
+pal_cpp pal::adler pal::adler::operator()(const size_t l, const char* t) const
 {
+	auto bytes = reinterpret_cast<const uint8_t*>(t);
+	uint32_t a = _a;
+	uint32_t b = _b;
+
+	for (size_t left = l; left; )
+	{
+		size_t block = std::min(left, NMAX);
+		left -= block;
+
+#if defined(__AVX2__)
+		const size_t wide = block & ~static_cast<size_t>(31);
+		adler_avx2(a, b, bytes, wide);
+#elif defined(__SSE2__) || defined(_M_X64)
+		const size_t wide = block & ~static_cast<size_t>(15);
+		adler_sse2(a, b, bytes, wide);
+#else
+		const size_t wide = 0;
+#endif
+		adler_bytes(a, b, bytes + wide, block - wide);
+		bytes += block;
+
+		a %= MOD_ADLER;
+		b %= MOD_ADLER;
+	}
+
+	return adler(a, b);
 }
 
-pal_cpp pal::adler::operator uint32_t(void) const
+pal_cpp pal::adler pal::adler::scalar(const size_t l, const char* t) const
 {
-	return (_b << 16) | _a;
+	auto bytes = reinterpret_cast<const uint8_t*>(t);
+	uint32_t a = _a;
+	uint32_t b = _b;
+
+	for (size_t left = l; left; )
+	{
+		const size_t block = std::min(left, NMAX);
+		adler_bytes(a, b, bytes, block);
+
+		bytes += block;
+		left -= block;
+
+		a %= MOD_ADLER;
+		b %= MOD_ADLER;
+	}
+
+	return adler(a, b);
 }
 
-pal_cpp pal::adler pal::adler::operator()(const size_t l, const char* t) const
+pal__operator_implement(pal_cpp,pal::adler::sum, _weak, const char*, pal::adler::sum(them)._weak);
+
+pal__operator_implement(pal_cpp,pal::adler::sum, _weak, const pal::adler::sum, them._weak);
+
+namespace
 {
-	return l ? ((*this) << t)(l - 1, t + 1) : *this;
+	/// one thread's spans
+	struct trace_ring
+	{
+		uint32_t _thread;
+
+		/// total number of spans pushed; the ring holds the last CAPACITY of them
+		std::atomic<uint64_t> _pushed;
+
+		pal::trace::record _records[pal::trace::CAPACITY];
+	};
+
+	/// every ring that's been made; they outlive their threads so that they can be dumped
+	/// ... a ring whose thread has exited is spare, and the next new thread to trace takes it up (and its tid) rather than making another
+	struct trace_rings
+	{
+		std::mutex _lock;
+		std::vector<std::unique_ptr<trace_ring>> _rings;
+		std::vector<trace_ring*> _spare;
+
+		/// when the first ring was made; dump() measures the tick rate from here
+		const uint64_t _ticks = pal::trace::now();
+		const uint64_t _nanoseconds = pal::trace::nanoseconds();
+
+		/// never destroyed; thread_local owners can run after statics are gone (where libstdc++ defers the main thread's to atexit())
+		static trace_rings& get(void)
+		{
+			static trace_rings* rings = new trace_rings();
+			return *rings;
+		}
+	};
+
+	/// hands a thread's ring back to be spare when the thread exits
+	struct trace_owner
+	{
+		/// the thread's trace_local() state
+		trace_ring** _ring = nullptr;
+		bool* _exited = nullptr;
+
+		~trace_owner(void)
+		{
+			if (nullptr == _ring)
+				return;
+
+			*_exited = true;
+
+			auto& rings = trace_rings::get();
+			std::unique_lock<std::mutex> guard(rings._lock);
+
+			rings._spare.push_back(*_ring);
+			*_ring = nullptr;
+		}
+	};
+
+	trace_ring& trace_local(void)
+	{
+		thread_local trace_ring* ring = nullptr;
+
+		// set once the owner has been and gone; spans pushed after that (from other thread_local destructors) get a ring of their own, which isn't given back
+		thread_local bool exited = false;
+
+		if (nullptr == ring)
+		{
+			auto& rings = trace_rings::get();
+			{
+				std::unique_lock<std::mutex> guard(rings._lock);
+
+				if (!exited && !rings._spare.empty())
+				{
+					ring = rings._spare.back();
+					rings._spare.pop_back();
+				}
+				else
+				{
+					rings._rings.emplace_back(new trace_ring());
+					ring = rings._rings.back().get();
+					ring->_thread = static_cast<uint32_t>(rings._rings.size());
+					ring->_pushed = 0;
+				}
+			}
+
+			if (!exited)
+			{
+				// the owner is only touched here, so, pushing a span doesn't pay for its thread_local guard
+				thread_local trace_owner owner;
+				owner._ring = &ring;
+				owner._exited = &exited;
+			}
+		}
+
+		return *ring;
+	}
+
+	void trace_string(FILE* file, const char* text)
+	{
+		fputc('"', file);
+		for (; text && *text; ++text)
+		{
+			if ('"' == *text || '\\' == *text)
+				fputc('\\', file);
+			fputc(*text, file);
+		}
+		fputc('"', file);
+	}
 }
 
-pal_cpp uint32_t pal::adler::operator()(void) const
+pal_cpp void pal::trace::push(const char* category, const char* name, const uint64_t start, const uint64_t end)
 {
-	return *this;
+	auto& ring = trace_local();
+
+	const auto index = ring._pushed.load(std::memory_order_relaxed);
+
+	auto& record = ring._records[index % CAPACITY];
+	record._category = category;
+	record._name = name;
+	record._start = start;
+	record._end = end;
+
+	ring._pushed.store(index + 1, std::memory_order_release);
 }
 
-pal_cpp pal::adler pal::adler:: operator << (const char* s) const
+pal_cpp bool pal::trace::dump(const char* path)
 {
-	return (s && *s) ? pal::adler(*this, *s) << (1 + s) : *this;
+	FILE* file = fopen(path, "w");
+	if (nullptr == file)
+		return false;
+
+	auto& rings = trace_rings::get();
+	std::unique_lock<std::mutex> guard(rings._lock);
+
+	// ticks to microseconds, measured across the life of the tracer
+	const auto ticks = pal::trace::now() - rings._ticks;
+	const auto scale = 0 == ticks ? 0.001 : (pal::trace::nanoseconds() - rings._nanoseconds) / (1000.0 * ticks);
+
+	fprintf(file, "{\"traceEvents\":[");
+
+	bool first = true;
+	for (auto& ring : rings._rings)
+	{
+		const auto pushed = ring->_pushed.load(std::memory_order_acquire);
+		const auto oldest = pushed < CAPACITY ? 0 : pushed - CAPACITY;
+
+		for (auto index = oldest; index < pushed; ++index)
+		{
+			auto& record = ring->_records[index % CAPACITY];
+
+			fprintf(file, first ? "\n{\"name\":" : ",\n{\"name\":");
+			trace_string(file, record._name);
+			fprintf(file, ",\"cat\":");
+			trace_string(file, record._category);
+			fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				ring->_thread,
+				static_cast<int64_t>(record._start - rings._ticks) * scale,
+				(record._end - record._start) * scale);
+
+			first = false;
+		}
+	}
+
+	fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+	return 0 == fclose(file);
 }
 
-pal_cpp pal::adler pal::adler::operator << (const char c) const
+pal_cpp void pal::trace::clear(void)
 {
-	return pal::adler(*this, c);
+	auto& rings = trace_rings::get();
+	std::unique_lock<std::mutex> guard(rings._lock);
+
+	for (auto& ring : rings._rings)
+		ring->_pushed = 0;
 }
 
-pal_cpp pal::adler::sum::sum(const char* text) :
-	pal::strong<uint32_t>::strong(pal::adler() << text)
+namespace
 {
+	/// "whpj"
+	const uint32_t JOURNAL_MAGIC = 0x6a706877;
+	/// 2; adler's bytes are unsigned, as zlib's are
+	const uint32_t JOURNAL_VERSION = 2;
+
+	/// what comes first in a journal segment
+	struct journal_segment
+	{
+		uint32_t _magic;
+		uint32_t _version;
+		uint32_t _record;
+		uint32_t _stride;
+
+		uint64_t _index;
+
+		/// the sequence number of its first record
+		uint64_t _first;
+	};
+	static_assert(sizeof(journal_segment) <= 32, "journal segment headers have 32 bytes");
+
+	/// what comes before each record
+	struct journal_record
+	{
+		uint64_t _sequence;
+		uint32_t _size;
+
+		/// adler of the sequence number and the record; a record that isn't whole (or was never written) won't match
+		uint32_t _check;
+	};
+
+	uint32_t journal_check(const uint64_t sequence, const void* data, const size_t size)
+	{
+		return pal::adler()(sizeof(sequence), reinterpret_cast<const char*>(&sequence))(size, reinterpret_cast<const char*>(data));
+	}
+
+	std::string journal_name(const std::string& path, const uint64_t index)
+	{
+		return path + "." + std::to_string(index);
+	}
+
+	/// the numbers of the segments there are, in order
+	std::vector<uint64_t> journal_segments(const std::string& path)
+	{
+		const std::filesystem::path full(path);
+		const auto folder = full.has_parent_path() ? full.parent_path() : std::filesystem::path(".");
+		const auto prefix = full.filename().string() + ".";
+
+		std::vector<uint64_t> indices;
+
+		std::error_code error;
+		for (std::filesystem::directory_iterator entry(folder, error), end; !error && entry != end; entry.increment(error))
+		{
+			const auto name = entry->path().filename().string();
+			if (name.size() <= prefix.size() || 0 != name.compare(0, prefix.size(), prefix))
+				continue;
+
+			const auto digits = name.substr(prefix.size());
+			if (digits.end() != std::find_if(digits.begin(), digits.end(), [](const char c) { return c < '0' || '9' < c; }))
+				continue;
+
+			indices.push_back(std::stoull(digits));
+		}
+
+		std::sort(indices.begin(), indices.end());
+		return indices;
+	}
+
+#ifndef _WIN32
+	/// calls code (if there is one) with each whole record of a segment, in order; last is the last one's sequence number
+	size_t journal_scan(const std::string& name, const size_t record, const size_t stride, void(*code)(void*, const void*), void* data, uint64_t& last)
+	{
+		last = 0;
+
+		const int file = open(name.c_str(), O_RDONLY);
+		if (file < 0)
+			return 0;
+
+		struct stat status;
+		if (0 != fstat(file, &status) || static_cast<size_t>(status.st_size) < pal::journal::SEGMENT_HEADER)
+		{
+			close(file);
+			return 0;
+		}
+
+		const auto size = static_cast<size_t>(status.st_size);
+		const auto mapping = reinterpret_cast<const uint8_t*>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0));
+		close(file);
+
+		if (MAP_FAILED == reinterpret_cast<const void*>(mapping))
+			return 0;
+
+		journal_segment header;
+		memcpy(&header, mapping, sizeof(header));
+
+		size_t count = 0;
+		if (JOURNAL_MAGIC == header._magic && JOURNAL_VERSION == header._version && record == header._record && stride == header._stride)
+		{
+			last = header._first - 1;
+
+			for (size_t at = pal::journal::SEGMENT_HEADER; at + stride <= size; at += stride)
+			{
+				journal_record each;
+				memcpy(&each, mapping + at, sizeof(each));
+
+				const auto* bytes = mapping + at + sizeof(each);
+				if (last + 1 != each._sequence || record != each._size || journal_check(each._sequence, bytes, record) != each._check)
+					break;
+
+				if (code)
+					code(data, bytes);
+
+				last = each._sequence;
+				++count;
+			}
+		}
+
+		munmap(const_cast<uint8_t*>(mapping), size);
+		return count;
+	}
+#endif
 }
 
-pal_cpp pal::adler::sum::sum(const pal::adler& adler) :
-	pal::strong<uint32_t>::strong(adler)
+pal_cpp pal::journal::journal(void) :
+	_record(0),
+	_segment(0),
+	_segments(0),
+	_interval(0),
+	_file(-1),
+	_mapping(nullptr),
+	_index(0),
+	_offset(0),
+	_sequence(1),
+	_written(0),
+	_last(0),
+	_synced_mapping(nullptr),
+	_synced(0),
+	_committed(0),
+	_error(0),
+	_terminate(false)
 {
 }
 
+pal_cpp pal::journal::~journal(void)
+{
+	close();
+}
 
-pal__operator_implement(pal_cpp,pal::adler::sum, _weak, const char*, pal::adler::sum(them)._weak);
+pal_cpp size_t pal::journal::stride_(void) const
+{
+	return (sizeof(journal_record) + _record + 7) & ~static_cast<size_t>(7);
+}
 
-pal__operator_implement(pal_cpp,pal::adler::sum, _weak, const pal::adler::sum, them._weak);
+pal_cpp bool pal::journal::open(const char* path, const size_t record, const size_t segment, const size_t segments, const std::chrono::milliseconds interval)
+{
+	close();
+
+#ifdef _WIN32
+	return false;
+#else
+	_path = path;
+	_record = record;
+	_segment = segment;
+	_segments = std::max<size_t>(1, segments);
+	_interval = interval;
+
+	if (_segment < SEGMENT_HEADER + stride_())
+		return false;
+
+	// numbering carries on from the newest segment (even if it was cut short) whose header made it to disk
+	// ... one made just before a crash can be all zeroes, which says nothing; so, the ones before it are looked at
+	const auto existing = journal_segments(_path);
+
+	uint64_t last = 0;
+	for (auto index = existing.rbegin(); existing.rend() != index && 0 == last; ++index)
+		journal_scan(journal_name(_path, *index), _record, stride_(), nullptr, nullptr, last);
+
+	_index = existing.empty() ? 0 : existing.back() + 1;
+	_sequence = last + 1;
+	_last = last;
+	_committed = last;
+
+	for (auto index : existing)
+		if (index + _segments <= _index)
+			unlink(journal_name(_path, index).c_str());
+
+	if (!roll_())
+		return false;
+
+	_terminate = false;
+	_thread = std::thread([this]
+	{
+		std::unique_lock<std::mutex> guard_wake(_wake);
+		while (!_terminate)
+		{
+			_condition.wait_for(guard_wake, _interval);
+
+			guard_wake.unlock();
+			sync_();
+			guard_wake.lock();
+		}
+	});
+
+	return true;
+#endif
+}
+
+pal_cpp void pal::journal::close(void)
+{
+	if (_thread.joinable())
+	{
+		{
+			std::unique_lock<std::mutex> guard_wake(_wake);
+			_terminate = true;
+			_condition.notify_one();
+		}
+		_thread.join();
+	}
+
+#ifndef _WIN32
+	if (nullptr == _mapping)
+		return;
+
+	sync_();
+
+	// segments that still wouldn't sync are let go of anyway (error() says so)
+	for (auto& each : _retired)
+	{
+		munmap(each._mapping, _segment);
+		::close(each._file);
+	}
+	_retired.clear();
+
+	munmap(_mapping, _segment);
+	::close(_file);
+
+	_mapping = nullptr;
+	_file = -1;
+	_synced_mapping = nullptr;
+#endif
+}
+
+pal_cpp bool pal::journal::roll_(void)
+{
+#ifdef _WIN32
+	return false;
+#else
+	const int file = ::open(journal_name(_path, _index).c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file < 0)
+		return false;
+
+	auto mapping = reinterpret_cast<uint8_t*>(MAP_FAILED);
+	if (0 == ftruncate(file, static_cast<off_t>(_segment)))
+		mapping = reinterpret_cast<uint8_t*>(mmap(nullptr, _segment, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0));
+
+	if (MAP_FAILED == reinterpret_cast<void*>(mapping))
+	{
+		::close(file);
+		return false;
+	}
+
+	const journal_segment header = {
+		JOURNAL_MAGIC,
+		JOURNAL_VERSION,
+		static_cast<uint32_t>(_record),
+		static_cast<uint32_t>(stride_()),
+		_index,
+		_sequence,
+	};
+	memcpy(mapping, &header, sizeof(header));
+
+	{
+		std::unique_lock<std::mutex> guard(_lock);
+
+		if (nullptr != _mapping)
+			_retired.push_back(retired_s{ _file, _mapping, _offset });
+
+		_file = file;
+		_mapping = mapping;
+		_offset = SEGMENT_HEADER;
+		_written.store(_offset, std::memory_order_release);
+	}
+
+	// the ring; this one counts
+	if (_segments <= _index)
+		unlink(journal_name(_path, _index - _segments).c_str());
+
+	++_index;
+	return true;
+#endif
+}
+
+pal_cpp uint64_t pal::journal::append(const void* data, const size_t size)
+{
+	if (size != _record)
+		return 0;
+
+	return append(data);
+}
+
+pal_cpp uint64_t pal::journal::append(const void* data)
+{
+	const size_t stride = stride_();
+
+	if (nullptr == _mapping || (_segment < _offset + stride && !roll_()))
+		return 0;
+
+	auto* at = _mapping + _offset;
+
+	// the header goes in last, but the check covers for it not being there on its own
+	const journal_record header = { _sequence, static_cast<uint32_t>(_record), journal_check(_sequence, data, _record) };
+	memcpy(at + sizeof(header), data, _record);
+	memcpy(at, &header, sizeof(header));
+
+	_offset += stride;
+
+	// written before last, so that the syncing thread never commits more than it's synced
+	_written.store(_offset, std::memory_order_release);
+	_last.store(_sequence, std::memory_order_release);
+
+	return _sequence++;
+}
+
+pal_cpp void pal::journal::sync_(void)
+{
+#ifndef _WIN32
+	std::unique_lock<std::mutex> guard_sync(_sync);
+
+	std::vector<retired_s> retired;
+	uint64_t last;
+	size_t written;
+	uint8_t* mapping;
+	{
+		std::unique_lock<std::mutex> guard(_lock);
+
+		last = _last.load(std::memory_order_acquire);
+		written = _written.load(std::memory_order_acquire);
+		mapping = _mapping;
+		retired.swap(_retired);
+	}
+
+	const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+
+	// nothing more counts as committed once a sync fails; a retired segment that didn't sync is kept (and tried again) rather than closed
+	bool synced = true;
+	std::vector<retired_s> again;
+
+	// only the dirty pages are written, but the ones already synced needn't be looked through again
+	for (auto& each : retired)
+	{
+		const size_t from = (each._mapping == _synced_mapping) ? (_synced & ~(page - 1)) : 0;
+		if (synced && from < each._end && 0 != msync(each._mapping + from, each._end - from, MS_SYNC))
+		{
+			_error.store(errno, std::memory_order_release);
+			synced = false;
+		}
+
+		if (!synced)
+		{
+			again.push_back(each);
+			continue;
+		}
+
+		if (each._mapping == _synced_mapping)
+			_synced_mapping = nullptr;
+
+		munmap(each._mapping, _segment);
+		::close(each._file);
+	}
+
+	if (!again.empty())
+	{
+		std::unique_lock<std::mutex> guard(_lock);
+		_retired.insert(_retired.begin(), again.begin(), again.end());
+	}
+
+	if (!synced || nullptr == mapping)
+		return;
+
+	if (mapping != _synced_mapping)
+	{
+		_synced_mapping = mapping;
+		_synced = 0;
+	}
+
+	if (_synced < written)
+	{
+		const size_t from = _synced & ~(page - 1);
+		if (0 != msync(mapping + from, written - from, MS_SYNC))
+		{
+			_error.store(errno, std::memory_order_release);
+			return;
+		}
+
+		_synced = written;
+	}
+
+	_committed.store(last, std::memory_order_release);
+#endif
+}
+
+pal_cpp uint64_t pal::journal::commit(void)
+{
+	sync_();
+	return committed();
+}
+
+pal_cpp uint64_t pal::journal::committed(void) const
+{
+	return _committed.load(std::memory_order_acquire);
+}
+
+pal_cpp int pal::journal::error(void) const
+{
+	return _error.load(std::memory_order_acquire);
+}
+
+pal_cpp size_t pal::journal::replay(const char* path, const size_t record, void(*code)(void*, const void*), void* data)
+{
+#ifdef _WIN32
+	return 0;
+#else
+	const size_t stride = (sizeof(journal_record) + record + 7) & ~static_cast<size_t>(7);
+
+	size_t count = 0;
+	for (auto index : journal_segments(path))
+	{
+		uint64_t last;
+		count += journal_scan(journal_name(path, index), record, stride, code, data, last);
+	}
+
+	return count;
+#endif
+}
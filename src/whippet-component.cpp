@@ -13,52 +13,56 @@
 #include "whippet.hpp"
 
 whippet::_component::_component(void) :
-	_owner(owner()),
-	_guid(guid())
+	_handle(_handle)
 {
 	assert((inuse()) && "You're probably attaching a component with no args - that doesn't work in V$");
 }
 
-whippet::_component::~_component(void)
+void whippet::_component::detach(void)
 {
 	assert(inuse());
-
-	_owner.world().guid_release(_guid);
-	_guid = 0;
-	assert(!inuse());
+	whippet__count(++manager()._counters._detached);
+	manager().detach(this);
 }
 
-void whippet::_component::detach(void)
+void whippet::_component::touch(void)
 {
 	assert(inuse());
-	assert(nullptr != _manager);
-	_manager->detach(this);
+	manager().touch(this);
 }
 
 whippet::guid_t whippet::_component::guid(void) const
 {
 	assert(inuse());
-	return _guid;
+	return _handle._self;
 }
 
 bool whippet::_component::inuse(void) const
 {
-	return _guid != 0;
+	return _handle._self != 0;
+}
+
+whippet::_provider& whippet::_component::manager(void) const
+{
+	// the storage block knows which provider it belongs to
+	auto manager = reinterpret_cast<whippet::_provider*>(hanoi_block::tag(this));
+	assert(nullptr != manager);
+	return *manager;
 }
 
 bool whippet::_component::is(const std::type_index kind) const
 {
-	return _manager->is(kind);
+	return manager().is(kind);
 }
 
 whippet::entity whippet::_component::owner(void) const
 {
 	assert(inuse());
-	return _owner;
+	return whippet::entity(&world(), _handle._entity);
 }
 
 whippet::universe& whippet::_component::world(void) const
 {
 	assert(inuse());
-	return _owner.world();
+	return manager()._world;
 }
@@ -0,0 +1,332 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "whippet.hpp"
+
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#ifdef __linux__
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
+namespace
+{
+#ifdef __linux__
+	/// a file of frozen blocks; kept open while any block says that it has a copy in it
+	struct fork_file
+	{
+		int _descriptor;
+		uint32_t _blocks;
+	};
+
+	/// every fork_file; forks can happen on any thread
+	struct fork_files
+	{
+		std::mutex _lock;
+		std::map<uint32_t, fork_file> _files;
+		uint32_t _next = 1;
+
+		static fork_files& get(void)
+		{
+			static fork_files files;
+			return files;
+		}
+
+		void ref(const uint32_t file)
+		{
+			std::unique_lock<std::mutex> guard(_lock);
+			++(_files[file]._blocks);
+		}
+
+		void unref(const uint32_t file)
+		{
+			std::unique_lock<std::mutex> guard(_lock);
+
+			auto found = _files.find(file);
+			assert(_files.end() != found && 0 < found->second._blocks);
+
+			if (0 == --(found->second._blocks))
+			{
+				close(found->second._descriptor);
+				_files.erase(found);
+			}
+		}
+
+		int descriptor(const uint32_t file)
+		{
+			std::unique_lock<std::mutex> guard(_lock);
+			return _files[file]._descriptor;
+		}
+	};
+
+	/// an allocate()d block that's been frozen
+	void release_heap(void* block)
+	{
+		fork_files::get().unref(reinterpret_cast<hanoi_block::header*>(block)->_frozen);
+		::operator delete(block, std::align_val_t(hanoi_block::SIZE));
+	}
+
+	/// a mapped block that's been frozen (or was mapped from a frozen one)
+	void release_mapped(void* block)
+	{
+		fork_files::get().unref(reinterpret_cast<hanoi_block::header*>(block)->_frozen);
+		munmap(block, hanoi_block::SIZE);
+	}
+
+	/// writes all of a block's bytes at an offset in the file
+	bool write_block(const int descriptor, const hanoi_block::header* block, const off_t at)
+	{
+		auto data = reinterpret_cast<const char*>(block);
+		for (size_t done = 0; done < hanoi_block::SIZE;)
+		{
+			const auto wrote = pwrite(descriptor, data + done, hanoi_block::SIZE - done, at + static_cast<off_t>(done));
+			if (wrote <= 0)
+				return false;
+			done += static_cast<size_t>(wrote);
+		}
+
+		return true;
+	}
+
+#ifndef NDEBUG
+	/// whether a frozen block still matches its image; past the header, which freeze() changes after writing it
+	bool unchanged(const hanoi_block::header* block)
+	{
+		std::vector<char> image(hanoi_block::SIZE);
+		const int descriptor = fork_files::get().descriptor(block->_frozen);
+		const auto at = static_cast<off_t>(block->_slot) * hanoi_block::SIZE;
+		for (size_t done = 0; done < hanoi_block::SIZE;)
+		{
+			const auto read = pread(descriptor, image.data() + done, hanoi_block::SIZE - done, at + static_cast<off_t>(done));
+			if (read <= 0)
+				return false;
+			done += static_cast<size_t>(read);
+		}
+
+		const auto skip = sizeof(hanoi_block::header);
+		return 0 == memcmp(image.data() + skip, reinterpret_cast<const char*>(block) + skip, hanoi_block::SIZE - skip);
+	}
+#endif
+
+	/// copies the blocks that need it into a new file; false (having changed nothing) if that can't be done
+	/// ... a block is only copied again if it's been touched; anything changed without that would be missed (which debug builds check)
+	bool freeze(const std::vector<hanoi_block::header*>& blocks)
+	{
+		std::vector<hanoi_block::header*> stale;
+		for (auto block : blocks)
+			if (0 == block->_frozen || block->_written)
+				stale.push_back(block);
+			else
+				assert(unchanged(block) && "a component was changed through a kept reference without touch()");
+
+		if (stale.empty())
+			return true;
+
+		const int descriptor = memfd_create("whippet", MFD_CLOEXEC);
+		if (descriptor < 0)
+			return false;
+
+		if (0 != ftruncate(descriptor, static_cast<off_t>(stale.size() * hanoi_block::SIZE)))
+		{
+			close(descriptor);
+			return false;
+		}
+
+		auto& files = fork_files::get();
+		uint32_t file;
+		{
+			std::unique_lock<std::mutex> guard(files._lock);
+			file = files._next++;
+			files._files[file] = fork_file{ descriptor, 0 };
+		}
+
+		// the image carries these, so, they're set before it's written (and put back if it can't be)
+		struct was_t
+		{
+			uint32_t _frozen;
+			uint32_t _slot;
+			uint32_t _written;
+		};
+		std::vector<was_t> was;
+		was.reserve(stale.size());
+
+		for (uint32_t slot = 0; slot < stale.size(); ++slot)
+		{
+			auto block = stale[slot];
+			was.push_back(was_t{ block->_frozen, block->_slot, block->_written });
+
+			block->_frozen = file;
+			block->_slot = slot;
+			block->_written = 0;
+
+			if (!write_block(descriptor, block, static_cast<off_t>(slot) * hanoi_block::SIZE))
+			{
+				for (size_t i = 0; i < was.size(); ++i)
+				{
+					stale[i]->_frozen = was[i]._frozen;
+					stale[i]->_slot = was[i]._slot;
+					stale[i]->_written = was[i]._written;
+				}
+
+				{
+					std::unique_lock<std::mutex> guard(files._lock);
+					files._files.erase(file);
+				}
+				close(descriptor);
+				return false;
+			}
+		}
+
+		// every image is in the file; so, the blocks can say that they are
+		for (uint32_t slot = 0; slot < stale.size(); ++slot)
+		{
+			auto block = stale[slot];
+
+			files.ref(file);
+
+			if (0 == was[slot]._frozen)
+				block->_release = (nullptr == block->_release) ? release_heap : release_mapped;
+			else
+				files.unref(was[slot]._frozen);
+		}
+
+		return true;
+	}
+
+	/// maps (copy-on-write) each frozen block's image; a run of slots from a file at a time
+	/// ... false (having given back anything it did map) if the address space or the mapping couldn't be had
+	bool thaw(const std::vector<hanoi_block::header*>& blocks, std::vector<hanoi_block::header*>& copies)
+	{
+		copies.assign(blocks.size(), nullptr);
+
+		const auto fail = [&copies](void)
+		{
+			for (auto copy : copies)
+				if (nullptr != copy)
+					hanoi_block::release(copy);
+			copies.clear();
+			return false;
+		};
+
+		// the slots that are wanted from each file
+		std::map<uint32_t, std::map<uint32_t, size_t>> wanted;
+		for (size_t i = 0; i < blocks.size(); ++i)
+			wanted[blocks[i]->_frozen][blocks[i]->_slot] = i;
+
+		auto& files = fork_files::get();
+		for (auto& kv : wanted)
+		{
+			const uint32_t first = kv.second.begin()->first;
+			const uint32_t span = 1 + kv.second.rbegin()->first - first;
+			const size_t size = static_cast<size_t>(span) * hanoi_block::SIZE;
+
+			// reserve an aligned range ...
+			auto reserved = reinterpret_cast<uint8_t*>(mmap(nullptr, size + hanoi_block::SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+			if (MAP_FAILED == reinterpret_cast<void*>(reserved))
+				return fail();
+
+			const auto aligned = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(reserved) + hanoi_block::SIZE - 1) & ~static_cast<uintptr_t>(hanoi_block::SIZE - 1));
+			if (aligned != reserved)
+				munmap(reserved, aligned - reserved);
+			munmap(aligned + size, (reserved + size + hanoi_block::SIZE) - (aligned + size));
+
+			// ... map the run of slots into it ...
+			if (MAP_FAILED == mmap(aligned, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, files.descriptor(kv.first), static_cast<off_t>(first) * hanoi_block::SIZE))
+			{
+				munmap(aligned, size);
+				return fail();
+			}
+
+			// ... and give back the ones that aren't wanted
+			for (uint32_t slot = first; slot < first + span; ++slot)
+			{
+				auto block = reinterpret_cast<hanoi_block::header*>(aligned + (static_cast<size_t>(slot - first) * hanoi_block::SIZE));
+				auto found = kv.second.find(slot);
+
+				if (kv.second.end() == found)
+				{
+					munmap(block, hanoi_block::SIZE);
+					continue;
+				}
+
+				block->_release = release_mapped;
+				files.ref(kv.first);
+				copies[found->second] = block;
+			}
+		}
+
+		return true;
+	}
+#endif
+}
+
+std::vector<hanoi_block::header*> whippet::_provider::fork_blocks(const std::vector<hanoi_block::header*>& blocks)
+{
+#ifdef __linux__
+	std::vector<hanoi_block::header*> mapped;
+	if (freeze(blocks) && thaw(blocks, mapped))
+		return mapped;
+#endif
+
+	// no way to share them; so they're copied
+	std::vector<hanoi_block::header*> copies;
+	for (auto block : blocks)
+	{
+		auto copy = reinterpret_cast<hanoi_block::header*>(hanoi_block::allocate());
+
+		memcpy(copy, block, hanoi_block::SIZE);
+		copy->_release = nullptr;
+		copy->_frozen = 0;
+
+		copies.push_back(copy);
+	}
+
+	return copies;
+}
+
+std::unique_ptr<whippet::universe> whippet::universe::fork(void)
+{
+	pal__trace_span("whippet", "fork");
+
+	auto child = std::make_unique<whippet::universe>();
+
+	// the guids come first; serial components release (then take) theirs as they're read back
+	child->_guid_active = _guid_active;
+	child->_guid_count = _guid_count;
+
+	for (auto& kv : _providers)
+		child->_providers[kv.first] = kv.second->fork(*child);
+
+	// these are attached; so, they wait until every provider is there
+	for (auto& kv : _providers)
+		if (whippet::_provider::layout::serial == kv.second->describe()._layout)
+		{
+			std::stringstream buffer;
+			kv.second->save(buffer);
+			child->_providers[kv.first]->load(buffer);
+		}
+
+	// the rest are left behind; so, their guids are free in the child
+	for (auto& kv : _providers)
+		if (whippet::_provider::layout::none == kv.second->describe()._layout)
+			kv.second->visit(0, false, child.get(), [](void* child, void* component)
+			{
+				reinterpret_cast<whippet::universe*>(child)->guid_release(reinterpret_cast<whippet::_component*>(component)->guid());
+				return true;
+			});
+
+	return child;
+}
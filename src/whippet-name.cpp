@@ -0,0 +1,174 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "whippet.hpp"
+
+whippet::name::name(const char* text) :
+	_key(text)
+#ifdef whippet__names_compare
+	, _text(text)
+#endif
+{
+	world()._names.insert(this);
+}
+
+whippet::name::name(const pal::adler::sum key) :
+	_key(key)
+{
+	world()._names.insert(this);
+}
+
+whippet::name::~name(void)
+{
+	world()._names.erase(this);
+}
+
+void whippet::serial<whippet::name>::save(std::ostream& out, const whippet::name& name)
+{
+	out.write(reinterpret_cast<const char*>(&(name._key._weak)), sizeof(uint32_t));
+
+#ifdef whippet__names_compare
+	const uint32_t size = static_cast<uint32_t>(name._text.size());
+
+	out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+	out.write(name._text.data(), size);
+#endif
+}
+
+void whippet::serial<whippet::name>::load(std::istream& in, whippet::entity owner)
+{
+	uint32_t key;
+	if (!in.read(reinterpret_cast<char*>(&key), sizeof(key)))
+		return;
+
+#ifdef whippet__names_compare
+	uint32_t size;
+	if (!in.read(reinterpret_cast<char*>(&size), sizeof(size)))
+		return;
+
+	std::string text(size, '\0');
+	if (!in.read(&(text[0]), size))
+		return;
+
+	if (!text.empty())
+	{
+		owner.attach<whippet::name>(text.c_str());
+		return;
+	}
+#endif
+
+	owner.attach<whippet::name>(pal::adler::sum(pal::adler(key & 0xFFFF, key >> 16)));
+}
+
+size_t whippet::universe::names_t::home(const uint32_t key) const
+{
+	// the high bits of the product; an adler sum's low bits are just the byte total, so, similar names would crowd together
+	return static_cast<uint32_t>(key * 0x9E3779B1u) >> _shift;
+}
+
+void whippet::universe::names_t::place(const slot_t& slot)
+{
+	const size_t mask = _slots.size() - 1;
+
+	size_t at = home(slot._key);
+	while (nullptr != _slots[at]._name)
+		at = (at + 1) & mask;
+
+	_slots[at] = slot;
+}
+
+void whippet::universe::names_t::insert(const whippet::name* name)
+{
+	if (_slots.size() < 2 * (_count + 1))
+	{
+		std::vector<slot_t> old(_slots.empty() ? 16 : _slots.size() * 2, slot_t{ 0, 0, nullptr });
+		std::swap(old, _slots);
+		_shift = 32 - pal::lowest_bit(_slots.size());
+
+		for (auto& next : old)
+			if (nullptr != next._name)
+				place(next);
+	}
+
+	place(slot_t{ name->_key._weak, name->owner().guid()._weak, name });
+	++_count;
+}
+
+void whippet::universe::names_t::erase(const whippet::name* name)
+{
+	const size_t mask = _slots.size() - 1;
+
+	size_t at = home(name->_key._weak);
+	while (name != _slots[at]._name)
+	{
+		assert(nullptr != _slots[at]._name && "Couldn't find the name - was it already erased?");
+		at = (at + 1) & mask;
+	}
+
+	// pull the rest of the run back over the gap (where they can go) so that lookups never stop short of them
+	for (size_t next = (at + 1) & mask; nullptr != _slots[next]._name; next = (next + 1) & mask)
+	{
+		const size_t want = home(_slots[next]._key);
+
+		if (((next - want) & mask) >= ((next - at) & mask))
+		{
+			_slots[at] = _slots[next];
+			at = next;
+		}
+	}
+
+	_slots[at] = slot_t{ 0, 0, nullptr };
+	--_count;
+}
+
+bool whippet::universe::named_(const pal::adler::sum key, const char* text, void* userdata, bool(*callback)(void*, whippet::entity))
+{
+	if (_names._slots.empty())
+		return true;
+
+	const size_t mask = _names._slots.size() - 1;
+
+	// the table is never full so there's always an empty slot to stop at
+	for (size_t at = _names.home(key._weak); nullptr != _names._slots[at]._name; at = (at + 1) & mask)
+	{
+		auto& slot = _names._slots[at];
+
+		if (key._weak != slot._key)
+			continue;
+
+#ifdef whippet__names_compare
+		// a name that was read back without its text can only be trusted on its sum
+		if (!slot._name->_text.empty() && slot._name->_text != text)
+			continue;
+#else
+		(void)text;
+#endif
+
+		if (!callback(userdata, whippet::entity(this, slot._entity)))
+			return false;
+	}
+
+	return true;
+}
+
+whippet::entity whippet::universe::named(const char* text)
+{
+	whippet::entity found;
+
+	named<whippet::entity>(text, found, [](whippet::entity& found, whippet::entity next)
+	{
+		found = next;
+		return false;
+	});
+
+	return found;
+}
@@ -0,0 +1,111 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "whippet.hpp"
+
+whippet::prefab::prefab(whippet::entity source)
+{
+	auto& world = source.world();
+
+	// a provider at a time; so that each part knows its type
+	for (auto& kv : world._providers)
+	{
+		struct context
+		{
+			whippet::prefab& _prefab;
+			const std::type_index _kind;
+			whippet::_provider& _provider;
+		};
+
+		context self = {
+			*this,
+			kv.first,
+			*(kv.second),
+		};
+
+		kv.second->visit(source.guid(), false, &self, [](void* self, void* component)
+		{
+			auto& outer = *reinterpret_cast<context*>(self);
+
+			// there's nothing to copy; so, the prefab can't be instantiated
+			if (whippet::_provider::layout::none == outer._provider.describe()._layout)
+			{
+				outer._prefab._whole = false;
+				return true;
+			}
+
+			outer._prefab._parts.push_back(part_t{
+				outer._kind,
+				outer._provider.describe()._layout,
+				outer._provider.capture(reinterpret_cast<whippet::_component*>(component)),
+			});
+			return true;
+		});
+	}
+}
+
+std::vector<whippet::entity> whippet::universe::instantiate(const whippet::prefab& prefab, const size_t count)
+{
+	pal__trace_span("whippet", "instantiate");
+
+	// everything is checked before any guids are handed out
+	assume(prefab._whole, "the prefab's entity had a component that can't be copied");
+	if (!prefab._whole)
+		return {};
+
+	std::vector<whippet::_provider*> providers;
+	for (auto& part : prefab._parts)
+	{
+		auto found = _providers.find(part._kind);
+
+		assume(_providers.end() != found, "the prefab has a component that isn't installed");
+		if (_providers.end() == found)
+			return {};
+
+		assume(part._layout == found->second->describe()._layout, "the prefab's component is stored differently here");
+		if (part._layout != found->second->describe()._layout)
+			return {};
+
+		providers.push_back(found->second.get());
+	}
+
+	// the entities' guids first, then, a run for each blittable part
+	size_t blocks = 0;
+	for (auto& part : prefab._parts)
+		if (whippet::_provider::layout::blocks == part._layout)
+			++blocks;
+
+	std::vector<uint32_t> guids(count * (1 + blocks));
+	guid_activate(guids.data(), guids.size());
+
+	std::vector<whippet::entity> spawned;
+	spawned.reserve(count);
+	for (size_t i = 0; i < count; ++i)
+		spawned.emplace_back(this, guids[i]);
+
+	std::vector<whippet::handle_t> handles(count, whippet::handle_t{ 0, 0 });
+	const uint32_t* next = guids.data() + count;
+
+	for (size_t p = 0; p < providers.size(); ++p)
+	{
+		auto& part = prefab._parts[p];
+
+		// tags and serial components (which are attached) use the owner's guid; the blittable ones get their own
+		const bool own = whippet::_provider::layout::blocks == part._layout;
+		for (size_t i = 0; i < count; ++i)
+			handles[i] = whippet::handle_t{ guids[i], own ? *(next++) : guids[i] };
+
+		providers[p]->spawn(part._image, handles.data(), count);
+	}
+
+	return spawned;
+}
@@ -0,0 +1,580 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "whippet.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <streambuf>
+#include <vector>
+
+#ifndef _WIN32
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+namespace
+{
+	/// "whpt"
+	const uint32_t SNAPSHOT_MAGIC = 0x74706877;
+	const uint32_t SNAPSHOT_VERSION = 2;
+
+	/// "whpd"
+	const uint32_t DELTA_MAGIC = 0x64706877;
+
+	/// the end of a list of changed words
+	const uint32_t WORDS_END = ~static_cast<uint32_t>(0);
+
+	/// what comes first in a snapshot; followed by a schema per provider, the guids, then each provider's components
+	struct snapshot_header
+	{
+		uint32_t _magic;
+		uint32_t _version;
+
+		/// the storage blocks need to be the same size to be read back
+		uint32_t _block;
+		uint32_t _providers;
+
+		/// active guids, and, the words of bits that they're in
+		uint32_t _guids;
+		uint32_t _words;
+	};
+
+	template<typename T>
+	void put(std::ostream& out, const T& data)
+	{
+		out.write(reinterpret_cast<const char*>(&data), sizeof(T));
+	}
+
+	template<typename T>
+	bool get(std::istream& in, T& data)
+	{
+		return !!in.read(reinterpret_cast<char*>(&data), sizeof(T));
+	}
+
+	/// reads through to another stream, keeping a copy of everything that's read
+	struct kept_buffer : std::streambuf
+	{
+		std::istream& _from;
+		std::string _kept;
+		char _next;
+
+		kept_buffer(std::istream& from) :
+			_from(from)
+		{
+		}
+
+		int_type underflow(void) override
+		{
+			if (!_from.get(_next))
+				return traits_type::eof();
+
+			_kept.push_back(_next);
+			setg(&_next, &_next, &_next + 1);
+			return traits_type::to_int_type(_next);
+		}
+
+		std::streamsize xsgetn(char* into, const std::streamsize size) override
+		{
+			std::streamsize done = 0;
+
+			// a character that underflow() already read (and kept) goes first
+			if (0 < size && gptr() < egptr())
+			{
+				into[done++] = *gptr();
+				gbump(1);
+			}
+
+			if (done < size)
+			{
+				_from.read(into + done, size - done);
+				_kept.append(into + done, static_cast<size_t>(_from.gcount()));
+				done += _from.gcount();
+			}
+
+			return done;
+		}
+	};
+
+	/// the guids that go into a snapshot
+	struct snapshot_guids
+	{
+		std::vector<uint64_t> _active;
+		uint32_t _count;
+
+		/// components that aren't saved leave their guids behind
+		static bool drop(void* guids, void* component)
+		{
+			auto& self = *reinterpret_cast<snapshot_guids*>(guids);
+			const auto guid = reinterpret_cast<whippet::_component*>(component)->guid()._weak;
+
+			self._active[guid >> 6] &= ~(uint64_t(1) << (guid & 63));
+			--self._count;
+			return true;
+		}
+	};
+
+	/// a count, padding up to a block boundary (in the file; so they can be mapped), then the blocks
+	void put_blocks(std::ostream& out, whippet::_provider& provider)
+	{
+		std::vector<const hanoi_block::header*> blocks;
+		provider.blocks(&blocks, [](void* blocks, const hanoi_block::header* block)
+		{
+			reinterpret_cast<std::vector<const hanoi_block::header*>*>(blocks)->push_back(block);
+		});
+
+		put(out, static_cast<uint32_t>(blocks.size()));
+
+		// streams that can't say where they are aren't padded
+		const auto at = static_cast<int64_t>(out.tellp());
+		const uint32_t padding = at < 0 ? 0 : static_cast<uint32_t>((hanoi_block::SIZE - ((at + sizeof(uint32_t)) % hanoi_block::SIZE)) % hanoi_block::SIZE);
+
+		put(out, padding);
+		for (uint32_t i = 0; i < padding; ++i)
+			out.put(0);
+
+		for (auto block : blocks)
+			out.write(reinterpret_cast<const char*>(block), hanoi_block::SIZE);
+	}
+
+#ifndef _WIN32
+	void unmap_block(void* block)
+	{
+		munmap(block, hanoi_block::SIZE);
+	}
+
+	/// maps the blocks from the file into an aligned range; nullptr if they can't be
+	uint8_t* map_blocks(const int file, const int64_t at, const uint32_t count)
+	{
+		struct stat status;
+		if (at < 0 || 0 != (at % hanoi_block::SIZE) || 0 != fstat(file, &status))
+			return nullptr;
+
+		if (static_cast<uint64_t>(status.st_size) < static_cast<uint64_t>(at) + (static_cast<uint64_t>(count) * hanoi_block::SIZE))
+			return nullptr;
+
+		const size_t size = static_cast<size_t>(count) * hanoi_block::SIZE;
+
+		// reserve enough to find an aligned range in, then, trim it
+		auto reserved = reinterpret_cast<uint8_t*>(mmap(nullptr, size + hanoi_block::SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+		if (MAP_FAILED == reinterpret_cast<void*>(reserved))
+			return nullptr;
+
+		const auto aligned = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(reserved) + hanoi_block::SIZE - 1) & ~static_cast<uintptr_t>(hanoi_block::SIZE - 1));
+
+		if (aligned != reserved)
+			munmap(reserved, aligned - reserved);
+		if (aligned + size != reserved + size + hanoi_block::SIZE)
+			munmap(aligned + size, (reserved + size + hanoi_block::SIZE) - (aligned + size));
+
+		// private; so writes are copied (a page at a time) and never reach the file
+		if (MAP_FAILED == mmap(aligned, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, file, static_cast<off_t>(at)))
+		{
+			munmap(aligned, size);
+			return nullptr;
+		}
+
+		return aligned;
+	}
+#endif
+
+	/// the other end of put_blocks(); maps them if there's a file to map from
+	bool get_blocks(std::istream& in, whippet::_provider& provider, const int file)
+	{
+		uint32_t count, padding;
+		if (!get(in, count) || !get(in, padding) || !in.ignore(padding))
+			return false;
+
+#ifndef _WIN32
+		uint8_t* mapped = nullptr;
+
+		if (0 <= file && 0 < count)
+			mapped = map_blocks(file, static_cast<int64_t>(in.tellg()), count);
+
+		if (nullptr != mapped)
+		{
+			in.seekg(static_cast<std::streamoff>(count) * hanoi_block::SIZE, std::ios_base::cur);
+
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				auto block = reinterpret_cast<hanoi_block::header*>(mapped + (static_cast<size_t>(i) * hanoi_block::SIZE));
+
+				block->_release = unmap_block;
+				if (!provider.adopt(block))
+				{
+					// the rest haven't been adopted and their headers are still whatever was in the file; don't release() through them
+					munmap(block, static_cast<size_t>(count - i) * hanoi_block::SIZE);
+					return false;
+				}
+			}
+
+			return !!in;
+		}
+#endif
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			auto block = reinterpret_cast<hanoi_block::header*>(hanoi_block::allocate());
+
+			const bool read = !!in.read(reinterpret_cast<char*>(block), hanoi_block::SIZE);
+			block->_release = nullptr;
+
+			if (!read || !provider.adopt(block))
+			{
+				hanoi_block::release(block);
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+void whippet::universe::snapshot(std::ostream& out)
+{
+	pal__trace_span("whippet", "snapshot");
+
+	// only the guids of what's written out; the rest would never be freed in what's restored
+	snapshot_guids guids = { _guid_active, _guid_count };
+	for (auto& kv : _providers)
+		if (whippet::_provider::layout::none == kv.second->describe()._layout)
+			kv.second->visit(0, false, &guids, snapshot_guids::drop);
+
+	const snapshot_header header = {
+		SNAPSHOT_MAGIC,
+		SNAPSHOT_VERSION,
+		static_cast<uint32_t>(hanoi_block::SIZE),
+		static_cast<uint32_t>(_providers.size()),
+		guids._count,
+		static_cast<uint32_t>(guids._active.size()),
+	};
+	put(out, header);
+
+	for (auto& kv : _providers)
+		put(out, kv.second->describe());
+
+	out.write(reinterpret_cast<const char*>(guids._active.data()), sizeof(uint64_t) * guids._active.size());
+
+	for (auto& kv : _providers)
+		if (whippet::_provider::layout::blocks == kv.second->describe()._layout)
+			put_blocks(out, *kv.second);
+		else
+			kv.second->save(out);
+}
+
+bool whippet::universe::restore(std::istream& in)
+{
+	return restore_(in, -1);
+}
+
+bool whippet::universe::map(const char* path)
+{
+	std::ifstream in(path, std::ios_base::binary);
+	if (!in)
+		return false;
+
+#ifdef _WIN32
+	return restore_(in, -1);
+#else
+	const int file = open(path, O_RDONLY);
+	const bool restored = restore_(in, file);
+
+	// the mappings outlive the descriptor
+	if (0 <= file)
+		close(file);
+
+	return restored;
+#endif
+}
+
+bool whippet::universe::restore_(std::istream& in, const int file)
+{
+	pal__trace_span("whippet", "restore");
+
+	snapshot_header header;
+	if (!get(in, header) || SNAPSHOT_MAGIC != header._magic || SNAPSHOT_VERSION != header._version || hanoi_block::SIZE != header._block)
+		return false;
+
+	std::map<uint32_t, whippet::_provider*> installed;
+	for (auto& kv : _providers)
+	{
+		const auto hash = kv.second->describe()._hash;
+
+		assume(0 == installed.count(hash), "two component types have names with the same hash");
+		installed[hash] = kv.second.get();
+	}
+
+	// check everything before anything is changed
+	std::vector<whippet::_provider*> order;
+	for (uint32_t i = 0; i < header._providers; ++i)
+	{
+		whippet::_provider::schema schema;
+		if (!get(in, schema))
+			return false;
+
+		auto found = installed.find(schema._hash);
+		if (installed.end() == found || order.end() != std::find(order.begin(), order.end(), found->second))
+			return false;
+
+		const auto expected = found->second->describe();
+		if (expected._size != schema._size || expected._align != schema._align || expected._layout != schema._layout)
+			return false;
+
+		order.push_back(found->second);
+	}
+
+	// the blocks are about to be replaced; whatever was being tracked is moot
+	for (auto& kv : _providers)
+		kv.second->mark(false);
+	_marked = false;
+
+	purge_();
+
+	// nothing's left, but, the empty blocks would clash with the ones coming in
+	for (auto& kv : _providers)
+		kv.second->weed();
+
+	_guid_count = header._guids;
+	_guid_active.assign(header._words, 0);
+	bool good = !!in.read(reinterpret_cast<char*>(_guid_active.data()), sizeof(uint64_t) * header._words);
+
+	for (auto it = order.begin(); good && it != order.end(); ++it)
+		if (whippet::_provider::layout::blocks == (*it)->describe()._layout)
+			good = get_blocks(in, **it, file);
+		else
+			good = (*it)->load(in);
+
+	if (good)
+		return true;
+
+	// don't leave half a universe behind
+	purge_();
+	_guid_active.clear();
+	_guid_count = 0;
+	return false;
+}
+
+void whippet::_provider::delta_words(std::ostream& out, const std::vector<uint64_t>& now, const std::vector<uint64_t>& was)
+{
+	put(out, static_cast<uint32_t>(now.size()));
+
+	for (size_t i = 0; i < now.size(); ++i)
+		if (now[i] != (i < was.size() ? was[i] : 0))
+		{
+			put(out, static_cast<uint32_t>(i));
+			put(out, now[i]);
+		}
+
+	put(out, WORDS_END);
+}
+
+bool whippet::_provider::apply_words(std::istream& in, std::vector<uint64_t>& words)
+{
+	uint32_t size;
+	if (!get(in, size))
+		return false;
+
+	words.resize(size, 0);
+
+	for (;;)
+	{
+		uint32_t index;
+		if (!get(in, index))
+			return false;
+
+		if (WORDS_END == index)
+			return true;
+
+		if (size <= index || !get(in, words[index]))
+			return false;
+	}
+}
+
+void whippet::universe::mark(void)
+{
+	pal__trace_span("whippet", "mark");
+
+	for (auto& kv : _providers)
+		kv.second->mark(true);
+
+	_guid_marked = _guid_active;
+	_guid_marked_count = _guid_count;
+	_marked = true;
+}
+
+void whippet::universe::rollback(void)
+{
+	pal__trace_span("whippet", "rollback");
+
+	assume(_marked, "there's nothing to roll back to without mark()");
+	if (!_marked)
+		return;
+
+	// serial components are read back from what mark() wrote; so, the ones that are there now go first (while their guids are still theirs to give back)
+	for (auto& kv : _providers)
+		if (whippet::_provider::layout::serial == kv.second->describe()._layout)
+			kv.second->purge();
+
+	_guid_active = _guid_marked;
+	_guid_count = _guid_marked_count;
+
+	for (auto& kv : _providers)
+		kv.second->rollback();
+
+	guid_keep_(false);
+}
+
+void whippet::universe::delta(std::ostream& out)
+{
+	pal__trace_span("whippet", "delta");
+
+	assume(_marked, "there's nothing to compare with without mark()");
+
+	put(out, DELTA_MAGIC);
+	put(out, static_cast<uint32_t>(_providers.size()));
+	put(out, _guid_count);
+	whippet::_provider::delta_words(out, _guid_active, _guid_marked);
+
+	for (auto& kv : _providers)
+	{
+		put(out, kv.second->describe()._hash);
+		kv.second->delta(out);
+	}
+}
+
+bool whippet::universe::apply(std::istream& in)
+{
+	pal__trace_span("whippet", "apply");
+
+	// it's checked as it's read (and kept) then done from the copy; so, nothing changes unless all of it fits
+	kept_buffer kept(in);
+	std::istream through(&kept);
+	if (!apply_(through, true))
+		return false;
+
+	std::stringstream again(kept._kept);
+	const bool applied = apply_(again, false);
+	assert(applied);
+	return applied;
+}
+
+bool whippet::universe::apply_(std::istream& in, const bool check)
+{
+	uint32_t magic, providers, count;
+	if (!get(in, magic) || DELTA_MAGIC != magic || !get(in, providers) || !get(in, count))
+		return false;
+
+	// serial providers are read back whole; so, what's in them now goes first, but, their guids stay as they are (the delta only has the words that changed)
+	if (!check)
+	{
+		const auto active = _guid_active;
+		const auto taken = _guid_count;
+
+		for (auto& kv : _providers)
+			if (whippet::_provider::layout::serial == kv.second->describe()._layout)
+				kv.second->purge();
+
+		_guid_active = active;
+		_guid_count = taken;
+	}
+
+	std::vector<uint64_t> checked;
+	if (check)
+		checked = _guid_active;
+
+	if (!whippet::_provider::apply_words(in, check ? checked : _guid_active))
+		return false;
+
+	if (!check)
+		_guid_count = count;
+
+	for (uint32_t i = 0; i < providers; ++i)
+	{
+		uint32_t hash;
+		if (!get(in, hash))
+			return false;
+
+		whippet::_provider* found = nullptr;
+		for (auto& kv : _providers)
+			if (hash == kv.second->describe()._hash)
+				found = kv.second.get();
+
+		if (nullptr == found || !found->apply(in, check))
+			return false;
+	}
+
+	if (!check)
+		guid_keep_(true);
+
+	return true;
+}
+
+void whippet::universe::guid_take_(const uint32_t guid)
+{
+	if (guid_active_(guid))
+		return;
+
+	if (_guid_active.size() <= (guid >> 6))
+		_guid_active.resize((guid >> 6) + 1, 0);
+
+	_guid_active[guid >> 6] |= uint64_t(1) << (guid & 63);
+	++_guid_count;
+}
+
+void whippet::universe::guid_keep_(const bool applied)
+{
+	// components that aren't written at all are still around; the ones that still belong keep their guids, and the rest are detached
+	struct keep_t
+	{
+		whippet::universe& _world;
+		const bool _applied;
+		std::vector<whippet::_component*> _strays;
+	} keep = { *this, applied, {} };
+
+	for (auto& kv : _providers)
+		if (whippet::_provider::layout::none == kv.second->describe()._layout)
+			kv.second->visit(0, false, &keep, [](void* userdata, void* component)
+			{
+				auto& keep = *reinterpret_cast<keep_t*>(userdata);
+				auto self = reinterpret_cast<whippet::_component*>(component);
+				const auto& handle = self->_handle;
+
+				// after a rollback, one that was there at mark() still has its guid; after apply(), one is only kept if nothing else has taken its guid
+				const bool kept = keep._world.guid_active_(handle._entity._weak) && (keep._applied != keep._world.guid_active_(handle._self._weak));
+
+				if (!kept)
+					keep._strays.push_back(self);
+				else if (keep._applied)
+					keep._world.guid_take_(handle._self._weak);
+
+				return true;
+			});
+
+	// detaching gives the guid back; so, it's taken first if it's free, or taken again if it belongs to something else
+	for (auto stray : keep._strays)
+	{
+		const auto guid = stray->_handle._self._weak;
+		const bool owned = guid_active_(guid);
+
+		if (!owned)
+			guid_take_(guid);
+
+		stray->detach();
+
+		if (owned)
+			guid_take_(guid);
+	}
+}
@@ -0,0 +1,98 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+#include "whippet.hpp"
+
+#include <iomanip>
+#include <ostream>
+
+namespace
+{
+	/// type names are all we'll be writing; they only need quotes and backslashes escaped
+	void json_string(std::ostream& out, const std::string& text)
+	{
+		out << '"';
+		for (auto c : text)
+		{
+			if ('"' == c || '\\' == c)
+				out << '\\';
+			out << c;
+		}
+		out << '"';
+	}
+}
+
+void whippet::stats::print(std::ostream& out) const
+{
+	if (!_enabled)
+	{
+		out << "whippet stats: disabled (define whippet__stats)\n";
+		return;
+	}
+
+	out << "guids; activated=" << _guids._activated
+		<< " probes=" << _guids._probes
+		<< " released=" << _guids._released
+		<< " ns=" << _guids._nanoseconds
+		<< '\n';
+
+	for (auto& next : _providers)
+	{
+		out << std::setw(24) << next._name
+			<< "; emplaced=" << next._emplaced
+			<< " scanned=" << next._scanned
+			<< " skipped=" << next._skipped
+			<< " layers=" << next._layers << " (+" << next._allocated << "/-" << next._weeded << ")"
+			<< " visits=" << next._visits
+			<< " visit_scanned=" << next._visit_scanned
+			<< " callbacks=" << next._visit_callbacks
+			<< " visit_ns=" << next._visit_nanoseconds
+			<< " detached=" << next._detached
+			<< " entity_scanned=" << next._entity_scanned
+			<< '\n';
+	}
+}
+
+void whippet::stats::json(std::ostream& out) const
+{
+	out << "{\"enabled\":" << (_enabled ? "true" : "false");
+
+	out << ",\"guids\":{"
+		<< "\"activated\":" << _guids._activated
+		<< ",\"probes\":" << _guids._probes
+		<< ",\"released\":" << _guids._released
+		<< ",\"nanoseconds\":" << _guids._nanoseconds
+		<< '}';
+
+	out << ",\"providers\":[";
+	for (size_t i = 0; i < _providers.size(); ++i)
+	{
+		auto& next = _providers[i];
+
+		out << (i ? ",{" : "{") << "\"name\":";
+		json_string(out, next._name);
+		out << ",\"emplaced\":" << next._emplaced
+			<< ",\"scanned\":" << next._scanned
+			<< ",\"skipped\":" << next._skipped
+			<< ",\"allocated\":" << next._allocated
+			<< ",\"weeded\":" << next._weeded
+			<< ",\"layers\":" << next._layers
+			<< ",\"visits\":" << next._visits
+			<< ",\"visit_scanned\":" << next._visit_scanned
+			<< ",\"visit_callbacks\":" << next._visit_callbacks
+			<< ",\"visit_nanoseconds\":" << next._visit_nanoseconds
+			<< ",\"detached\":" << next._detached
+			<< ",\"entity_scanned\":" << next._entity_scanned
+			<< '}';
+	}
+	out << "]}";
+}
@@ -13,6 +13,9 @@
 #include "whippet.hpp"
 
 whippet::universe::universe(void) :
+	_guid_count(0),
+	_guid_marked_count(0),
+	_marked(false),
 	_systems(nullptr)
 {
 }
@@ -22,28 +25,91 @@ whippet::entity whippet::universe::create(void)
 	return whippet::entity(this, guid_activate());
 }
 
+bool whippet::universe::guid_active_(const uint32_t guid) const
+{
+	const uint32_t word = guid >> 6;
+
+	return word < _guid_active.size() && (_guid_active[word] & (uint64_t(1) << (guid & 63)));
+}
+
 whippet::guid_t whippet::universe::guid_activate(void)
 {
-	uint32_t next = 1 + (uint32_t)_guid_active.size();
+	whippet__count(const auto started = std::chrono::steady_clock::now());
+
+	uint32_t next = 1 + _guid_count;
 
-	while (_guid_active.end() != _guid_active.find(next))
+	whippet__count(++_guid_stats._probes);
+	while (guid_active_(next))
+	{
 		--next;
+		whippet__count(++_guid_stats._probes);
+	}
 
 	assert(0 != next);
 
-	_guid_active.emplace(next);
+	if (_guid_active.size() <= (next >> 6))
+		_guid_active.resize((next >> 6) + 1, 0);
+
+	_guid_active[next >> 6] |= uint64_t(1) << (next & 63);
+	++_guid_count;
+
+	whippet__count(++_guid_stats._activated);
+	whippet__count(_guid_stats._nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
 
 	return next;
 }
 
+void whippet::universe::guid_activate(uint32_t* guids, const size_t count)
+{
+	whippet__count(const auto started = std::chrono::steady_clock::now());
+
+	// there are (at least) `count` free guids at or below this; they're gathered from there down, a word at a time
+	const uint64_t top = uint64_t(_guid_count) + count;
+	assert(top <= UINT32_MAX);
+
+	if (_guid_active.size() <= (top >> 6))
+		_guid_active.resize((top >> 6) + 1, 0);
+
+	size_t found = 0;
+	for (uint64_t word = top >> 6; found < count; --word)
+	{
+		uint64_t free = ~_guid_active[word];
+
+		// nothing above the top, and, never 0
+		if ((top >> 6) == word && 63 != (top & 63))
+			free &= (uint64_t(2) << (top & 63)) - 1;
+		if (0 == word)
+			free &= ~uint64_t(1);
+
+		uint64_t taken = 0;
+		for (; 0 != free && found < count; free &= free - 1)
+		{
+			taken |= free & (~free + 1);
+			guids[found++] = static_cast<uint32_t>((word << 6) | pal::lowest_bit(free));
+		}
+
+		_guid_active[word] |= taken;
+		whippet__count(++_guid_stats._probes);
+
+		assert(0 != word || found == count);
+	}
+
+	_guid_count += static_cast<uint32_t>(count);
+
+	whippet__count(_guid_stats._activated += count);
+	whippet__count(_guid_stats._nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
+}
+
 void whippet::universe::guid_release(whippet::guid_t guid)
 {
 	// we can only release "live" guid values (obviously)
-	assert(_guid_active.end() != _guid_active.find(guid));
+	assert(guid_active_(guid._weak));
 
-	_guid_active.erase(_guid_active.find(guid));
+	_guid_active[guid._weak >> 6] &= ~(uint64_t(1) << (guid._weak & 63));
+	--_guid_count;
+	whippet__count(++_guid_stats._released);
 
-	assert(_guid_active.end() == _guid_active.find(guid));
+	assert(!guid_active_(guid._weak));
 }
 
 void whippet::universe::visit_(const whippet::guid_t entity_guid, const std::type_index provider_type, void* userdata, bool(*callback)(void*, void*))
@@ -51,18 +117,34 @@ void whippet::universe::visit_(const whippet::guid_t entity_guid, const std::typ
 	assert((std::type_index(typeid(whippet::_component)) == provider_type) || _providers.contains(provider_type));
 
 	if (std::type_index(typeid(whippet::_component)) != provider_type)
-		_providers[provider_type]->visit(
+	{
+		auto& provider = _providers[provider_type];
+
+		pal__trace_span("whippet.visit", provider_type.name());
+		whippet__count(const auto started = std::chrono::steady_clock::now());
+		provider->visit(
 			entity_guid, false,
 			userdata, callback
 		);
+		whippet__count(++provider->_counters._visits);
+		whippet__count(provider->_counters._visit_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
+	}
 	else
 		for (auto& provider : _providers)
-			// allow the inners to break out of the full-visit
-			if (!provider.second->visit(
+		{
+			pal__trace_span("whippet.visit", provider.first.name());
+			whippet__count(const auto started = std::chrono::steady_clock::now());
+			const bool more = provider.second->visit(
 				entity_guid, true,
 				userdata, callback
-			))
+			);
+			whippet__count(++provider.second->_counters._visits);
+			whippet__count(provider.second->_counters._visit_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
+
+			// allow the inners to break out of the full-visit
+			if (!more)
 				return;
+		}
 }
 
 bool whippet::universe::installed_(std::type_index kind)const
@@ -72,15 +154,44 @@ bool whippet::universe::installed_(std::type_index kind)const
 
 void whippet::universe::weed(void)
 {
+	pal__trace_span("whippet", "weed");
+
 	for (auto& kv : _providers)
 		kv.second->weed();
 }
 
-whippet::universe::~universe(void)
+whippet::stats whippet::universe::stats(void)
+{
+	whippet::stats snapshot = {};
+
+#ifdef whippet__stats
+	snapshot._enabled = true;
+	snapshot._guids = _guid_stats;
+
+	for (auto& kv : _providers)
+	{
+		auto counters = kv.second->_counters;
+
+		counters._name = kv.first.name();
+		kv.second->report(counters);
+
+		snapshot._providers.push_back(counters);
+	}
+#endif
+
+	return snapshot;
+}
+
+void whippet::universe::purge_(void)
 {
-	// clear out components
 	for (auto& kv : _providers)
 		kv.second->purge();
+}
+
+whippet::universe::~universe(void)
+{
+	// clear out components
+	purge_();
 
 	// cleanup entities & components
 	_providers.clear();
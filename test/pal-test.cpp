@@ -0,0 +1,1091 @@
+//Whippet; A container for entity component systems.
+//Copyright (C) 2017-2018 Peter LaValle / gmail
+//
+//This program is free software: you can redistribute it and/or modify it under the terms of the GNU Affero General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+//
+//This program is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+//See the GNU Affero General Public License for more details.
+//
+//You should have received a copy of the GNU Affero General Public License (agpl-3.0.txt) along with this program.
+//If not, see <https://www.gnu.org/licenses/>.
+
+
+#include <pal.hpp>
+
+#include <atomic>
+
+namespace
+{
+	/// counts how it's made (and has no default constructor)
+	struct tracked
+	{
+		static std::atomic<int> _copies;
+		static std::atomic<int> _moves;
+		static std::atomic<int> _alive;
+
+		uint64_t _value;
+
+		tracked(const uint64_t a, const uint64_t b) : _value(a * 1000 + b) { ++_alive; }
+		tracked(const tracked& other) : _value(other._value) { ++_copies; ++_alive; }
+		tracked(tracked&& other) : _value(other._value) { ++_moves; ++_alive; }
+		~tracked(void) { --_alive; }
+
+		tracked& operator=(const tracked& other) { _value = other._value; ++_copies; return *this; }
+	};
+
+	std::atomic<int> tracked::_copies(0);
+	std::atomic<int> tracked::_moves(0);
+	std::atomic<int> tracked::_alive(0);
+
+	/// a message for whoever is listening to its topic
+	struct topical
+	{
+		uint32_t _topic;
+		uint64_t _value;
+	};
+}
+
+namespace pal
+{
+	template<>
+	struct event_key<topical>
+	{
+		static const bool enabled = true;
+
+		static uint32_t key(const topical& message) { return message._topic; }
+	};
+
+	template<>
+	struct event_lane<topical>
+	{
+		static size_t lane(const topical& message) { return static_cast<size_t>(message._value >> 32); }
+	};
+}
+
+#define pal_event_manager_E uint64_t
+#define pal_event_manager_cpp
+#include <pal.inc.event_manager.hpp>
+
+// tracked and topical are local to this file; so, the parts of their event_managers that aren't used here would be warned about
+#define pal_event_manager_E tracked
+#undef pal_event_manager_cpp
+#define pal_event_manager_cpp [[maybe_unused]]
+#include <pal.inc.event_manager.hpp>
+
+#define pal_event_manager_E topical
+#define pal_event_manager_cpp [[maybe_unused]]
+#include <pal.inc.event_manager.hpp>
+
+#include "gtest/gtest.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/// the same as zlib's; at compile time, from text, and through the kernels (however the bytes line up)
+TEST(pal, adler)
+{
+	static_assert(0x11E60398 == pal::adler::sum("Wikipedia")._weak, "folds at compile time");
+
+	ASSERT_EQ(0x00000001u, pal::adler() << "");
+	ASSERT_EQ(0x00620062u, pal::adler() << "a");
+	ASSERT_EQ(0x024D0127u, pal::adler() << "abc");
+	ASSERT_EQ(0x29750586u, pal::adler() << "message digest");
+	ASSERT_EQ(0x90860B20u, pal::adler() << "abcdefghijklmnopqrstuvwxyz");
+	ASSERT_EQ(0x90860B20u, pal::adler()(26, "abcdefghijklmnopqrstuvwxyz"));
+
+	std::vector<char> pattern(100000), full(100000, static_cast<char>(0xFF));
+	for (size_t i = 0; i < pattern.size(); ++i)
+		pattern[i] = static_cast<char>((i * 7 + i / 251) % 256);
+
+	ASSERT_EQ(0xB3AE95BCu, pal::adler()(pattern.size(), pattern.data()));
+	ASSERT_EQ(0xF255A14Fu, pal::adler()(99001, pattern.data() + 37));
+	ASSERT_EQ(0x149A302Cu, pal::adler()(full.size(), full.data()));
+	ASSERT_EQ(0x149A302Cu, pal::adler().scalar(full.size(), full.data()));
+
+	for (size_t offset = 0; offset < 33; ++offset)
+		for (size_t size : { 0, 1, 15, 16, 17, 31, 32, 33, 5551, 5552, 5553, 11104, 20000 })
+		{
+			const auto* bytes = pattern.data() + offset;
+			ASSERT_EQ(pal::adler().scalar(size, bytes), pal::adler()(size, bytes));
+
+			// in two goes
+			const auto half = pal::adler()(size / 2, bytes);
+			ASSERT_EQ(pal::adler()(size, bytes), half(size - size / 2, bytes + size / 2));
+		}
+}
+
+/// spans from two threads end up in the dump
+TEST(pal, trace)
+{
+	pal::trace::clear();
+
+	{
+		pal::trace::span outer("test", "outer");
+		pal::trace::span inner("test", "in\"ner");
+	}
+
+	std::thread([]
+	{
+		pal::trace::span other("test", "other");
+	}).join();
+
+	const char* path = "pal-test-trace.json";
+	ASSERT_TRUE(pal::trace::dump(path));
+
+	std::ifstream file(path);
+	std::stringstream text;
+	text << file.rdbuf();
+
+	ASSERT_EQ(0, text.str().find("{\"traceEvents\":["));
+	ASSERT_NE(std::string::npos, text.str().find("\"name\":\"outer\""));
+	ASSERT_NE(std::string::npos, text.str().find("\"name\":\"in\\\"ner\""));
+	ASSERT_NE(std::string::npos, text.str().find("\"name\":\"other\""));
+	ASSERT_NE(std::string::npos, text.str().find("\"ph\":\"X\""));
+
+	remove(path);
+}
+
+/// a thread that's exited hands its ring on; threads run one after another all trace under one tid
+TEST(pal, trace_reuse)
+{
+	pal::trace::clear();
+
+	for (int i = 0; i < 8; ++i)
+		std::thread([]
+		{
+			pal::trace::span reused("test", "reused");
+		}).join();
+
+	const char* path = "pal-test-trace-reuse.json";
+	ASSERT_TRUE(pal::trace::dump(path));
+
+	std::ifstream file(path);
+	std::string line;
+	std::vector<std::string> tids;
+	while (std::getline(file, line))
+		if (std::string::npos != line.find("\"name\":\"reused\""))
+		{
+			const auto tid = line.find("\"tid\":");
+			ASSERT_NE(std::string::npos, tid);
+			tids.push_back(line.substr(tid, line.find(',', tid) - tid));
+		}
+
+	ASSERT_EQ(8u, tids.size());
+	for (auto& tid : tids)
+		ASSERT_EQ(tids.front(), tid);
+
+	remove(path);
+}
+
+namespace
+{
+	/// keeps what it's sent
+	struct recorder
+	{
+		pal::event_manager<uint64_t>* _events;
+		std::vector<uint64_t> _messages;
+
+		static void record(recorder* self, const uint64_t& message)
+		{
+			self->_messages.push_back(message);
+		}
+
+		/// sends 1 to 100 in reply to 0, and 1000 in reply to 50
+		static void reply(recorder* self, const uint64_t& message)
+		{
+			self->_messages.push_back(message);
+
+			if (0 == message)
+				for (uint64_t i = 1; i <= 100; ++i)
+					self->_events->broadcast(i);
+
+			if (50 == message)
+				self->_events->broadcast(1000);
+		}
+	};
+
+	/// keeps what it's sent and which thread it was called on
+	struct witness
+	{
+		std::vector<uint64_t> _messages;
+		std::vector<std::thread::id> _threads;
+		std::atomic<size_t> _seen;
+
+		/// (if set) holds the first message until the other witness has seen this many
+		const witness* _after;
+		size_t _count;
+		bool _late;
+
+		witness(void) : _seen(0), _after(nullptr), _count(0), _late(false) {}
+
+		static void record(witness* self, const uint64_t& message)
+		{
+			if (self->_after && self->_messages.empty())
+			{
+				const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+				while (self->_after->_seen < self->_count && std::chrono::steady_clock::now() < deadline)
+					std::this_thread::yield();
+
+				self->_late = self->_after->_seen < self->_count;
+			}
+
+			self->_messages.push_back(message);
+			self->_threads.push_back(std::this_thread::get_id());
+			++self->_seen;
+		}
+	};
+
+	/// holds the first message it's sent until it's opened
+	struct gate
+	{
+		std::atomic<bool> _entered;
+		std::atomic<bool> _open;
+		std::vector<uint64_t> _messages;
+
+		gate(void) : _entered(false), _open(false) {}
+
+		static void hold(gate* self, const uint64_t& message)
+		{
+			self->_messages.push_back(message);
+			self->_entered = true;
+
+			while (!self->_open)
+				std::this_thread::yield();
+		}
+	};
+
+	/// keeps the values of the tracked messages it's sent
+	struct values
+	{
+		std::vector<uint64_t> _values;
+
+		static void record(values* self, const tracked& message)
+		{
+			self->_values.push_back(message._value);
+		}
+	};
+
+	/// counts what it's sent, from whichever thread
+	struct tally
+	{
+		std::atomic<uint64_t> _count;
+
+		tally(void) : _count(0) {}
+
+		static void count(tally* self, const uint64_t&)
+		{
+			++self->_count;
+		}
+	};
+
+	/// on 5, swaps one tally for another
+	struct rewire
+	{
+		pal::event_manager<uint64_t>* _events;
+		tally* _detach;
+		tally* _attach;
+
+		static void on(rewire* self, const uint64_t& message)
+		{
+			if (5 != message)
+				return;
+
+			self->_events->detach(self->_detach, tally::count);
+			self->_events->attach(self->_attach, tally::count);
+		}
+	};
+
+	/// on the first message, waits until it's being detached and then attaches another
+	struct reattach
+	{
+		pal::event_manager<uint64_t>* _events;
+		tally* _attach;
+		std::atomic<bool> _entered;
+		std::atomic<bool> _detaching;
+
+		reattach(void) : _events(nullptr), _attach(nullptr), _entered(false), _detaching(false) {}
+
+		static void on(reattach* self, const uint64_t&)
+		{
+			if (self->_entered.exchange(true))
+				return;
+
+			while (!self->_detaching)
+				std::this_thread::yield();
+
+			// long enough for detach() to be waiting on this
+			std::this_thread::sleep_for(std::chrono::milliseconds(20));
+			self->_events->attach(self->_attach, tally::count);
+		}
+	};
+
+	/// counts the topical messages it's sent, and those that weren't for its topic
+	struct listener
+	{
+		uint32_t _topic;
+		std::atomic<uint64_t> _count;
+		std::atomic<uint64_t> _wrong;
+
+		listener(void) : _topic(0), _count(0), _wrong(0) {}
+
+		static void hear(listener* self, const topical& message)
+		{
+			++self->_count;
+			if (message._topic != self->_topic)
+				++self->_wrong;
+		}
+	};
+
+	/// keeps the values of the topical messages it's sent, and holds the first until it's opened
+	struct sequence
+	{
+		std::atomic<bool> _entered;
+		std::atomic<bool> _open;
+		std::vector<uint64_t> _values;
+
+		sequence(void) : _entered(false), _open(false) {}
+
+		static void record(sequence* self, const topical& message)
+		{
+			self->_values.push_back(message._value);
+			self->_entered = true;
+
+			while (!self->_open)
+				std::this_thread::yield();
+		}
+	};
+
+	/// deletes a journal's segments
+	void forget(const char* path)
+	{
+		for (int i = 0; i < 64; ++i)
+			remove((std::string(path) + "." + std::to_string(i)).c_str());
+	}
+
+	/// keeps what a journal replays
+	void replayed(void* data, const void* record)
+	{
+		uint64_t value;
+		memcpy(&value, record, sizeof(value));
+		reinterpret_cast<std::vector<uint64_t>*>(data)->push_back(value);
+	}
+
+	/// the last message it saw
+	struct latest
+	{
+		std::atomic<uint64_t> _message;
+
+		latest(void) : _message(~0ull) {}
+
+		static void see(latest* self, const uint64_t& message)
+		{
+			self->_message = message;
+		}
+	};
+}
+
+/// producers racing through a small ring; every handler sees everything, and each producer's messages stay in order
+TEST(pal, event_manager)
+{
+	const uint64_t PRODUCERS = 4;
+	const uint64_t EACH = 10000;
+
+	recorder first, second;
+	{
+		pal::event_manager<uint64_t> events(64);
+		events.attach(&first, recorder::record);
+		events.attach(&second, recorder::record);
+		events.attach(&second, recorder::record);
+
+		std::vector<std::thread> producers;
+		for (uint64_t p = 0; p < PRODUCERS; ++p)
+			producers.emplace_back([&events, p]
+			{
+				for (uint64_t i = 0; i < EACH; ++i)
+					events.broadcast((p << 32) | i);
+			});
+
+		for (auto& producer : producers)
+			producer.join();
+
+		// the destructor sends whatever is left
+	}
+
+	for (auto* handler : { &first, &second })
+	{
+		ASSERT_EQ(PRODUCERS * EACH, handler->_messages.size());
+
+		std::vector<uint64_t> next(PRODUCERS, 0);
+		for (auto message : handler->_messages)
+			ASSERT_EQ(next[message >> 32]++, message & 0xFFFFFFFF);
+	}
+}
+
+/// a handler broadcasting more than the ring holds doesn't wait on itself, and its messages keep their order
+TEST(pal, event_manager_reply)
+{
+	recorder handler;
+	{
+		pal::event_manager<uint64_t> events(4);
+		handler._events = &events;
+		events.attach(&handler, recorder::reply);
+		events.broadcast(0);
+	}
+
+	ASSERT_EQ(102, handler._messages.size());
+	for (uint64_t i = 0; i <= 100; ++i)
+		ASSERT_EQ(i, handler._messages[i]);
+	ASSERT_EQ(1000, handler._messages[101]);
+}
+
+/// each affinity gets its thread, everyone gets everything in order, and a held-up dedicated handler doesn't hold up the event thread
+TEST(pal, event_manager_dispatch)
+{
+	const uint64_t COUNT = 1000;
+
+	witness event_thread, dedicated, pool_a, pool_b, caller;
+	dedicated._after = &event_thread;
+	dedicated._count = COUNT;
+	{
+		pal::event_manager<uint64_t> events(64, 2);
+		events.attach(&event_thread, witness::record);
+		events.attach(&dedicated, witness::record, pal::dispatch(pal::dispatch::affinity::dedicated, pal::dispatch::backpressure::block, COUNT));
+		events.attach(&pool_a, witness::record, pal::dispatch(pal::dispatch::affinity::pool));
+		events.attach(&pool_b, witness::record, pal::dispatch(pal::dispatch::affinity::pool));
+		events.attach(&caller, witness::record, pal::dispatch(pal::dispatch::affinity::caller));
+
+		for (uint64_t i = 0; i < COUNT; ++i)
+			events.broadcast(i);
+
+		// every caller message was handled before broadcast() returned
+		ASSERT_EQ(COUNT, caller._messages.size());
+
+	}
+
+	// the dedicated handler held its first message until the event thread's had them all
+	ASSERT_FALSE(dedicated._late);
+
+	for (auto* handler : { &event_thread, &dedicated, &pool_a, &pool_b, &caller })
+	{
+		ASSERT_EQ(COUNT, handler->_messages.size());
+		for (uint64_t i = 0; i < COUNT; ++i)
+			ASSERT_EQ(i, handler->_messages[i]);
+	}
+
+	const auto main = std::this_thread::get_id();
+	for (auto thread : caller._threads)
+		ASSERT_EQ(main, thread);
+	for (auto thread : event_thread._threads)
+		ASSERT_EQ(event_thread._threads[0], thread);
+	for (auto thread : dedicated._threads)
+		ASSERT_EQ(dedicated._threads[0], thread);
+
+	ASSERT_NE(main, event_thread._threads[0]);
+	ASSERT_NE(main, dedicated._threads[0]);
+	ASSERT_NE(event_thread._threads[0], dedicated._threads[0]);
+	for (auto* pool : { &pool_a, &pool_b })
+		for (auto thread : pool->_threads)
+		{
+			ASSERT_NE(main, thread);
+			ASSERT_NE(event_thread._threads[0], thread);
+			ASSERT_NE(dedicated._threads[0], thread);
+		}
+}
+
+/// a held-up handler's queue drops the oldest messages, or, keeps replacing the newest
+TEST(pal, event_manager_backpressure)
+{
+	for (auto full : { pal::dispatch::backpressure::drop_oldest, pal::dispatch::backpressure::coalesce })
+	{
+		gate slow;
+		latest seen;
+		{
+			pal::event_manager<uint64_t> events;
+			events.attach(&slow, gate::hold, pal::dispatch(pal::dispatch::affinity::dedicated, full, 4));
+			events.attach(&seen, latest::see);
+
+			events.broadcast(0);
+			while (!slow._entered)
+				std::this_thread::yield();
+
+			// once the event thread has seen 100 it has queued (or not) everything before it
+			for (uint64_t i = 1; i <= 100; ++i)
+				events.broadcast(i);
+			while (100 != seen._message)
+				std::this_thread::yield();
+
+			slow._open = true;
+		}
+
+		const std::vector<uint64_t> expected = (pal::dispatch::backpressure::drop_oldest == full)
+			? std::vector<uint64_t>({ 0, 97, 98, 99, 100 })
+			: std::vector<uint64_t>({ 0, 1, 2, 3, 100 });
+
+		ASSERT_EQ(expected, slow._messages);
+	}
+}
+
+/// a held-up handler's queue of keyed messages replaces the newest one with the same key, which keeps its place
+TEST(pal, event_manager_backpressure_keyed)
+{
+	struct held
+	{
+		gate _gate;
+		std::atomic<uint64_t> _seen;
+
+		static void hold(held* self, const topical& message)
+		{
+			gate::hold(&(self->_gate), message._value);
+		}
+
+		static void see(held* self, const topical& message)
+		{
+			self->_seen = message._value;
+		}
+	};
+
+	held slow;
+	slow._seen = 0;
+	{
+		pal::event_manager<topical> events;
+		events.attach(&slow, held::hold, pal::dispatch(pal::dispatch::affinity::dedicated, pal::dispatch::backpressure::coalesce, 4));
+		events.attach(&slow, held::see);
+
+		events.broadcast(topical{ 0, 0 });
+		while (!slow._gate._entered)
+			std::this_thread::yield();
+
+		// four topics, one after another; the queue fills with the first of each, then, each is replaced by the latest
+		for (uint64_t i = 1; i <= 100; ++i)
+			events.broadcast(topical{ static_cast<uint32_t>(i % 4), i });
+		while (100 != slow._seen)
+			std::this_thread::yield();
+
+		slow._gate._open = true;
+	}
+
+	ASSERT_EQ(std::vector<uint64_t>({ 0, 97, 98, 99, 100 }), slow._gate._messages);
+}
+
+/// emplaced and moved messages aren't copied, copies are copied once, batches bigger than the ring get through, and everything's destroyed
+TEST(pal, event_manager_emplace)
+{
+	tracked::_copies = 0;
+	tracked::_moves = 0;
+
+	values handler;
+	{
+		pal::event_manager<tracked> events(8);
+		events.attach(&handler, values::record);
+
+		events.emplace_broadcast(1, 2);
+		ASSERT_EQ(0, tracked::_copies);
+		ASSERT_EQ(0, tracked::_moves);
+
+		tracked moved(3, 4);
+		events.broadcast(std::move(moved));
+		ASSERT_EQ(0, tracked::_copies);
+		ASSERT_EQ(1, tracked::_moves);
+
+		const tracked copied(5, 6);
+		events.broadcast(copied);
+		ASSERT_EQ(1, tracked::_copies);
+
+		std::vector<tracked> batch;
+		batch.reserve(100);
+		for (uint64_t i = 0; i < 100; ++i)
+			batch.emplace_back(7, i);
+
+		events.broadcast_batch(batch.data(), batch.size());
+		ASSERT_EQ(101, tracked::_copies);
+		ASSERT_EQ(1, tracked::_moves);
+	}
+
+	ASSERT_EQ(103, handler._values.size());
+	ASSERT_EQ(1002, handler._values[0]);
+	ASSERT_EQ(3004, handler._values[1]);
+	ASSERT_EQ(5006, handler._values[2]);
+	for (uint64_t i = 0; i < 100; ++i)
+		ASSERT_EQ(7000 + i, handler._values[3 + i]);
+
+	// the ring destroyed each message once it had been handled
+	ASSERT_EQ(0, tracked::_alive);
+}
+
+/// a handler can attach and detach others; the detached one isn't called again (not even for the rest of this message) and the attached one starts with the next message
+TEST(pal, event_manager_rewire)
+{
+	tally before, after;
+	rewire handler;
+	{
+		pal::event_manager<uint64_t> events;
+		handler._events = &events;
+		handler._detach = &before;
+		handler._attach = &after;
+
+		events.attach(&before, tally::count);
+		events.attach(&handler, rewire::on);
+
+		for (uint64_t i = 0; i < 100; ++i)
+			events.broadcast(i);
+	}
+
+	// handlers are called in order of their code's address
+	const bool first = reinterpret_cast<size_t>(&tally::count) < reinterpret_cast<size_t>(&rewire::on);
+
+	ASSERT_EQ(first ? 6 : 5, before._count);
+	ASSERT_EQ(94, after._count);
+}
+
+/// once detach() returns the handler isn't called again, whichever thread it was on
+TEST(pal, event_manager_detach)
+{
+	for (auto affinity : { pal::dispatch::affinity::event_thread, pal::dispatch::affinity::dedicated, pal::dispatch::affinity::pool, pal::dispatch::affinity::caller })
+	{
+		tally subject, marker;
+
+		pal::event_manager<uint64_t> events(64, 2);
+		events.attach(&subject, tally::count, pal::dispatch(affinity));
+		events.attach(&marker, tally::count);
+
+		std::atomic<bool> stop(false);
+		std::thread producer([&events, &stop]
+		{
+			while (!stop)
+				events.broadcast(1);
+		});
+
+		while (subject._count < 1000)
+			std::this_thread::yield();
+
+		events.detach(&subject, tally::count);
+		const uint64_t detached = subject._count;
+
+		// plenty more go past
+		const uint64_t marked = marker._count;
+		while (marker._count < marked + 1000)
+			std::this_thread::yield();
+
+		stop = true;
+		producer.join();
+
+		ASSERT_EQ(detached, subject._count);
+	}
+}
+
+/// a handler can attach another while some other thread is detaching it, whichever thread it's on
+TEST(pal, event_manager_detach_reentrant)
+{
+	for (auto affinity : { pal::dispatch::affinity::event_thread, pal::dispatch::affinity::dedicated, pal::dispatch::affinity::pool, pal::dispatch::affinity::caller })
+	{
+		tally other;
+		reattach handler;
+
+		pal::event_manager<uint64_t> events(64, 2);
+		handler._events = &events;
+		handler._attach = &other;
+		events.attach(&handler, reattach::on, pal::dispatch(affinity));
+
+		std::thread producer([&events]
+		{
+			events.broadcast(1);
+		});
+
+		while (!handler._entered)
+			std::this_thread::yield();
+
+		handler._detaching = true;
+		events.detach(&handler, reattach::on);
+		producer.join();
+
+		// the one it attached is called from then on
+		events.broadcast(2);
+		while (0 == other._count)
+			std::this_thread::yield();
+	}
+}
+
+/// attaching and detaching (of every affinity) while messages flow doesn't stall, crash or leak
+TEST(pal, event_manager_churn)
+{
+	const size_t HANDLERS = 8;
+	const size_t ROUNDS = 50;
+
+	tally handlers[HANDLERS];
+	{
+		pal::event_manager<uint64_t> events(64, 2);
+
+		std::atomic<bool> stop(false);
+		std::thread producer([&events, &stop]
+		{
+			while (!stop)
+				events.broadcast(1);
+		});
+
+		for (size_t round = 0; round < ROUNDS; ++round)
+		{
+			for (size_t i = 0; i < HANDLERS; ++i)
+				events.attach(&handlers[i], tally::count, pal::dispatch(static_cast<pal::dispatch::affinity>(i % 4)));
+
+			for (size_t i = 0; i < HANDLERS; ++i)
+				events.detach(&handlers[i], tally::count);
+		}
+
+		stop = true;
+		producer.join();
+	}
+}
+
+/// keyed handlers only see their own topic, wildcards see everything, and one handler can listen to several topics
+TEST(pal, event_manager_topics)
+{
+	const uint32_t TOPICS = 100;
+	const uint32_t UNHEARD = 10;
+
+	listener each[TOPICS], wildcard, both;
+	{
+		pal::event_manager<topical> events(64);
+		events.attach(&wildcard, listener::hear);
+
+		for (uint32_t topic = 0; topic < TOPICS; ++topic)
+		{
+			each[topic]._topic = topic;
+			events.attach(&each[topic], listener::hear, topic);
+		}
+
+		// these are called with the broadcast()
+		both._topic = 7;
+		events.attach(&both, listener::hear, 7, pal::dispatch(pal::dispatch::affinity::caller));
+		events.attach(&both, listener::hear, 8, pal::dispatch(pal::dispatch::affinity::caller));
+		events.attach(&both, listener::hear, 8, pal::dispatch(pal::dispatch::affinity::caller));
+
+		for (uint32_t topic = 0; topic < TOPICS + UNHEARD; ++topic)
+			events.broadcast(topical{ topic, topic });
+
+		events.detach(&each[3], listener::hear, 3);
+		events.detach(&both, listener::hear, 8);
+
+		for (uint32_t topic = 0; topic < TOPICS + UNHEARD; ++topic)
+			events.broadcast(topical{ topic, topic });
+	}
+
+	ASSERT_EQ(2 * (TOPICS + UNHEARD), wildcard._count);
+
+	for (uint32_t topic = 0; topic < TOPICS; ++topic)
+	{
+		ASSERT_EQ(3 == topic ? 1 : 2, each[topic]._count);
+		ASSERT_EQ(0, each[topic]._wrong);
+	}
+
+	ASSERT_EQ(3, both._count);
+	ASSERT_EQ(1, both._wrong);
+}
+
+/// timers go off no sooner than they're due, repeat until they're cancelled, and those cancelled (or left over) never go off
+TEST(pal, event_manager_timers)
+{
+	using clock = std::chrono::steady_clock;
+
+	const uint64_t TIMERS = 1000;
+
+	struct stamps
+	{
+		std::vector<std::pair<uint64_t, clock::time_point>> _seen;
+		std::atomic<size_t> _repeats;
+
+		static void stamp(stamps* self, const uint64_t& message)
+		{
+			self->_seen.emplace_back(message, clock::now());
+			self->_repeats += TIMERS == message;
+		}
+	} handler;
+	handler._repeats = 0;
+
+	const auto start = clock::now();
+	{
+		pal::event_manager<uint64_t> events(64);
+		events.attach(&handler, stamps::stamp);
+
+		// spread over the first two levels of the wheel, in no particular order
+		for (uint64_t i = 0; i < TIMERS; ++i)
+		{
+			const uint64_t delay = (i * 37) % 200;
+			auto timer = events.broadcast_at(start + std::chrono::milliseconds(delay), i);
+
+			if (0 == i % 10)
+			{
+				ASSERT_TRUE(events.cancel(timer));
+			}
+		}
+
+		auto every = events.broadcast_every(std::chrono::milliseconds(20), TIMERS);
+		auto never = events.broadcast_at(start + std::chrono::hours(1), TIMERS + 1);
+
+		const auto deadline = clock::now() + std::chrono::seconds(10);
+		while (clock::now() < deadline)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+			if (clock::now() - start > std::chrono::milliseconds(250) && 3 <= handler._repeats)
+				break;
+		}
+
+		ASSERT_TRUE(events.cancel(every));
+		ASSERT_FALSE(events.cancel(every));
+
+		// the handle still names the slot, but not what it's reused for
+		auto reused = events.broadcast_at(start + std::chrono::hours(1), TIMERS + 2);
+		ASSERT_FALSE(events.cancel(every));
+		ASSERT_TRUE(events.cancel(reused));
+
+		(void)never;
+	}
+
+	std::vector<bool> fired(TIMERS, false);
+	size_t repeats = 0;
+	for (auto& seen : handler._seen)
+	{
+		ASSERT_GT(TIMERS + 1, seen.first);
+
+		if (TIMERS == seen.first)
+		{
+			++repeats;
+			continue;
+		}
+
+		ASSERT_NE(0, seen.first % 10);
+		ASSERT_FALSE(fired[seen.first]);
+		fired[seen.first] = true;
+
+		ASSERT_LE(start + std::chrono::milliseconds((seen.first * 37) % 200), seen.second);
+	}
+
+	for (uint64_t i = 0; i < TIMERS; ++i)
+		ASSERT_EQ(0 != i % 10, fired[i]);
+
+	ASSERT_LE(3, repeats);
+}
+
+/// with the event thread held up, whatever's waiting in the urgent lane goes first; or with weights, the lanes take turns
+TEST(pal, event_manager_lanes)
+{
+	const uint64_t EACH = 12;
+
+	for (auto order : { pal::lanes::order::strict, pal::lanes::order::weighted })
+	{
+		pal::lanes how(2, order);
+		how._weights[1] = 3;
+
+		sequence handler;
+		{
+			pal::event_manager<topical> events(64, 0, how);
+			events.attach(&handler, sequence::record);
+
+			events.broadcast(topical{ 0, 0 });
+			while (!handler._entered)
+				std::this_thread::yield();
+
+			for (uint64_t i = 1; i <= EACH; ++i)
+			{
+				events.broadcast(topical{ 0, (1ull << 32) | i });
+				events.broadcast(topical{ 0, i });
+			}
+
+			handler._open = true;
+		}
+
+		ASSERT_EQ(1 + 2 * EACH, handler._values.size());
+
+		std::vector<size_t> lanes;
+		std::vector<uint64_t> next(2, 1);
+		for (size_t i = 1; i < handler._values.size(); ++i)
+		{
+			const auto lane = static_cast<size_t>(handler._values[i] >> 32);
+			ASSERT_EQ(next[lane]++, handler._values[i] & 0xFFFFFFFF);
+			lanes.push_back(lane);
+		}
+
+		// weighted, the first message used lane 0's turn
+		for (size_t i = 0; i < lanes.size(); ++i)
+			if (pal::lanes::order::strict == order)
+				ASSERT_EQ(i < EACH ? 0 : 1, lanes[i]);
+			else if (i < 4 * EACH / 3)
+				ASSERT_EQ(3 == i % 4 ? 0 : 1, lanes[i]);
+			else
+				ASSERT_EQ(0, lanes[i]);
+	}
+}
+
+/// in a coalescing lane a newer message replaces one still waiting with the same key, and keeps its place
+TEST(pal, event_manager_coalesce)
+{
+	pal::lanes how(2);
+	how._coalesce[1] = true;
+
+	sequence handler;
+	listener caller;
+	{
+		pal::event_manager<topical> events(64, 0, how);
+		events.attach(&handler, sequence::record);
+		events.attach(&caller, listener::hear, pal::dispatch(pal::dispatch::affinity::caller));
+
+		events.broadcast(topical{ 0, 0 });
+		while (!handler._entered)
+			std::this_thread::yield();
+
+		const uint32_t topics[] = { 1, 2, 1, 3, 2, 1 };
+		for (uint64_t i = 0; i < 6; ++i)
+			events.broadcast(topical{ topics[i], (1ull << 32) | i });
+
+		handler._open = true;
+	}
+
+	const std::vector<uint64_t> expected = { 0, (1ull << 32) | 5, (1ull << 32) | 4, (1ull << 32) | 3 };
+	ASSERT_EQ(expected, handler._values);
+
+	ASSERT_EQ(7, caller._count);
+}
+
+/// records roll over into new segments (the oldest going), each run carries on in a segment of its own, and a torn record ends its segment
+TEST(pal, journal)
+{
+	const char* path = "pal-test-journal";
+	forget(path);
+
+	// 24 bytes a record; 169 to a segment
+	const size_t SEGMENT = 1 << 12;
+	const uint64_t COUNT = 1000;
+
+	{
+		pal::journal journal;
+		ASSERT_TRUE(journal.open(path, sizeof(uint64_t), SEGMENT, 3));
+
+		for (uint64_t i = 1; i <= COUNT; ++i)
+			ASSERT_EQ(i, journal.append(&i));
+
+		// records of the wrong size aren't appended
+		const uint32_t small = 0;
+		ASSERT_EQ(0, journal.append(&small, sizeof(small)));
+		pal::journal::record<uint32_t>(&journal, small);
+
+		ASSERT_EQ(COUNT, journal.commit());
+		ASSERT_EQ(0, journal.error());
+	}
+
+	std::vector<uint64_t> values;
+	const size_t kept = pal::journal::replay(path, sizeof(uint64_t), replayed, &values);
+
+	// the last three segments
+	ASSERT_EQ(COUNT - (COUNT / 169 - 2) * 169, kept);
+	ASSERT_EQ(kept, values.size());
+	for (size_t i = 0; i < values.size(); ++i)
+		ASSERT_EQ(COUNT - kept + 1 + i, values[i]);
+
+	{
+		pal::journal journal;
+		ASSERT_TRUE(journal.open(path, sizeof(uint64_t), SEGMENT, 3));
+
+		const uint64_t value = 12345;
+		ASSERT_EQ(COUNT + 1, journal.append(&value));
+	}
+
+	// tear the second record of the first run's last segment
+	{
+		const std::string name = std::string(path) + "." + std::to_string(COUNT / 169);
+		std::fstream file(name, std::ios_base::in | std::ios_base::out | std::ios_base::binary);
+		file.seekp(pal::journal::SEGMENT_HEADER + 24 + 16);
+		file.put('!');
+	}
+
+	values.clear();
+	pal::journal::replay(path, sizeof(uint64_t), replayed, &values);
+
+	ASSERT_EQ(1 + 169 + 1, values.size());
+	ASSERT_EQ(COUNT - COUNT % 169 - 169 + 1, values[0]);
+	ASSERT_EQ(COUNT - COUNT % 169 + 1, values[169]);
+	ASSERT_EQ(12345, values[170]);
+
+	forget(path);
+}
+
+/// a segment whose header never made it to disk doesn't start the numbering over
+TEST(pal, journal_torn_header)
+{
+	const char* path = "pal-test-journal-torn";
+	forget(path);
+
+	const size_t SEGMENT = 1 << 12;
+	const uint64_t COUNT = 10;
+
+	{
+		pal::journal journal;
+		ASSERT_TRUE(journal.open(path, sizeof(uint64_t), SEGMENT, 4));
+
+		for (uint64_t i = 1; i <= COUNT; ++i)
+			ASSERT_EQ(i, journal.append(&i));
+
+		ASSERT_EQ(COUNT, journal.commit());
+	}
+
+	// a crash just after the next segment was made; none of it was written
+	{
+		std::ofstream file(std::string(path) + ".1", std::ios_base::binary);
+		const std::string zeroes(SEGMENT, '\0');
+		file.write(zeroes.data(), zeroes.size());
+	}
+
+	{
+		pal::journal journal;
+		ASSERT_TRUE(journal.open(path, sizeof(uint64_t), SEGMENT, 4));
+
+		const uint64_t value = COUNT + 1;
+		ASSERT_EQ(COUNT + 1, journal.append(&value));
+	}
+
+	std::vector<uint64_t> values;
+	pal::journal::replay(path, sizeof(uint64_t), replayed, &values);
+
+	ASSERT_EQ(COUNT + 1, values.size());
+	for (size_t i = 0; i < values.size(); ++i)
+		ASSERT_EQ(i + 1, values[i]);
+
+	forget(path);
+}
+
+/// a journal attached to an event_manager keeps everything broadcast, which replays into another
+TEST(pal, journal_event_manager)
+{
+	const char* path = "pal-test-journal-events";
+	forget(path);
+
+	const uint64_t COUNT = 10000;
+
+	{
+		pal::journal journal;
+		ASSERT_TRUE(journal.open(path, sizeof(uint64_t), 1 << 16));
+
+		pal::event_manager<uint64_t> events(64);
+		events.attach(&journal, pal::journal::record<uint64_t>, pal::dispatch(pal::dispatch::affinity::dedicated));
+
+		for (uint64_t i = 0; i < COUNT; ++i)
+			events.broadcast(i);
+	}
+
+	recorder handler;
+	{
+		pal::event_manager<uint64_t> events(64);
+		events.attach(&handler, recorder::record);
+
+		ASSERT_EQ(COUNT, pal::journal::replay(path, events));
+	}
+
+	ASSERT_EQ(COUNT, handler._messages.size());
+	for (uint64_t i = 0; i < COUNT; ++i)
+		ASSERT_EQ(i, handler._messages[i]);
+
+	forget(path);
+}
@@ -11,10 +11,37 @@
 
 
 #include <whippet.hpp>
+#include <whippet.hierarchy.hpp>
+#include <whippet.kernels.hpp>
+#include <whippet.static.hpp>
+
+#ifdef __cpp_impl_coroutine
+#	include <whippet.tasks.hpp>
+
+namespace
+{
+	/// what the coroutine systems wait for
+	struct siren
+	{
+		int _code;
+	};
+}
+
+// siren is local to this file; so, the parts of its event_manager that aren't used here would be warned about
+#define pal_event_manager_E siren
+#define pal_event_manager_cpp [[maybe_unused]]
+#include <pal.inc.event_manager.hpp>
+#endif
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
+
 /// test to see if testing works
 TEST(whippet, nothing)
 {
@@ -98,9 +125,9 @@ TEST(whippet, attach)
 
 		universe.install<foonk>();
 
-		auto e0 = universe.create();
+		[[maybe_unused]] auto e0 = universe.create();
 		auto e1 = universe.create();
-		auto e2 = universe.create();
+		[[maybe_unused]] auto e2 = universe.create();
 
 		auto& c0 = e1.attach<foonk>("foonk");
 		ASSERT_NE(nullptr, &c0);
@@ -160,20 +187,20 @@ TEST(whippet, counting)
 		ASSERT_EQ(3, total);
 
 		ASSERT_EQ(1, whippet::porcelain::component_count(e0));
-		ASSERT_EQ(1, whippet::porcelain::component_count<boop>(e0, [](boop& them) { return true; }));
-		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e0, [](foonk& them) { return true; }));
+		ASSERT_EQ(1, whippet::porcelain::component_count<boop>(e0, [](boop&) { return true; }));
+		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e0, [](foonk&) { return true; }));
 		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e0, [](foonk& them) { return them._name == "baur"; }));
 		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e0, [](foonk& them) { return them._name == "foonk"; }));
 
 		ASSERT_EQ(1, whippet::porcelain::component_count(e1, [](whippet::_component&) { return true; }));
-		ASSERT_EQ(0, whippet::porcelain::component_count<boop>(e1, [](boop& them) { return true; }));
-		ASSERT_EQ(1, whippet::porcelain::component_count<foonk>(e1, [](foonk& them) { return true; }));
+		ASSERT_EQ(0, whippet::porcelain::component_count<boop>(e1, [](boop&) { return true; }));
+		ASSERT_EQ(1, whippet::porcelain::component_count<foonk>(e1, [](foonk&) { return true; }));
 		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e1, [](foonk& them) { return them._name == "baur"; }));
 		ASSERT_EQ(1, whippet::porcelain::component_count<foonk>(e1, [](foonk& them) { return them._name == "foonk"; }));
 
 		ASSERT_EQ(1, whippet::porcelain::component_count(e2, [](whippet::_component&) { return true; }));
-		ASSERT_EQ(1, whippet::porcelain::component_count<boop>(e2, [](boop& them) { return true; }));
-		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e2, [](foonk& them) { return true; }));
+		ASSERT_EQ(1, whippet::porcelain::component_count<boop>(e2, [](boop&) { return true; }));
+		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e2, [](foonk&) { return true; }));
 		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e2, [](foonk& them) { return them._name == "baur"; }));
 		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e2, [](foonk& them) { return them._name == "foonk"; }));
 
@@ -183,20 +210,20 @@ TEST(whippet, counting)
 		e2.attach<foonk>("grop");
 
 		ASSERT_EQ(1, whippet::porcelain::component_count(e0, [](whippet::_component&) { return true; }));
-		ASSERT_EQ(1, whippet::porcelain::component_count<boop>(e0, [](boop& them) { return true; }));
-		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e0, [](foonk& them) { return true; }));
+		ASSERT_EQ(1, whippet::porcelain::component_count<boop>(e0, [](boop&) { return true; }));
+		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e0, [](foonk&) { return true; }));
 		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e0, [](foonk& them) { return them._name == "baur"; }));
 		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e0, [](foonk& them) { return them._name == "foonk"; }));
 
 		ASSERT_EQ(1, whippet::porcelain::component_count(e1, [](whippet::_component&) { return true; }));
-		ASSERT_EQ(0, whippet::porcelain::component_count<boop>(e1, [](boop& them) { return true; }));
-		ASSERT_EQ(1, whippet::porcelain::component_count<foonk>(e1, [](foonk& them) { return true; }));
+		ASSERT_EQ(0, whippet::porcelain::component_count<boop>(e1, [](boop&) { return true; }));
+		ASSERT_EQ(1, whippet::porcelain::component_count<foonk>(e1, [](foonk&) { return true; }));
 		ASSERT_EQ(0, whippet::porcelain::component_count<foonk>(e1, [](foonk& them) { return them._name == "baur"; }));
 		ASSERT_EQ(1, whippet::porcelain::component_count<foonk>(e1, [](foonk& them) { return them._name == "foonk"; }));
 
 		ASSERT_EQ(5, whippet::porcelain::component_count(e2, [](whippet::_component&) { return true; }));
-		ASSERT_EQ(1, whippet::porcelain::component_count<boop>(e2, [](boop& them) { return true; }));
-		ASSERT_EQ(4, whippet::porcelain::component_count<foonk>(e2, [](foonk& them) { return true; }));
+		ASSERT_EQ(1, whippet::porcelain::component_count<boop>(e2, [](boop&) { return true; }));
+		ASSERT_EQ(4, whippet::porcelain::component_count<foonk>(e2, [](foonk&) { return true; }));
 		ASSERT_EQ(1, whippet::porcelain::component_count<foonk>(e2, [](foonk& them) { return them._name == "baur"; }));
 		ASSERT_EQ(2, whippet::porcelain::component_count<foonk>(e2, [](foonk& them) { return them._name == "foonk"; }));
 	}
@@ -209,7 +236,7 @@ TEST(whippet, check_pre_new)
 {
 	static bool name_match = false;
 	static whippet::universe* pointer = nullptr;
-	static bool is_null = false;
+	[[maybe_unused]] static bool is_null = false;
 	struct foonk : whippet::_component
 	{
 		foonk(const char* name)
@@ -230,7 +257,7 @@ TEST(whippet, check_pre_new)
 
 	ASSERT_EQ(nullptr, pointer) << "the pointer isn't null when it should be";
 
-	auto& c0 = universe.create().attach<foonk>("baur");
+	[[maybe_unused]] auto& c0 = universe.create().attach<foonk>("baur");
 
 	ASSERT_EQ(&universe, pointer) << "the pointers don't patch";
 	ASSERT_EQ(true, name_match) << "the names don't match";
@@ -375,3 +402,1356 @@ TEST(whippet, is_as)
 	ASSERT_TRUE(e0.attach<foo>(18).is<foo>());
 	ASSERT_TRUE(e0.attach<bar>(.8).is<bar>());
 }
+
+/// the per-component overhead should be a packed handle and nothing more
+TEST(whippet, component_header)
+{
+	struct tiny : whippet::_component
+	{
+		tiny(int) {}
+	};
+	struct small : whippet::_component
+	{
+		int _value;
+		small(int value) : _value(value) {}
+	};
+
+	ASSERT_EQ(sizeof(uint64_t), sizeof(whippet::_component));
+	ASSERT_EQ(sizeof(uint64_t), sizeof(tiny));
+	ASSERT_EQ(sizeof(uint64_t) + sizeof(int), sizeof(small));
+
+	whippet::universe universe;
+
+	universe.install<tiny>();
+	universe.install<small>();
+
+	auto e0 = universe.create();
+	auto e1 = universe.create();
+
+	auto& c0 = e0.attach<tiny>(0);
+	auto& c1 = e1.attach<small>(23);
+
+	// the world, owner and type all come back out of the storage block
+	ASSERT_EQ(&universe, &(c0.world()));
+	ASSERT_EQ(&universe, &(c1.world()));
+	ASSERT_EQ(e0.guid(), c0.owner().guid());
+	ASSERT_EQ(e1.guid(), c1.owner().guid());
+	ASSERT_TRUE(c0.is<tiny>());
+	ASSERT_TRUE(c1.is<small>());
+	ASSERT_EQ(&c1, c1.as<small>());
+	ASSERT_EQ(nullptr, c1.as<tiny>());
+	ASSERT_EQ(23, c1._value);
+}
+
+#ifdef whippet__porcelain
+/// components with no data (and no destructor) are stored as bits
+TEST(whippet, tags)
+{
+	struct dead : whippet::_component
+	{
+		dead(int) {}
+	};
+	struct named : whippet::_component
+	{
+		std::string _name;
+		named(const char* name) : _name(name) {}
+	};
+	struct counted : whippet::_component
+	{
+		counted(int) {}
+		~counted(void) {}
+	};
+
+	static_assert(whippet::is_tag<dead>::value, "no data; should be a tag");
+	static_assert(!whippet::is_tag<named>::value, "has data; shouldn't be a tag");
+	static_assert(!whippet::is_tag<counted>::value, "has a destructor; shouldn't be a tag");
+
+	whippet::universe universe;
+
+	universe.install<dead>();
+	universe.install<named>();
+
+	auto e0 = universe.create();
+	auto e1 = universe.create();
+	auto e2 = universe.create();
+
+	e0.attach<named>("e0");
+	e1.attach<named>("e1");
+
+	auto& d0 = e0.attach<dead>(0);
+	ASSERT_TRUE(d0.is<dead>());
+	ASSERT_EQ(e0.guid(), d0.owner().guid());
+
+	// tags don't take guids of their own
+	ASSERT_EQ(e0.guid(), d0.guid());
+	ASSERT_EQ(&universe, &(d0.world()));
+
+	e2.attach<dead>(0);
+	e2.attach<dead>(0);
+
+	// the tag is there or it isn't
+	ASSERT_EQ(1, whippet::porcelain::component_count<dead>(e0));
+	ASSERT_EQ(0, whippet::porcelain::component_count<dead>(e1));
+	ASSERT_EQ(1, whippet::porcelain::component_count<dead>(e2));
+	ASSERT_EQ(2, whippet::porcelain::component_count(e0));
+	ASSERT_EQ(1, whippet::porcelain::component_count(e1));
+
+	// scan for everything that's tagged
+	std::set<uint32_t> found;
+	universe.visit<std::set<uint32_t>, dead>(found, [](std::set<uint32_t>& found, dead& tag)
+	{
+		found.emplace(tag.owner().guid()._weak);
+		return true;
+	});
+	ASSERT_EQ(2, found.size());
+	ASSERT_EQ(1, found.count(e0.guid()._weak));
+	ASSERT_EQ(1, found.count(e2.guid()._weak));
+
+	// detaching clears the bit
+	whippet::porcelain::component<dead>(e2).detach();
+	ASSERT_EQ(0, whippet::porcelain::component_count<dead>(e2));
+
+	// removing the entity takes the tag with it
+	e0.remove();
+	ASSERT_EQ(0, whippet::porcelain::component_count(e0));
+	ASSERT_EQ(1, whippet::porcelain::component_count(e1));
+}
+#endif
+
+#ifdef whippet__porcelain
+/// sort storage by owner and by a key
+TEST(whippet, sort)
+{
+	struct value : whippet::_component
+	{
+		uint32_t _value;
+		value(uint32_t v) : _value(v) {}
+	};
+
+	whippet::universe universe;
+	universe.install<value>();
+
+	std::vector<whippet::entity> entities;
+	for (uint32_t i = 0; i < 3000; ++i)
+		entities.push_back(universe.create());
+
+	// attach in a scrambled order, with some holes
+	for (uint32_t i = 0; i < 3000; ++i)
+	{
+		const uint32_t pick = (i * 1543) % 3000;
+		entities[pick].attach<value>(pick);
+	}
+	for (uint32_t i = 0; i < 3000; i += 7)
+		whippet::porcelain::component<value>(entities[i]).detach();
+
+	struct check
+	{
+		uint32_t _count;
+		uint32_t _last;
+		bool _ordered;
+	};
+
+	// by owner
+	universe.sort<value>();
+	{
+		check state = { 0, 0, true };
+		universe.visit<check, value>(state, [](check& state, value& next)
+		{
+			const auto owner = next.owner().guid()._weak;
+			state._ordered = state._ordered && state._last < owner;
+			state._last = owner;
+			++state._count;
+			return true;
+		});
+		ASSERT_TRUE(state._ordered);
+		ASSERT_EQ(3000 - 429, state._count);
+	}
+
+	// by (descending) value
+	universe.sort<value>([](const value& v) { return 0xFFFFFFFFu - v._value; });
+	{
+		check state = { 0, 0xFFFFFFFFu, true };
+		universe.visit<check, value>(state, [](check& state, value& next)
+		{
+			state._ordered = state._ordered && next._value < state._last;
+			state._last = next._value;
+			++state._count;
+			return true;
+		});
+		ASSERT_TRUE(state._ordered);
+		ASSERT_EQ(3000 - 429, state._count);
+	}
+
+	// everything's still attached to who it should be
+	for (uint32_t i = 0; i < 3000; ++i)
+	{
+		ASSERT_EQ((i % 7) ? 1 : 0, whippet::porcelain::component_count<value>(entities[i]));
+		if (i % 7)
+		{
+			ASSERT_EQ(i, whippet::porcelain::component<value>(entities[i])._value);
+		}
+	}
+}
+#endif
+
+/// batch kernels over columns should agree with the one-at-a-time visit
+TEST(whippet, columns)
+{
+	typedef whippet::kernels::motion motion;
+
+	typedef void(*kernel_t)(const whippet::column<motion>&, float);
+
+	// the tail of a partial group; up to 64 lanes
+	ASSERT_EQ(1u, whippet::column<motion>(nullptr, 9).tail_mask(2));
+	ASSERT_EQ(0u, whippet::column<motion>(nullptr, 8).tail_mask(4));
+	ASSERT_EQ(0x3fu, whippet::column<motion>(nullptr, 70).tail_mask(64));
+	ASSERT_EQ(~uint64_t(0) >> 1, whippet::column<motion>(nullptr, 63).tail_mask(64));
+	ASSERT_EQ(0u, whippet::column<motion>(nullptr, 128).tail_mask(64));
+
+	std::vector<kernel_t> kernels = { whippet::kernels::integrate_scalar };
+#ifdef whippet__kernels_sse
+	kernels.push_back(whippet::kernels::integrate_sse);
+#endif
+#ifdef whippet__kernels_avx2
+	kernels.push_back(whippet::kernels::integrate_avx2);
+#endif
+#ifdef whippet__kernels_simd
+	kernels.push_back(whippet::kernels::integrate_simd);
+#endif
+
+	for (auto kernel : kernels)
+	{
+		whippet::universe universe;
+		universe.install<motion>();
+
+		// make some holes so that there's more than one run
+		std::vector<motion*> attached;
+		for (int i = 0; i < 1001; ++i)
+			attached.push_back(&(universe.create().attach<motion>(float(i), 0.f, -float(i), 1.f, float(i % 3), 0.5f)));
+		for (int i = 0; i < 1001; i += 10)
+			attached[i]->detach();
+
+		struct state
+		{
+			kernel_t _kernel;
+			uint32_t _runs;
+			uint32_t _count;
+		};
+		state self = { kernel, 0, 0 };
+
+		universe.columns<state, motion>(self, [](state& self, whippet::column<motion>& column)
+		{
+			EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(column.begin()->_position) % 16);
+			++self._runs;
+			self._count += column.size();
+			self._kernel(column, 2.f);
+			return true;
+		});
+
+		ASSERT_LT(1u, self._runs);
+		ASSERT_EQ(1001u - 101u, self._count);
+
+		universe.visit<state, motion>(self, [](state&, motion& next)
+		{
+			const auto i = next._position[1] * 0.5f;
+			EXPECT_FLOAT_EQ(next._velocity[1], i);
+			EXPECT_FLOAT_EQ(next._position[2] + next._position[0], 3.f);
+			EXPECT_FLOAT_EQ(0.f, next._position[3]);
+			return true;
+		});
+	}
+}
+
+/// the counters come back out of the universe (or, are empty if they're compiled out)
+TEST(whippet, stats)
+{
+	struct value : whippet::_component
+	{
+		int _value;
+		value(int v) : _value(v) {}
+	};
+
+	whippet::universe universe;
+	universe.install<value>();
+
+	auto e0 = universe.create();
+	auto e1 = universe.create();
+
+	e0.attach<value>(1);
+	e1.attach<value>(2).detach();
+	e1.attach<value>(3);
+
+	int count = 0;
+	universe.visit<int, value>(count, [](int& count, value&) { ++count; return true; });
+	ASSERT_EQ(2, count);
+
+	auto snapshot = universe.stats();
+
+	std::stringstream json;
+	snapshot.json(json);
+	ASSERT_EQ(0, json.str().find("{\"enabled\":"));
+
+#ifdef whippet__stats
+	ASSERT_TRUE(snapshot._enabled);
+	ASSERT_EQ(5, snapshot._guids._activated);
+	ASSERT_EQ(1, snapshot._guids._released);
+	ASSERT_EQ(1, snapshot._providers.size());
+	ASSERT_EQ(3, snapshot._providers[0]._emplaced);
+	ASSERT_EQ(1, snapshot._providers[0]._allocated);
+	ASSERT_EQ(1, snapshot._providers[0]._layers);
+	ASSERT_EQ(1, snapshot._providers[0]._visits);
+	ASSERT_EQ(2, snapshot._providers[0]._visit_callbacks);
+	ASSERT_EQ(1, snapshot._providers[0]._detached);
+#else
+	ASSERT_FALSE(snapshot._enabled);
+	ASSERT_TRUE(snapshot._providers.empty());
+#endif
+}
+
+namespace
+{
+	struct spot : whippet::_component
+	{
+		float _x, _y;
+		spot(float x, float y) : _x(x), _y(y) {}
+	};
+
+	struct marked : whippet::_component
+	{
+		marked(int) {}
+	};
+
+	struct label : whippet::_component
+	{
+		std::string _text;
+		label(const std::string& text) : _text(text) {}
+	};
+
+	/// no serial<C>; left out of snapshots
+	struct scratch : whippet::_component
+	{
+		std::vector<int> _data;
+		scratch(int size) : _data(size) {}
+	};
+
+	/// owner guid to something about its components
+	std::map<uint32_t, float> spots(whippet::universe& universe)
+	{
+		std::map<uint32_t, float> found;
+		universe.visit<std::map<uint32_t, float>, spot>(found, [](std::map<uint32_t, float>& found, spot& next)
+		{
+			found[next.owner().guid()._weak] += next._x * 3 + next._y;
+			return true;
+		});
+		return found;
+	}
+
+	std::map<uint32_t, std::string> labels(whippet::universe& universe)
+	{
+		std::map<uint32_t, std::string> found;
+		universe.visit<std::map<uint32_t, std::string>, label>(found, [](std::map<uint32_t, std::string>& found, label& next)
+		{
+			found[next.owner().guid()._weak] += next._text;
+			return true;
+		});
+		return found;
+	}
+
+	std::set<uint32_t> marks(whippet::universe& universe)
+	{
+		std::set<uint32_t> found;
+		universe.visit<std::set<uint32_t>, marked>(found, [](std::set<uint32_t>& found, marked& next)
+		{
+			found.emplace(next.owner().guid()._weak);
+			return true;
+		});
+		return found;
+	}
+
+	size_t scratches(whippet::universe& universe)
+	{
+		size_t count = 0;
+		universe.visit<size_t, scratch>(count, [](size_t& count, scratch&) { ++count; return true; });
+		return count;
+	}
+}
+
+namespace whippet
+{
+	template<>
+	struct serial<label>
+	{
+		static const bool enabled = true;
+
+		static void save(std::ostream& out, const label& data)
+		{
+			const uint32_t size = static_cast<uint32_t>(data._text.size());
+			out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+			out.write(data._text.data(), size);
+		}
+
+		static void load(std::istream& in, entity owner)
+		{
+			uint32_t size = 0;
+			in.read(reinterpret_cast<char*>(&size), sizeof(size));
+
+			std::string text(size, ' ');
+			in.read(&text[0], size);
+
+			owner.attach<label>(text);
+		}
+	};
+}
+
+/// write a universe out and read it back (into itself and into another)
+TEST(whippet, snapshot)
+{
+	whippet::universe universe;
+	universe.install<spot>();
+	universe.install<marked>();
+	universe.install<label>();
+	universe.install<scratch>();
+
+	// enough to fill a few blocks, with some holes in them
+	std::vector<whippet::entity> entities;
+	for (int i = 0; i < 10000; ++i)
+	{
+		auto next = universe.create();
+		entities.push_back(next);
+
+		auto& mine = next.attach<spot>(static_cast<float>(i), 1.0f);
+		if (0 == i % 7)
+			mine.detach();
+		if (0 == i % 2)
+			next.attach<marked>(0);
+		if (0 == i % 100)
+			next.attach<label>("e" + std::to_string(i));
+		if (0 == i % 1000)
+			next.attach<scratch>(3);
+	}
+	entities[5].remove();
+
+	const auto expected_spots = spots(universe);
+	const auto expected_labels = labels(universe);
+	const auto expected_marks = marks(universe);
+	ASSERT_EQ(10000 - 1 - (10000 + 6) / 7, expected_spots.size());
+	ASSERT_EQ(100, expected_labels.size());
+	ASSERT_EQ(10, scratches(universe));
+
+	std::stringstream saved;
+	universe.snapshot(saved);
+	const auto bytes = saved.str();
+
+	// roll back some changes
+	entities[1].remove();
+	entities[2].attach<label>("late");
+	universe.create().attach<spot>(1.0f, 2.0f);
+
+	{
+		std::stringstream in(bytes);
+		ASSERT_TRUE(universe.restore(in));
+	}
+	ASSERT_EQ(expected_spots, spots(universe));
+	ASSERT_EQ(expected_labels, labels(universe));
+	ASSERT_EQ(expected_marks, marks(universe));
+	ASSERT_EQ(0, scratches(universe));
+
+	// a restored universe carries on as normal
+	auto fresh = universe.create();
+	ASSERT_EQ(0, expected_spots.count(fresh.guid()._weak));
+	fresh.attach<spot>(0.0f, 0.0f);
+	entities[3].remove();
+	ASSERT_EQ(expected_spots.size(), spots(universe).size());
+
+	// into another universe
+	whippet::universe other;
+	other.install<label>();
+	other.install<scratch>();
+	other.install<marked>();
+	other.install<spot>();
+	{
+		std::stringstream in(bytes);
+		ASSERT_TRUE(other.restore(in));
+	}
+	ASSERT_EQ(expected_spots, spots(other));
+	ASSERT_EQ(expected_labels, labels(other));
+	ASSERT_EQ(expected_marks, marks(other));
+
+	// a universe without the same types is left alone
+	whippet::universe missing;
+	missing.install<spot>();
+	missing.install<marked>();
+	missing.create().attach<spot>(1.0f, 1.0f);
+	{
+		std::stringstream in(bytes);
+		ASSERT_FALSE(missing.restore(in));
+	}
+	ASSERT_EQ(1, spots(missing).size());
+
+	// running out part way through leaves it empty
+	{
+		std::stringstream in(bytes.substr(0, bytes.size() / 2));
+		ASSERT_FALSE(other.restore(in));
+	}
+	ASSERT_TRUE(spots(other).empty());
+	ASSERT_TRUE(labels(other).empty());
+	ASSERT_TRUE(marks(other).empty());
+
+	// a scratch isn't saved; so, its guid is the next one handed out by what's restored
+	{
+		whippet::universe small;
+		small.install<scratch>();
+		const auto guid = small.create().attach<scratch>(1).guid();
+
+		std::stringstream out;
+		small.snapshot(out);
+
+		whippet::universe fresh;
+		fresh.install<scratch>();
+		ASSERT_TRUE(fresh.restore(out));
+		ASSERT_EQ(guid, fresh.create().guid());
+	}
+}
+
+/// a snapshot file's blocks are mapped in place; changes to them are the universe's own
+TEST(whippet, snapshot_map)
+{
+	const char* path = "whippet-test-snapshot.bin";
+
+	whippet::universe universe;
+	universe.install<spot>();
+	universe.install<marked>();
+	universe.install<label>();
+	universe.install<scratch>();
+
+	for (int i = 0; i < 10000; ++i)
+	{
+		auto next = universe.create();
+		next.attach<spot>(static_cast<float>(i), 2.0f);
+
+		if (0 == i % 3)
+			next.attach<marked>(0);
+		if (0 == i % 1000)
+			next.attach<label>(std::to_string(i));
+	}
+
+	{
+		std::ofstream out(path, std::ios_base::binary);
+		universe.snapshot(out);
+	}
+
+	const auto expected_spots = spots(universe);
+	const auto expected_labels = labels(universe);
+	const auto expected_marks = marks(universe);
+
+	{
+		whippet::universe mapped;
+		mapped.install<spot>();
+		mapped.install<marked>();
+		mapped.install<label>();
+		mapped.install<scratch>();
+
+		ASSERT_TRUE(mapped.map(path));
+		ASSERT_EQ(expected_spots, spots(mapped));
+		ASSERT_EQ(expected_labels, labels(mapped));
+		ASSERT_EQ(expected_marks, marks(mapped));
+
+		// the blocks should be from the file rather than allocated
+		spot* first = nullptr;
+		mapped.visit<spot*, spot>(first, [](spot*& first, spot& next) { first = &next; return false; });
+		ASSERT_NE(nullptr, first);
+#ifndef _WIN32
+		ASSERT_NE(nullptr, hanoi_block::of(first)->_release);
+#endif
+
+		// change (and remove) some of them
+		int changed = 0;
+		mapped.visit<int, spot>(changed, [](int& changed, spot& next) { next._y = -1.0f; return 0 != ++changed; });
+		mapped.create().attach<spot>(0.0f, 0.0f);
+		first->owner().remove();
+		mapped.weed();
+
+		ASSERT_EQ(expected_spots.size(), spots(mapped).size());
+		ASSERT_NE(expected_spots, spots(mapped));
+	}
+
+	// ... which didn't reach the file
+	{
+		whippet::universe again;
+		again.install<spot>();
+		again.install<marked>();
+		again.install<label>();
+		again.install<scratch>();
+
+		ASSERT_TRUE(again.map(path));
+		ASSERT_EQ(expected_spots, spots(again));
+		ASSERT_EQ(expected_marks, marks(again));
+	}
+
+	remove(path);
+}
+
+namespace
+{
+	/// what a tick might do; move things, make and lose things, and tag things
+	std::vector<uint32_t> tick(whippet::universe& universe, const int seed)
+	{
+		int step = seed;
+		universe.visit<int, spot>(step, [](int& step, spot& next)
+		{
+			next._x += static_cast<float>(step % 5);
+			next._y -= 1.0f;
+			return true;
+		});
+
+		std::vector<uint32_t> made;
+		for (int i = 0; i < 3000; ++i)
+		{
+			auto next = universe.create();
+			next.attach<spot>(static_cast<float>(seed), static_cast<float>(i));
+			if (0 == i % 5)
+				next.attach<marked>(0);
+			made.push_back(next.guid()._weak);
+		}
+
+		std::vector<spot*> doomed;
+		universe.visit<std::vector<spot*>, spot>(doomed, [](std::vector<spot*>& doomed, spot& next)
+		{
+			if (0 == static_cast<int>(next._x) % 3)
+				doomed.push_back(&next);
+			return true;
+		});
+		for (auto next : doomed)
+			next->detach();
+
+		universe.weed();
+		return made;
+	}
+}
+
+/// go back to a mark() and do it all again
+TEST(whippet, rollback)
+{
+	whippet::universe universe;
+	universe.install<spot>();
+	universe.install<marked>();
+	universe.install<label>();
+	universe.install<scratch>();
+
+	for (int i = 0; i < 5000; ++i)
+	{
+		auto next = universe.create();
+		next.attach<spot>(static_cast<float>(i), 0.0f);
+		if (0 == i % 4)
+			next.attach<marked>(0);
+	}
+
+	const auto expected_spots = spots(universe);
+	const auto expected_marks = marks(universe);
+
+	universe.mark();
+
+	std::vector<std::vector<uint32_t>> made;
+	for (int i = 0; i < 3; ++i)
+		made.push_back(tick(universe, i));
+
+	const auto ticked_spots = spots(universe);
+	const auto ticked_marks = marks(universe);
+	ASSERT_NE(expected_spots, ticked_spots);
+
+	universe.rollback();
+	ASSERT_EQ(expected_spots, spots(universe));
+	ASSERT_EQ(expected_marks, marks(universe));
+
+	// the same ticks have the same results; storage and guids included
+	for (int i = 0; i < 3; ++i)
+		ASSERT_EQ(made[i], tick(universe, i));
+	ASSERT_EQ(ticked_spots, spots(universe));
+	ASSERT_EQ(ticked_marks, marks(universe));
+
+	// labels are written out by mark() and read back by rollback(); so, one attached since goes, and one detached since comes back (with its guid)
+	auto kept = universe.create();
+	auto& kept_label = kept.attach<label>("kept");
+	const auto kept_guid = kept_label.guid();
+	kept.attach<scratch>(1);
+	universe.mark();
+	kept_label.detach();
+	auto later = universe.create();
+	later.attach<label>("gone");
+	universe.rollback();
+	ASSERT_EQ((std::map<uint32_t, std::string>{ { kept.guid()._weak, "kept" } }), labels(universe));
+	std::set<uint32_t> label_guids;
+	universe.visit<std::set<uint32_t>, label>(label_guids, [](std::set<uint32_t>& found, label& next) { found.emplace(next.guid()._weak); return true; });
+	ASSERT_EQ(std::set<uint32_t>{ kept_guid._weak }, label_guids);
+	ASSERT_EQ(ticked_spots, spots(universe));
+
+	// a scratch isn't written at all; one from before mark() is kept, and one attached since is detached (its guids are free again)
+	ASSERT_EQ(1, scratches(universe));
+	universe.mark();
+	auto scratched = universe.create();
+	scratched.attach<scratch>(2);
+	ASSERT_EQ(2, scratches(universe));
+	universe.rollback();
+	ASSERT_EQ(1, scratches(universe));
+	ASSERT_EQ(scratched.guid(), universe.create().guid());
+	universe.rollback();
+	ASSERT_EQ(ticked_spots, spots(universe));
+
+	// touching a component is needed when it's changed through an old reference
+	universe.mark();
+	spot* held = nullptr;
+	universe.visit<spot*, spot>(held, [](spot*& held, spot& next) { held = &next; return false; });
+	universe.mark();
+	held->touch();
+	held->_x = -100.0f;
+	universe.rollback();
+	ASSERT_EQ(ticked_spots, spots(universe));
+}
+
+/// the changes from one universe applied to another (that started the same)
+TEST(whippet, delta)
+{
+	whippet::universe source;
+	source.install<spot>();
+	source.install<marked>();
+	source.install<label>();
+
+	for (int i = 0; i < 20000; ++i)
+	{
+		auto next = source.create();
+		next.attach<spot>(static_cast<float>(i), 0.0f);
+		if (0 == i % 4)
+			next.attach<marked>(0);
+		if (0 == i % 1000)
+			next.attach<label>("s" + std::to_string(i));
+	}
+
+	std::stringstream saved;
+	source.snapshot(saved);
+	source.mark();
+
+	whippet::universe copy;
+	copy.install<marked>();
+	copy.install<label>();
+	copy.install<spot>();
+	ASSERT_TRUE(copy.restore(saved));
+
+	for (int i = 0; i < 3; ++i)
+	{
+		tick(source, i);
+		source.create().attach<label>("t" + std::to_string(i));
+
+		std::stringstream delta;
+		source.delta(delta);
+		source.mark();
+
+		// all of it is checked before anything's done; so, running out part way through changes nothing
+		const auto before = spots(copy);
+		{
+			std::stringstream half(delta.str().substr(0, delta.str().size() / 2));
+			ASSERT_FALSE(copy.apply(half));
+		}
+		ASSERT_EQ(before, spots(copy));
+
+		ASSERT_TRUE(copy.apply(delta));
+		ASSERT_EQ(spots(source), spots(copy));
+		ASSERT_EQ(marks(source), marks(copy));
+		ASSERT_EQ(labels(source), labels(copy));
+
+		// both carry on the same way
+		auto one = source.create();
+		auto two = copy.create();
+		ASSERT_EQ(one.guid(), two.guid());
+		one.remove();
+		two.remove();
+	}
+
+	// a small change makes a small delta
+	source.mark();
+	spot* first = nullptr;
+	source.visit<spot*, spot>(first, [](spot*& first, spot& next) { first = &next; return false; });
+	first->_y = 12.0f;
+
+	std::stringstream small;
+	source.delta(small);
+	ASSERT_GT(1024, small.str().size());
+
+	ASSERT_TRUE(copy.apply(small));
+	ASSERT_EQ(spots(source), spots(copy));
+}
+
+/// a fork starts the same and goes its own way (as does its parent)
+TEST(whippet, fork)
+{
+	auto parent = std::make_unique<whippet::universe>();
+	parent->install<spot>();
+	parent->install<marked>();
+	parent->install<label>();
+	parent->install<scratch>();
+
+	for (int i = 0; i < 10000; ++i)
+	{
+		auto next = parent->create();
+		next.attach<spot>(static_cast<float>(i), 1.0f);
+		if (0 == i % 2)
+			next.attach<marked>(0);
+		if (0 == i % 500)
+			next.attach<label>("p" + std::to_string(i));
+		if (0 == i % 5000)
+			next.attach<scratch>(1);
+	}
+
+	const auto expected_spots = spots(*parent);
+	const auto expected_labels = labels(*parent);
+	const auto expected_marks = marks(*parent);
+
+	std::set<uint32_t> scratched;
+	parent->visit<std::set<uint32_t>, scratch>(scratched, [](std::set<uint32_t>& scratched, scratch& next) { scratched.emplace(next.guid()._weak); return true; });
+	ASSERT_EQ(2, scratched.size());
+
+	auto child = parent->fork();
+	ASSERT_EQ(expected_spots, spots(*child));
+	ASSERT_EQ(expected_labels, labels(*child));
+	ASSERT_EQ(expected_marks, marks(*child));
+	ASSERT_EQ(0, scratches(*child));
+
+	// the scratches were left behind; so, their guids are the next ones that the child hands out
+	const std::set<uint32_t> reused = { child->create().guid()._weak, child->create().guid()._weak };
+	ASSERT_EQ(scratched, reused);
+
+	// the child's components are its own
+	spot* first = nullptr;
+	child->visit<spot*, spot>(first, [](spot*& first, spot& next) { first = &next; return false; });
+	ASSERT_EQ(child.get(), &(first->world()));
+
+	// changing the child leaves the parent alone ...
+	tick(*child, 1);
+	const auto child_spots = spots(*child);
+	const auto child_marks = marks(*child);
+	ASSERT_NE(expected_spots, child_spots);
+	ASSERT_EQ(expected_spots, spots(*parent));
+	ASSERT_EQ(expected_marks, marks(*parent));
+
+	// ... and the other way around
+	tick(*parent, 2);
+	const auto parent_spots = spots(*parent);
+	ASSERT_NE(expected_spots, parent_spots);
+	ASSERT_EQ(child_spots, spots(*child));
+
+	// forks of forks; and of a parent that's changed since it was last forked
+	auto grandchild = child->fork();
+	auto sibling = parent->fork();
+	ASSERT_EQ(child_spots, spots(*grandchild));
+	ASSERT_EQ(child_marks, marks(*grandchild));
+	ASSERT_EQ(parent_spots, spots(*sibling));
+
+	// a component changed (after it's touched) through a reference that was kept from before a fork is seen by the next one
+	{
+		auto& kept = parent->create().attach<spot>(1.0f, 1.0f);
+		auto before = parent->fork();
+
+		kept.touch();
+		kept._x = 2.0f;
+
+		auto after = parent->fork();
+		ASSERT_EQ(spots(*parent), spots(*after));
+		ASSERT_NE(spots(*before), spots(*after));
+	}
+
+	// the parent can go first
+	parent.reset();
+	tick(*sibling, 3);
+	tick(*grandchild, 4);
+	ASSERT_EQ(child_spots, spots(*child));
+
+	// a fork carries on making guids where its parent left off
+	auto made = child->create();
+	ASSERT_EQ(0, child_spots.count(made.guid()._weak));
+	made.attach<spot>(0.0f, 0.0f);
+	ASSERT_EQ(child_spots.size() + 1, spots(*child).size());
+}
+
+namespace
+{
+	size_t named_count(whippet::universe& universe, const char* text)
+	{
+		size_t count = 0;
+		universe.named<size_t>(text, count, [](size_t& count, whippet::entity) { ++count; return true; });
+		return count;
+	}
+
+	/// whether `entity` is one of the ones found for `text`; short names often share a sum with others, so, it might not be the only one
+	bool named_has(whippet::universe& universe, const char* text, whippet::entity entity)
+	{
+		std::pair<whippet::guid_t, bool> found(entity.guid(), false);
+		universe.named<std::pair<whippet::guid_t, bool>>(text, found, [](std::pair<whippet::guid_t, bool>& found, whippet::entity next)
+		{
+			found.second = found.first == next.guid();
+			return !found.second;
+		});
+		return found.second;
+	}
+}
+
+/// names are found through the index, and, it keeps up with attach, detach, remove and restore
+TEST(whippet, names)
+{
+	// a copy would erase the original from the index when it went
+	static_assert(!std::is_copy_constructible<whippet::name>::value && !std::is_move_constructible<whippet::name>::value, "names can't be copied");
+
+	whippet::universe universe;
+	universe.install<whippet::name>();
+
+	ASSERT_EQ(0, universe.named("player").guid()._weak);
+
+	auto player = universe.create();
+	player.attach<whippet::name>("player");
+	player.attach<whippet::name>("hero");
+
+	std::vector<whippet::entity> numbered;
+	for (int i = 0; i < 1000; ++i)
+	{
+		auto next = universe.create();
+		next.attach<whippet::name>("enemy");
+		next.attach<whippet::name>(("n" + std::to_string(i)).c_str());
+		numbered.push_back(next);
+	}
+
+	ASSERT_EQ(player.guid(), universe.named("player").guid());
+	ASSERT_EQ(player.guid(), universe.named("hero").guid());
+	ASSERT_EQ(0, universe.named("nobody").guid()._weak);
+	ASSERT_EQ(1000, named_count(universe, "enemy"));
+	for (int i = 0; i < 1000; ++i)
+		ASSERT_TRUE(named_has(universe, ("n" + std::to_string(i)).c_str(), numbered[i]));
+
+	// detaching (or removing) takes them out of the index; the rest are still found
+	whippet::porcelain::component<whippet::name>(player, 0).detach();
+	ASSERT_EQ(1, whippet::porcelain::component_count<whippet::name>(player));
+	for (int i = 0; i < 1000; i += 2)
+		numbered[i].remove();
+
+	const bool hero = pal::adler::sum("hero") == whippet::porcelain::component<whippet::name>(player, 0)._key;
+	ASSERT_EQ(hero ? whippet::guid_t(0) : player.guid(), universe.named("player").guid());
+	ASSERT_EQ(hero ? player.guid() : whippet::guid_t(0), universe.named("hero").guid());
+	ASSERT_EQ(500, named_count(universe, "enemy"));
+	for (int i = 0; i < 1000; ++i)
+		ASSERT_EQ(1 == i % 2, named_has(universe, ("n" + std::to_string(i)).c_str(), numbered[i]));
+
+	// these two have the same adler sum; they're only told apart if the text is kept
+	static_assert(pal::adler::sum("abc")._weak == pal::adler::sum("b`d")._weak, "a collision");
+	universe.create().attach<whippet::name>("abc");
+	universe.create().attach<whippet::name>("b`d");
+#ifdef whippet__names_compare
+	ASSERT_EQ(1, named_count(universe, "abc"));
+#else
+	ASSERT_EQ(2, named_count(universe, "abc"));
+#endif
+
+	// names are serial components, so, they come back with a snapshot
+	std::stringstream stream;
+	universe.snapshot(stream);
+
+	whippet::universe copy;
+	copy.install<whippet::name>();
+	ASSERT_TRUE(copy.restore(stream));
+	ASSERT_EQ(500, named_count(copy, "enemy"));
+	ASSERT_TRUE(named_has(copy, "n7", numbered[7]));
+	ASSERT_FALSE(named_has(copy, "n8", numbered[8]));
+}
+
+namespace
+{
+	struct weight : whippet::_component
+	{
+		float _weight;
+		weight(const float value) : _weight(value) {}
+	};
+
+	struct title : whippet::_component
+	{
+		std::string _text;
+		title(std::string text) : _text(std::move(text)) {}
+	};
+
+	/// the same calls on either sort of universe; every third entity goes, and, what's left is counted up
+	template<typename U>
+	std::map<uint32_t, std::string> populate(U& universe)
+	{
+		universe.template install<weight>();
+		universe.template install<title>();
+
+		std::vector<decltype(universe.create())> made;
+		for (int i = 0; i < 3000; ++i)
+		{
+			auto next = universe.create();
+			next.template attach<weight>(static_cast<float>(i));
+			if (0 == i % 2)
+				next.template attach<title>("t" + std::to_string(i));
+			made.push_back(next);
+		}
+
+		for (size_t i = 0; i < made.size(); i += 3)
+			made[i].remove();
+
+		float total = 0;
+		universe.template visit<float, weight>(total, [](float& total, weight& next)
+		{
+			total += next._weight;
+			return true;
+		});
+		EXPECT_EQ(3000000.0f, total);
+
+		std::map<uint32_t, std::string> found;
+		for (auto entity : made)
+			entity.template visit<std::map<uint32_t, std::string>, title>(found, [](std::map<uint32_t, std::string>& found, title& next)
+			{
+				found[static_cast<uint32_t>(std::stoi(next._text.substr(1)))] = next._text;
+				return true;
+			});
+
+		size_t components = 0;
+		made[1].template visit<size_t, whippet::_component>(components, [](size_t& components, whippet::_component&)
+		{
+			++components;
+			return true;
+		});
+		EXPECT_EQ(1, components);
+
+		return found;
+	}
+}
+
+/// a static_universe does what a universe does (through the same calls)
+TEST(whippet, static_universe)
+{
+	whippet::universe dynamic;
+	whippet::static_universe<weight, title> fixed;
+
+	static_assert(whippet::static_universe<weight, title>::installed<title>(), "listed");
+	static_assert(!whippet::static_universe<weight, title>::installed<spot>(), "not listed");
+
+	const auto expected = populate(dynamic);
+	ASSERT_EQ(expected, populate(fixed));
+	ASSERT_EQ(1000, expected.size());
+
+	// guids are handed back out; and, columns and detach go through the universe
+	auto again = fixed.create();
+	ASSERT_GE(3000u, again.guid()._weak);
+
+	auto& heavy = again.attach<weight>(5.0f);
+	float total = 0;
+	fixed.columns<float, weight>(total, [](float& total, whippet::column<weight>& run)
+	{
+		for (auto& next : run)
+			total += next._weight;
+		return true;
+	});
+
+	float visited = 0;
+	fixed.visit<float, weight>(visited, [](float& total, weight& next) { total += next._weight; return true; });
+	ASSERT_EQ(visited, total);
+
+	fixed.detach(heavy);
+	size_t left = 0;
+	again.visit<size_t, whippet::_component>(left, [](size_t& left, whippet::_component&) { ++left; return true; });
+	ASSERT_EQ(0, left);
+}
+
+namespace
+{
+	/// an offset from the parent, and, the sum of them from the root
+	struct placement
+	{
+		int64_t _local;
+		int64_t _world;
+		placement(const int64_t local) : _local(local), _world(0) {}
+	};
+
+	/// after a propagate() every node's _world should be what walking up through its parents adds up to
+	void check_placements(whippet::hierarchy<placement>& tree, const std::vector<whippet::entity>& nodes)
+	{
+		int visited = 0;
+		tree.propagate<int>(visited, [](int& visited, placement& node, const placement* parent)
+		{
+			node._world = node._local + (nullptr == parent ? 0 : parent->_world);
+			++visited;
+		});
+		ASSERT_EQ(tree.size(), static_cast<size_t>(visited));
+
+		size_t present = 0;
+		for (auto node : nodes)
+		{
+			if (!tree.contains(node))
+				continue;
+
+			++present;
+
+			int64_t expected = 0;
+			uint32_t depth = 0;
+			for (auto next = node; 0 != next.guid()._weak; next = tree.parent(next), ++depth)
+				expected += tree.get(next)._local;
+
+			ASSERT_EQ(expected, tree.get(node)._world);
+			ASSERT_EQ(depth - 1, tree.depth(node));
+		}
+		ASSERT_EQ(present, tree.size());
+	}
+}
+
+/// the hierarchy keeps parents ahead of their children through inserts, reparents and erases
+TEST(whippet, hierarchy)
+{
+	whippet::universe universe;
+	auto& tree = universe.system<whippet::hierarchy<placement>>();
+
+	uint32_t random = 1;
+	auto next = [&random](const uint32_t range)
+	{
+		random = random * 1664525u + 1013904223u;
+		return (random >> 8) % range;
+	};
+
+	std::vector<whippet::entity> nodes;
+	for (int i = 0; i < 2000; ++i)
+	{
+		auto node = universe.create();
+		const auto parent = (nodes.empty() || 0 == next(20)) ? whippet::entity() : nodes[next(static_cast<uint32_t>(nodes.size()))];
+		tree.insert(node, parent, static_cast<int64_t>(i));
+		nodes.push_back(node);
+	}
+	ASSERT_EQ(2000u, tree.size());
+	check_placements(tree, nodes);
+
+	size_t children = 0;
+	tree.children<size_t>(nodes[0], children, [](size_t& children, whippet::entity) { ++children; return true; });
+	ASSERT_LT(0u, children);
+
+	for (int round = 0; round < 20; ++round)
+	{
+		// move things about; but, never under themselves
+		for (int i = 0; i < 50; ++i)
+		{
+			auto node = nodes[next(static_cast<uint32_t>(nodes.size()))];
+			auto parent = 0 == next(10) ? whippet::entity() : nodes[next(static_cast<uint32_t>(nodes.size()))];
+			if (!tree.contains(node) || (0 != parent.guid()._weak && !tree.contains(parent)))
+				continue;
+
+			bool under = false;
+			for (auto up = parent; 0 != up.guid()._weak && !under; up = tree.parent(up))
+				under = up.guid() == node.guid();
+
+			if (!under)
+				tree.reparent(node, parent);
+		}
+		check_placements(tree, nodes);
+
+		// take out some branches and grow some new ones
+		for (int i = 0; i < 3; ++i)
+		{
+			auto node = nodes[next(static_cast<uint32_t>(nodes.size()))];
+			if (tree.contains(node))
+				tree.erase(node);
+		}
+		for (int i = 0; i < 20; ++i)
+		{
+			auto parent = nodes[next(static_cast<uint32_t>(nodes.size()))];
+			auto node = universe.create();
+			tree.insert(node, tree.contains(parent) ? parent : whippet::entity(), static_cast<int64_t>(round * 100 + i));
+			nodes.push_back(node);
+		}
+		check_placements(tree, nodes);
+	}
+
+	// everything goes
+	for (auto node : nodes)
+		if (tree.contains(node) && 0 == tree.depth(node))
+			tree.erase(node);
+	ASSERT_EQ(0u, tree.size());
+}
+
+/// copies of a prefab have what the entity it was made from had; with their own guids
+TEST(whippet, prefab)
+{
+	whippet::universe universe;
+	universe.install<spot>();
+	universe.install<marked>();
+	universe.install<label>();
+
+	// some holes for the copies to go into
+	std::vector<whippet::entity> before;
+	for (int i = 0; i < 3000; ++i)
+	{
+		auto next = universe.create();
+		next.attach<spot>(-1.0f, -1.0f);
+		before.push_back(next);
+	}
+	for (size_t i = 0; i < before.size(); i += 3)
+		before[i].remove();
+
+	auto source = universe.create();
+	source.attach<spot>(1.0f, 2.0f);
+	source.attach<spot>(3.0f, 4.0f);
+	source.attach<marked>(0);
+	source.attach<label>("copied");
+
+	const whippet::prefab prefab(source);
+	auto made = universe.instantiate(prefab, 5000);
+	ASSERT_EQ(5000, made.size());
+
+	const auto found_spots = spots(universe);
+	const auto found_labels = labels(universe);
+	const auto found_marks = marks(universe);
+
+	const float expected = spots(universe)[source.guid()._weak];
+	for (auto next : made)
+	{
+		ASSERT_EQ(2, whippet::porcelain::component_count<spot>(next));
+		ASSERT_EQ(expected, found_spots.at(next.guid()._weak));
+		ASSERT_EQ("copied", found_labels.at(next.guid()._weak));
+		ASSERT_EQ(1, found_marks.count(next.guid()._weak));
+	}
+
+	// every guid (entity or component) is handed out once
+	std::pair<std::set<uint32_t>, size_t> guids;
+	for (size_t i = 1; i < before.size(); i += 3)
+	{
+		guids.first.insert(before[i].guid()._weak);
+		guids.first.insert(before[i + 1].guid()._weak);
+		guids.second += 2;
+	}
+	for (auto next : made)
+	{
+		guids.first.insert(next.guid()._weak);
+		++guids.second;
+	}
+	universe.visit<std::pair<std::set<uint32_t>, size_t>, spot>(guids, [](std::pair<std::set<uint32_t>, size_t>& guids, spot& next)
+	{
+		guids.first.insert(next.guid()._weak);
+		++guids.second;
+		return true;
+	});
+	ASSERT_EQ(guids.second, guids.first.size());
+	ASSERT_EQ(0, guids.first.count(universe.create().guid()._weak));
+
+	// copies go like anything else; and, the prefab works in another universe with the same types
+	made[17].remove();
+	ASSERT_EQ(0, whippet::porcelain::component_count<spot>(made[17]));
+
+	whippet::universe other;
+	other.install<spot>();
+	other.install<marked>();
+	other.install<label>();
+
+	const auto elsewhere = other.instantiate(prefab, 3);
+	ASSERT_EQ(3, spots(other).size());
+	ASSERT_EQ(3, marks(other).size());
+	ASSERT_EQ("copied", labels(other)[elsewhere[2].guid()._weak]);
+
+	// nothing's made (or handed a guid) in a universe without all of the types
+	whippet::universe missing;
+	missing.install<spot>();
+	missing.install<marked>();
+
+	whippet::universe control;
+	control.install<spot>();
+	control.install<marked>();
+
+	missing.create();
+	control.create();
+	ASSERT_TRUE(missing.instantiate(prefab, 3).empty());
+	ASSERT_TRUE(spots(missing).empty());
+	ASSERT_EQ(control.create().guid(), missing.create().guid());
+
+	// nor from an entity with something that can't be copied
+	universe.install<scratch>();
+	source.attach<scratch>(1);
+
+	const whippet::prefab partial(source);
+	ASSERT_FALSE(partial.whole());
+	ASSERT_TRUE(universe.instantiate(partial, 3).empty());
+	ASSERT_TRUE(prefab.whole());
+}
+
+#ifdef __cpp_impl_coroutine
+namespace
+{
+	/// waits for a tick, then three more, then a siren
+	whippet::task patrol(std::vector<std::string>& log, pal::event_manager<siren>& sirens)
+	{
+		log.push_back("started");
+
+		co_await whippet::next_tick();
+		log.push_back("ticked");
+
+		co_await whippet::delay(3);
+		log.push_back("waited");
+
+		const auto heard = co_await whippet::event<siren>(sirens);
+		log.push_back("siren " + std::to_string(heard._code));
+	}
+
+	/// waits for a long time; counting each time it's resumed
+	whippet::task idle(int& resumed)
+	{
+		for (;;)
+		{
+			co_await whippet::delay(1000000);
+			++resumed;
+		}
+	}
+}
+
+/// tasks carry on from where they were when what they're waiting for comes; and, not before
+TEST(whippet, tasks)
+{
+	pal::event_manager<siren> sirens(64);
+	whippet::universe universe;
+	auto& scheduler = universe.system<whippet::scheduler>();
+
+	std::vector<std::string> log;
+	scheduler.spawn(patrol(log, sirens));
+	ASSERT_EQ(std::vector<std::string>({ "started" }), log);
+
+	scheduler.tick();
+	ASSERT_EQ(std::vector<std::string>({ "started", "ticked" }), log);
+
+	scheduler.tick();
+	scheduler.tick();
+	ASSERT_EQ(2, log.size());
+	scheduler.tick();
+	ASSERT_EQ("waited", log.back());
+
+	// nothing comes without a siren
+	for (int i = 0; i < 10; ++i)
+		scheduler.tick();
+	ASSERT_EQ(3, log.size());
+
+	// the siren comes in on the event thread; the task is resumed by a tick
+	sirens.broadcast(siren{ 7 });
+	for (int i = 0; i < 1000 && 4 != log.size(); ++i)
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		scheduler.tick();
+	}
+	ASSERT_EQ("siren 7", log.back());
+	ASSERT_EQ(0, scheduler.size());
+
+	// waiting tasks aren't touched; they're still there (and go with the universe)
+	int resumed = 0;
+	for (int i = 0; i < 1000; ++i)
+		scheduler.spawn(idle(resumed));
+
+	const auto before = scheduler.now();
+	for (int i = 0; i < 100; ++i)
+		scheduler.tick();
+	ASSERT_EQ(before + 100, scheduler.now());
+	ASSERT_EQ(0, resumed);
+	ASSERT_EQ(1000, scheduler.size());
+
+	// finished frames are reused
+	auto frame = whippet::frame_pool::allocate(200);
+	whippet::frame_pool::release(frame, 200);
+	ASSERT_EQ(frame, whippet::frame_pool::allocate(200));
+	whippet::frame_pool::release(frame, 200);
+}
+#endif